@@ -1,23 +1,1001 @@
 #include "assembly_generator.h"
 
-void generate_assembly(ast_node *node) {
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "constant.h"
+#include "pattern.h"
+
+#define ENTRY_FUNCTION "main"
+#define LABEL "..@L%lu"
+#define FUNCTION_SYMBOL "$%s.%s"
+#define VAR_SHIFT 3
+#define STACK_ALIGNMENT 16
+#define REGISTER_PARAMS 6
+#define STACK_PARAM_OFFSET 16
+#define BYTES_PER_LINE 16
+
+#define DEFINITION_SECTION "section %s.%s.%s %s"
+#define TEXT_SECTION ".text"
+#define RODATA_SECTION ".rodata"
+#define DATA_SECTION ".data"
+#define BSS_SECTION ".bss"
+#define TEXT_ATTRIBUTES "progbits alloc exec nowrite align=16"
+#define RODATA_ATTRIBUTES "progbits alloc noexec nowrite align=8"
+#define DATA_ATTRIBUTES "progbits alloc noexec write align=8"
+#define BSS_ATTRIBUTES "nobits alloc noexec write align=8"
+
+#define INIT_RUNTIME "rt_init"
+#define EXIT_RUNTIME "rt_exit"
+#define PARALLEL_FOR_RUNTIME "rt_parallel_for"
+#define PRINT_I64_RUNTIME "rt_print_i64"
+#define PRINT_STR_RUNTIME "rt_print_str"
+#define PRINT_SEPARATOR ' '
+#define PRINT_TERMINATOR '\n'
+#define MAX_THREADS 64
+#define ACCUMULATORS_SHIFT 6
+
+#define MAX_LINEAR_CASES 3
+#define MIN_JUMP_TABLE_CASES 4
+#define MAX_JUMP_TABLE_SIZE 4096
+#define MIN_JUMP_TABLE_DENSITY 40
+#define BIT_TEST_WIDTH 64
+#define MAX_BIT_TEST_DESTINATIONS 3
+
+typedef struct match_case_s {
+    int64_t value;
+    size_t label;
+} match_case;
+
+typedef enum cluster_kind_e {
+    SINGLE_CASE,
+    BIT_TEST,
+    JUMP_TABLE,
+} cluster_kind;
+
+typedef struct case_cluster_s {
+    match_case *cases;
+    size_t count;
+    cluster_kind kind;
+} case_cluster;
+
+static char *param_registers[REGISTER_PARAMS] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
+
+/**
+ * State of the assembly being generated for a program. Sections other than .text are buffered in memory while a
+ * definition is emitted
+ */
+typedef struct assembler_s {
+    FILE *text_out;
+    FILE *rodata_out;
+    FILE *data_out;
+    FILE *bss_out;
+    char *rodata;
+    char *data;
+    char *bss;
+    size_t rodata_size;
+    size_t data_size;
+    size_t bss_size;
+    function_node *curr_function;
+    size_t label_count;
+    size_t return_label;
+    size_t stack_depth;
+    vec parallel_bodies;
+    vec runtime_symbols;
+    char *module;
+} assembler;
+
+static __thread assembler *gen;
+
+static void emit(const char *instruction, ...) {
+    va_list args;
+    va_start(args, instruction);
+
+    fputs("    ", gen->text_out);
+    vfprintf(gen->text_out, instruction, args);
+    fputc('\n', gen->text_out);
+    va_end(args);
+}
+
+static void emit_label(size_t label) {
+    fprintf(gen->text_out, LABEL ":\n", label);
+}
+
+static void declare_runtime_symbol(char *symbol) {
+    if (!vec_conatins(gen->runtime_symbols, symbol, (int (*)(void*, void*)) &strcmp)) {
+        emit("extern %s", symbol);
+        vec_push(gen->runtime_symbols, symbol);
+    }
+}
+
+/**
+ * Calls a function of the runtime library with its arguments already in registers, declaring it on first use
+ * and aligning the stack to 16 bytes at the call
+ * @param symbol Name of the runtime function
+ */
+static void emit_runtime_call(char *symbol) {
+    declare_runtime_symbol(symbol);
+
+    size_t padding = gen->stack_depth & 1;
+    if (padding) {
+        emit("sub rsp, %d", 1 << VAR_SHIFT);
+    }
+    emit("call %s", symbol);
+    if (padding) {
+        emit("add rsp, %d", 1 << VAR_SHIFT);
+    }
+}
+
+static void emit_statements(vec statements) {
+    vec_iter(ast_node *statement, statements, statement->generate_assembly(statement))
+}
+
+static bool fits_imm32(int64_t value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+/**
+ * Compares rax to a constant, values that do not fit an immediate are loaded into rcx first
+ * @param value Constant to compare against
+ */
+static void emit_compare(int64_t value) {
+    if (fits_imm32(value)) {
+        emit("cmp rax, %ld", value);
+    } else {
+        emit("mov rcx, %ld", value);
+        emit("cmp rax, rcx");
+    }
+}
+
+/**
+ * Gets the stack offset of a variable's slot in the frame of the function declaring it
+ * @param var Variable
+ * @return size_t: offset below the frame pointer of the variable's slot
+ */
+static size_t var_offset(var_node *var) {
+    return (size_t) (var->slot + 1) << VAR_SHIFT;
+}
+
+/**
+ * Loads a variable into a register, variables of the function enclosing a parallel for body are read through the
+ * frame pointer the body gets as its context
+ * @param node Variable
+ * @param reg Register to load into
+ */
+static void emit_load_var(ast_node *node, char *reg) {
+    var_node *var = node->node;
+
+    if (var->scope == gen->curr_function->func_namespace.depth) {
+        emit("mov %s, [rbp - %lu]", reg, var_offset(var));
+    } else if (var->scope != 0) {
+        emit("mov %s, [rbp - %lu]", reg, (PARALLEL_CONTEXT + 1) << VAR_SHIFT);
+        emit("mov %s, [%s - %lu]", reg, reg, var_offset(var));
+    } else {
+        emit("mov %s, [rel $%s]", reg, var->name);
+    }
+}
+
+/**
+ * Stores rax into a variable, clobbers rcx when the variable is in the enclosing function's frame
+ * @param node Variable
+ */
+static void emit_store_var(ast_node *node) {
+    var_node *var = node->node;
+
+    if (var->scope == gen->curr_function->func_namespace.depth) {
+        emit("mov [rbp - %lu], rax", var_offset(var));
+    } else if (var->scope != 0) {
+        emit("mov rcx, [rbp - %lu]", (PARALLEL_CONTEXT + 1) << VAR_SHIFT);
+        emit("mov [rcx - %lu], rax", var_offset(var));
+    } else {
+        emit("mov [rel $%s], rax", var->name);
+    }
+}
+
+static void parallel_body_assembly(for_node *loop);
+
+void function_assembly(ast_node *node) {
+    function_node *func_node = node->node;
+    gen->curr_function = func_node;
+    gen->return_label = gen->label_count++;
+    gen->stack_depth = 0;
+
+    size_t frame_size = vec_len(func_node->func_namespace.vars) << VAR_SHIFT;
+    frame_size = (frame_size + STACK_ALIGNMENT - 1) & ~(size_t) (STACK_ALIGNMENT - 1);
+
+    emit(DEFINITION_SECTION, TEXT_SECTION, gen->module, func_node->name, TEXT_ATTRIBUTES);
+    fprintf(gen->text_out, "    global " FUNCTION_SYMBOL "\n" FUNCTION_SYMBOL ":\n", gen->module, func_node->name,
+        gen->module, func_node->name);
+    emit("push rbp");
+    emit("mov rbp, rsp");
+    if (frame_size > 0) {
+        emit("sub rsp, %lu", frame_size);
+    }
+
+    for (size_t i = 0; i < func_node->param_count; i++) {
+        size_t offset = (i + 1) << VAR_SHIFT;
+        if (i < REGISTER_PARAMS) {
+            emit("mov [rbp - %lu], %s", offset, param_registers[i]);
+        } else {
+            emit("mov rax, [rbp + %lu]", STACK_PARAM_OFFSET + ((i - REGISTER_PARAMS) << VAR_SHIFT));
+            emit("mov [rbp - %lu], rax", offset);
+        }
+    }
+
+    emit_statements(func_node->statements);
+
+    emit("xor eax, eax");
+    emit_label(gen->return_label);
+    emit("leave");
+    emit("ret");
+
+    vec_iter(for_node *loop, gen->parallel_bodies, parallel_body_assembly(loop))
+    vec_free(gen->parallel_bodies);
+    gen->parallel_bodies = vec_new();
+}
+
+void assignment_assembly(ast_node *node) {
+    binary_operation_node *op_node = node->node;
+    op_node->right->generate_assembly(op_node->right);
+    emit_store_var(op_node->left);
+}
+
+/**
+ * Evaluates both operands of a binary operation, leaving the left in rax and the right in rcx
+ * @param node Binary operation node
+ */
+static void binary_operands_assembly(ast_node *node) {
+    binary_operation_node *op_node = node->node;
+    op_node->left->generate_assembly(op_node->left);
+    emit("push rax");
+    gen->stack_depth++;
+    op_node->right->generate_assembly(op_node->right);
+    emit("mov rcx, rax");
+    emit("pop rax");
+    gen->stack_depth--;
+}
+
+void mul_assembly(ast_node *node) {
+    binary_operands_assembly(node);
+    emit("imul rax, rcx");
+}
+
+void div_assembly(ast_node *node) {
+    binary_operands_assembly(node);
+    emit("cqo");
+    emit("idiv rcx");
+}
+
+void mod_assembly(ast_node *node) {
+    binary_operands_assembly(node);
+    emit("cqo");
+    emit("idiv rcx");
+    emit("mov rax, rdx");
+}
+
+void add_assembly(ast_node *node) {
+    binary_operands_assembly(node);
+    emit("add rax, rcx");
+}
+
+void sub_assembly(ast_node *node) {
+    binary_operands_assembly(node);
+    emit("sub rax, rcx");
+}
+
+void or_assembly(ast_node *node) {
+    binary_operands_assembly(node);
+    emit("or rax, rcx");
+}
+
+void xor_assembly(ast_node *node) {
+    binary_operands_assembly(node);
+    emit("xor rax, rcx");
+}
+
+void and_assembly(ast_node *node) {
+    binary_operands_assembly(node);
+    emit("and rax, rcx");
+}
+
+void load_assembly(ast_node *node) {
+    emit_load_var(node, "rax");
+}
+
+static char unescape(char c) {
+    switch (c) {
+        case 'n': return '\n';
+        case 't': return '\t';
+        case 'r': return '\r';
+        case '0': return '\0';
+        default: return c;
+    }
+}
+
+/**
+ * Emits a string literal into .rodata as its length and a pointer to its bytes, followed by the bytes. Strings
+ * read at runtime use the same layout and point into the input buffer
+ * @param literal String literal token, including the quotes
+ * @return size_t: label of the string
+ */
+static size_t string_literal_assembly(char *literal) {
+    size_t literal_len = strlen(literal) - 2;
+    char bytes[literal_len];
+    size_t len = 0;
+    for (size_t i = 1; i <= literal_len; i++) {
+        bytes[len++] = literal[i] == '\\' && i < literal_len ? unescape(literal[++i]) : literal[i];
+    }
+
+    size_t label = gen->label_count++;
+    size_t bytes_label = gen->label_count++;
+    fprintf(gen->rodata_out, "    align 8\n" LABEL ":\n    dq %lu, " LABEL "\n" LABEL ":\n", label, len, bytes_label,
+        bytes_label);
+    for (size_t i = 0; i < len; i++) {
+        fprintf(gen->rodata_out, i % BYTES_PER_LINE == 0 ? "    db %d" : ", %d", (unsigned char) bytes[i]);
+        if (i % BYTES_PER_LINE == BYTES_PER_LINE - 1 || i + 1 == len) {
+            fputc('\n', gen->rodata_out);
+        }
+    }
+    return label;
+}
+
+void literal_assembly(ast_node *node) {
+    if (node->expr_type->validate_literal == &valid_string_literal) {
+        emit("lea rax, [rel " LABEL "]", string_literal_assembly(node->node));
+    } else {
+        emit("mov rax, %ld", strtol(node->node, NULL, 0));
+    }
+}
+
+/**
+ * Places a module level variable in .bss if it is zero-initialized, otherwise in .data with its constant value
+ * @param node Global variable definition node
+ */
+void global_var_assembly(ast_node *node) {
+    binary_operation_node *op_node = node->node;
+    char *name = var_name(op_node->left);
+    ast_node *value = op_node->right;
+
+    int64_t constant = 0;
+    bool string_literal = value != NULL && value->expr_type->validate_literal == &valid_string_literal;
+    if (value != NULL && !string_literal) {
+        evaluate_constant(value, &constant);
+    }
+
+    if (string_literal) {
+        fprintf(gen->data_out, "    align 8\n$%s:\n    dq " LABEL "\n", name, string_literal_assembly(value->node));
+    } else if (constant == 0) {
+        fprintf(gen->bss_out, "    alignb 8\n$%s:\n    resq 1\n", name);
+    } else {
+        fprintf(gen->data_out, "    align 8\n$%s:\n    dq %ld\n", name, constant);
+    }
+}
+
+/**
+ * Calls a function using the System V calling convention. Arguments are evaluated right to left and pushed, the
+ * register arguments are then popped off leaving the rest on the stack, aligned to 16 bytes at the call
+ * @param node Call node
+ */
+void call_assembly(ast_node *node) {
+    call_node *call = node->node;
+    size_t arg_count = vec_len(call->args);
+    size_t stack_args = arg_count > REGISTER_PARAMS ? arg_count - REGISTER_PARAMS : 0;
+    size_t padding = (gen->stack_depth + stack_args) & 1;
+
+    if (padding) {
+        emit("sub rsp, %d", 1 << VAR_SHIFT);
+    }
+    gen->stack_depth += padding;
+
+    for (size_t i = arg_count; i-- > 0;) {
+        ast_node *arg = vec_get(call->args, i);
+        arg->generate_assembly(arg);
+        emit("push rax");
+        gen->stack_depth++;
+    }
+    for (size_t i = 0; i < arg_count - stack_args; i++) {
+        emit("pop %s", param_registers[i]);
+        gen->stack_depth--;
+    }
+
+    function_node *func_node = call->function->node;
+    if (func_node->extern_symbol != NULL) {
+        declare_runtime_symbol(func_node->extern_symbol);
+        emit("call %s", func_node->extern_symbol);
+    } else {
+        emit("call " FUNCTION_SYMBOL, gen->module, func_node->name);
+    }
+    if (stack_args + padding > 0) {
+        emit("add rsp, %lu", (stack_args + padding) << VAR_SHIFT);
+    }
+    gen->stack_depth -= stack_args + padding;
+}
+
+void return_assembly(ast_node *node) {
+    ast_node *value = node->node;
+    if (value != NULL) {
+        value->generate_assembly(value);
+    } else {
+        emit("xor eax, eax");
+    }
+    emit("jmp " LABEL, gen->return_label);
 }
 
-void function_assembly(ast_node*) {}
+/**
+ * Emits a for loop, the loop's invariants are computed once before the first iteration and skipped along with the
+ * loop when its range is empty
+ * @param node For node
+ */
+void for_assembly(ast_node *node) {
+    for_node *loop = node->node;
+    size_t body_label = gen->label_count++;
+    size_t cond_label = gen->label_count++;
+    size_t done_label = gen->label_count++;
 
-void assignment_assembly(ast_node*) {}
+    loop->end->generate_assembly(loop->end);
+    emit_store_var(loop->end_var);
+    loop->start->generate_assembly(loop->start);
+    emit_store_var(loop->var);
+    if (vec_len(loop->invariants) > 0) {
+        emit_load_var(loop->end_var, "rcx");
+        emit("cmp rax, rcx");
+        emit("jge " LABEL, done_label);
+        emit_statements(loop->invariants);
+    } else {
+        emit("jmp " LABEL, cond_label);
+    }
 
-void mul_assembly(ast_node*) {}
+    emit_label(body_label);
+    emit_statements(loop->statements);
+    emit_load_var(loop->var, "rax");
+    emit("inc rax");
+    emit_store_var(loop->var);
 
-void div_assembly(ast_node*) {}
+    emit_label(cond_label);
+    emit_load_var(loop->var, "rax");
+    emit_load_var(loop->end_var, "rcx");
+    emit("cmp rax, rcx");
+    emit("jl " LABEL, body_label);
+    if (vec_len(loop->invariants) > 0) {
+        emit_label(done_label);
+    }
+}
+
+static char *reduction_instruction(reduction *loop_reduction) {
+    void (*combine)(ast_node*) = loop_reduction->combine;
+    if (combine == &or_assembly)
+        return "or";
+    if (combine == &xor_assembly)
+        return "xor";
+    if (combine == &and_assembly)
+        return "and";
+    return "add";
+}
+
+static int64_t reduction_identity(reduction *loop_reduction) {
+    return loop_reduction->combine == &and_assembly ? -1 : 0;
+}
+
+/**
+ * Emits the function a parallel for loop's body is outlined into. The runtime calls it with a chunk of the range,
+ * the enclosing frame pointer and the calling thread's index. Reduced variables are private to the call and added
+ * into the thread's accumulators when the chunk is done
+ * @param loop Parallel for loop
+ */
+static void parallel_body_assembly(for_node *loop) {
+    size_t body_label = gen->label_count++;
+    size_t cond_label = gen->label_count++;
+    size_t end_offset = (PARALLEL_END + 1) << VAR_SHIFT;
+    size_t thread_offset = (PARALLEL_THREAD + 1) << VAR_SHIFT;
+    size_t accumulators_offset = (PARALLEL_ACCUMULATORS + 1) << VAR_SHIFT;
+
+    gen->curr_function = loop->body;
+    gen->stack_depth = 0;
+    size_t frame_size = vec_len(loop->body->func_namespace.vars) << VAR_SHIFT;
+    frame_size = (frame_size + STACK_ALIGNMENT - 1) & ~(size_t) (STACK_ALIGNMENT - 1);
+
+    fprintf(gen->text_out, FUNCTION_SYMBOL ":\n", gen->module, loop->body->name);
+    emit("push rbp");
+    emit("mov rbp, rsp");
+    emit("sub rsp, %lu", frame_size);
+    for (size_t i = 0; i < PARALLEL_BODY_PARAMS; i++) {
+        emit("mov [rbp - %lu], %s", (i + 1) << VAR_SHIFT, param_registers[i]);
+    }
+    vec_iter(reduction *loop_reduction, loop->reductions, {
+        emit("mov rax, %ld", reduction_identity(loop_reduction));
+        emit_store_var(loop_reduction->var);
+    })
+    emit("jmp " LABEL, cond_label);
+
+    emit_label(body_label);
+    emit_statements(loop->statements);
+    emit("inc qword [rbp - %d]", 1 << VAR_SHIFT);
+    emit_label(cond_label);
+    emit("mov rax, [rbp - %d]", 1 << VAR_SHIFT);
+    emit("cmp rax, [rbp - %lu]", end_offset);
+    emit("jl " LABEL, body_label);
+
+    emit("mov rcx, [rbp - %lu]", accumulators_offset);
+    emit("mov rdx, [rbp - %lu]", thread_offset);
+    vec_iter(reduction *loop_reduction, loop->reductions, {
+        emit_load_var(loop_reduction->var, "rax");
+        emit("%s [rcx + rdx * 8 + %lu], rax", reduction_instruction(loop_reduction),
+            i << (ACCUMULATORS_SHIFT + VAR_SHIFT));
+    })
+    emit("leave");
+    emit("ret");
+}
+
+/**
+ * Runs a loop's body on chunks of its range across threads. Each reduction gets an accumulator per thread on the
+ * stack, which are combined into the variable in thread order once every chunk is done
+ * @param node Parallel for node
+ */
+void parallel_for_assembly(ast_node *node) {
+    for_node *loop = node->node;
+    size_t reduction_count = vec_len(loop->reductions);
+    size_t accumulator_slots = reduction_count << ACCUMULATORS_SHIFT;
+
+    if (reduction_count > 0) {
+        emit("sub rsp, %lu", accumulator_slots << VAR_SHIFT);
+        gen->stack_depth += accumulator_slots;
+        vec_iter(reduction *loop_reduction, loop->reductions, {
+            emit("lea rdi, [rsp + %lu]", i << (ACCUMULATORS_SHIFT + VAR_SHIFT));
+            emit("mov ecx, %d", MAX_THREADS);
+            emit("mov rax, %ld", reduction_identity(loop_reduction));
+            emit("rep stosq");
+        })
+    }
+
+    loop->end->generate_assembly(loop->end);
+    emit("push rax");
+    gen->stack_depth++;
+    loop->start->generate_assembly(loop->start);
+    emit("mov rdi, rax");
+    emit("pop rsi");
+    gen->stack_depth--;
+
+    if (vec_len(loop->invariants) > 0) {
+        size_t done_label = gen->label_count++;
+        emit("push rdi");
+        emit("push rsi");
+        gen->stack_depth += 2;
+        emit("cmp rdi, rsi");
+        emit("jge " LABEL, done_label);
+        emit_statements(loop->invariants);
+        emit_label(done_label);
+        emit("pop rsi");
+        emit("pop rdi");
+        gen->stack_depth -= 2;
+    }
+
+    emit("lea rdx, [rel " FUNCTION_SYMBOL "]", gen->module, loop->body->name);
+    emit("mov rcx, rbp");
+    if (reduction_count > 0) {
+        emit("mov r8, rsp");
+    } else {
+        emit("xor r8d, r8d");
+    }
+    emit("mov r9d, %d", loop->dynamic);
+    emit_runtime_call(PARALLEL_FOR_RUNTIME);
+
+    vec_iter(reduction *loop_reduction, loop->reductions, {
+        size_t combine_label = gen->label_count++;
+        emit_load_var(loop_reduction->target, "rax");
+        emit("xor edx, edx");
+        emit_label(combine_label);
+        emit("%s rax, [rsp + rdx * 8 + %lu]", reduction_instruction(loop_reduction),
+            i << (ACCUMULATORS_SHIFT + VAR_SHIFT));
+        emit("inc rdx");
+        emit("cmp rdx, %d", MAX_THREADS);
+        emit("jl " LABEL, combine_label);
+        emit_store_var(loop_reduction->target);
+    })
+
+    if (reduction_count > 0) {
+        emit("add rsp, %lu", accumulator_slots << VAR_SHIFT);
+        gen->stack_depth -= accumulator_slots;
+    }
+
+    vec_push(gen->parallel_bodies, loop);
+}
+
+/**
+ * Prints values through the runtime's output buffer, i64s in decimal and strs as their bytes
+ * @param node Print node
+ */
+void print_assembly(ast_node *node) {
+    vec values = node->node;
+    vec_iter(ast_node *value, values, {
+        value->generate_assembly(value);
+        emit("mov rdi, rax");
+        emit("mov esi, %d", i + 1 == vec_len(values) ? PRINT_TERMINATOR : PRINT_SEPARATOR);
+        bool str = value->expr_type->validate_literal == &valid_string_literal;
+        emit_runtime_call(str ? PRINT_STR_RUNTIME : PRINT_I64_RUNTIME);
+    })
+}
+
+static int compare_match_cases(const void *a, const void *b) {
+    int64_t x = ((match_case*) a)->value;
+    int64_t y = ((match_case*) b)->value;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Gets the distance between the smallest and largest case values
+ * @param cases Cases sorted by value
+ * @param count Number of cases
+ * @return uint64_t: max - min
+ */
+static uint64_t case_span(match_case *cases, size_t count) {
+    return (uint64_t) cases[count - 1].value - (uint64_t) cases[0].value;
+}
+
+static size_t count_destinations(match_case *cases, size_t count, size_t *destinations, size_t max_destinations) {
+    size_t destination_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t j = 0;
+        while (j < destination_count && destinations[j] != cases[i].label) {
+            j++;
+        }
+        if (j == destination_count) {
+            if (destination_count == max_destinations)
+                return max_destinations + 1;
+            destinations[destination_count++] = cases[i].label;
+        }
+    }
+
+    return destination_count;
+}
+
+/**
+ * Checks if a cluster of cases is worth dispatching with bit tests, the values must fit in one register and
+ * replace enough compares for their few destinations
+ * @param cases Cases sorted by value
+ * @param count Number of cases
+ * @param destinations Filled with the distinct destination labels
+ * @return size_t: number of destinations, 0 if bit tests are not suitable
+ */
+static size_t bit_test_destinations(match_case *cases, size_t count, size_t *destinations) {
+    if (case_span(cases, count) >= BIT_TEST_WIDTH)
+        return 0;
+
+    size_t destination_count = count_destinations(cases, count, destinations, MAX_BIT_TEST_DESTINATIONS);
+    bool profitable = (destination_count == 1 && count >= 3)
+        || (destination_count == 2 && count >= 5)
+        || (destination_count == 3 && count >= 6);
+
+    return profitable ? destination_count : 0;
+}
+
+static bool jump_table_suitable(match_case *cases, size_t count) {
+    uint64_t span = case_span(cases, count);
+    return count >= MIN_JUMP_TABLE_CASES
+        && span < MAX_JUMP_TABLE_SIZE
+        && count * 100 >= (span + 1) * MIN_JUMP_TABLE_DENSITY;
+}
+
+/**
+ * Rebases rax to the smallest case value and jumps to the default if it is out of the cases' range
+ * @param cases Cases sorted by value
+ * @param count Number of cases
+ * @param default_label Label jumped to when no case matches
+ */
+static void emit_range_check(match_case *cases, size_t count, size_t default_label) {
+    int64_t min = cases[0].value;
+    if (min != 0) {
+        if (fits_imm32(min)) {
+            emit("sub rax, %ld", min);
+        } else {
+            emit("mov rcx, %ld", min);
+            emit("sub rax, rcx");
+        }
+    }
+
+    emit("cmp rax, %lu", case_span(cases, count));
+    emit("ja " LABEL, default_label);
+}
+
+static void emit_bit_tests(match_case *cases, size_t count, size_t *destinations, size_t destination_count,
+    size_t default_label) {
+
+    emit_range_check(cases, count, default_label);
+
+    for (size_t d = 0; d < destination_count; d++) {
+        uint64_t mask = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (cases[i].label == destinations[d]) {
+                mask |= (uint64_t) 1 << (cases[i].value - cases[0].value);
+            }
+        }
+        emit("mov rcx, 0x%lx", mask);
+        emit("bt rcx, rax");
+        emit("jc " LABEL, destinations[d]);
+    }
+    emit("jmp " LABEL, default_label);
+}
+
+static void emit_jump_table(match_case *cases, size_t count, size_t default_label) {
+    size_t table_label = gen->label_count++;
+    emit_range_check(cases, count, default_label);
+    emit("lea rcx, [rel " LABEL "]", table_label);
+    emit("jmp [rcx + rax * 8]");
+
+    fprintf(gen->rodata_out, "    align 8\n" LABEL ":\n", table_label);
+    uint64_t span = case_span(cases, count);
+    match_case *curr_case = cases;
+    for (uint64_t offset = 0; offset <= span; offset++) {
+        size_t label = default_label;
+        if ((uint64_t) curr_case->value - (uint64_t) cases[0].value == offset) {
+            label = curr_case++->label;
+        }
+        fprintf(gen->rodata_out, "    dq " LABEL "\n", label);
+    }
+}
 
-void mod_assembly(ast_node*) {}
+/**
+ * Finds the longest run of cases starting at the first one that can be dispatched together
+ * @param cases Cases sorted by value
+ * @param count Number of cases
+ * @param cluster Filled with the run's length and dispatch kind
+ */
+static void find_cluster(match_case *cases, size_t count, case_cluster *cluster) {
+    size_t destinations[MAX_BIT_TEST_DESTINATIONS];
+    cluster->cases = cases;
+    cluster->count = 1;
+    cluster->kind = SINGLE_CASE;
 
-void add_assembly(ast_node*) {}
+    for (size_t len = 2; len <= count && case_span(cases, len) < MAX_JUMP_TABLE_SIZE; len++) {
+        if (bit_test_destinations(cases, len, destinations) > 0) {
+            cluster->count = len;
+            cluster->kind = BIT_TEST;
+        } else if (jump_table_suitable(cases, len)) {
+            cluster->count = len;
+            cluster->kind = JUMP_TABLE;
+        }
+    }
+}
 
-void sub_assembly(ast_node*) {}
+static void emit_cluster(case_cluster *cluster, size_t default_label) {
+    size_t destinations[MAX_BIT_TEST_DESTINATIONS];
 
-void load_assembly(ast_node*) {}
+    switch (cluster->kind) {
+        case SINGLE_CASE:
+            emit_compare(cluster->cases->value);
+            emit("je " LABEL, cluster->cases->label);
+            emit("jmp " LABEL, default_label);
+            break;
+        case BIT_TEST:
+            emit_bit_tests(cluster->cases, cluster->count, destinations,
+                bit_test_destinations(cluster->cases, cluster->count, destinations), default_label);
+            break;
+        case JUMP_TABLE:
+            emit_jump_table(cluster->cases, cluster->count, default_label);
+            break;
+        default: break;
+    }
+}
+
+/**
+ * Emits a binary decision tree over clusters of cases with the matched value in rax
+ * @param clusters Clusters sorted by value
+ * @param count Number of clusters
+ * @param default_label Label jumped to when no case matches
+ */
+static void lower_clusters(case_cluster *clusters, size_t count, size_t default_label) {
+    bool all_single = true;
+    for (size_t i = 0; i < count; i++) {
+        all_single &= clusters[i].kind == SINGLE_CASE;
+    }
+
+    if (all_single && count <= MAX_LINEAR_CASES) {
+        for (size_t i = 0; i < count; i++) {
+            emit_compare(clusters[i].cases->value);
+            emit("je " LABEL, clusters[i].cases->label);
+        }
+        emit("jmp " LABEL, default_label);
+        return;
+    }
+
+    if (count == 1) {
+        emit_cluster(clusters, default_label);
+        return;
+    }
+
+    size_t mid = count >> 1;
+    size_t left_label = gen->label_count++;
+    size_t right = mid;
+    emit_compare(clusters[mid].cases->value);
+    if (clusters[mid].kind == SINGLE_CASE) {
+        emit("je " LABEL, clusters[right++].cases->label);
+    }
+    emit("jl " LABEL, left_label);
+    lower_clusters(clusters + right, count - right, default_label);
+    emit_label(left_label);
+    lower_clusters(clusters, mid, default_label);
+}
 
-void literal_assembly(ast_node*) {}
+/**
+ * Emits the dispatch for a match's cases with the matched value in rax. Cases are grouped into dense clusters
+ * lowered to jump tables, clusters with few destinations lowered to bit tests, and single cases, then a binary
+ * decision tree picks the cluster
+ * @param cases Cases sorted by value
+ * @param count Number of cases
+ * @param default_label Label jumped to when no case matches
+ */
+static void lower_cases(match_case *cases, size_t count, size_t default_label) {
+    if (count == 0) {
+        emit("jmp " LABEL, default_label);
+        return;
+    }
+
+    case_cluster *clusters = malloc(count * sizeof(case_cluster));
+    size_t cluster_count = 0;
+    for (size_t i = 0; i < count; i += clusters[cluster_count++].count) {
+        find_cluster(cases + i, count - i, clusters + cluster_count);
+    }
+
+    lower_clusters(clusters, cluster_count, default_label);
+    free(clusters);
+}
+
+void match_assembly(ast_node *node) {
+    match_node *match = node->node;
+    size_t end_label = gen->label_count++;
+    size_t default_label = match->default_statements == NULL ? end_label : gen->label_count++;
+    size_t first_arm_label = gen->label_count;
+    gen->label_count += vec_len(match->arms);
+
+    size_t case_count = 0;
+    vec_iter(match_arm *arm, match->arms, case_count += vec_len(arm->values))
+
+    match_case *cases = malloc(case_count * sizeof(match_case));
+    size_t curr_case = 0;
+    vec_iter(match_arm *arm, match->arms, {
+        for (size_t j = 0; j < vec_len(arm->values); j++) {
+            cases[curr_case].value = (int64_t) vec_get(arm->values, j);
+            cases[curr_case++].label = first_arm_label + i;
+        }
+    })
+    qsort(cases, case_count, sizeof(match_case), &compare_match_cases);
+
+    match->value->generate_assembly(match->value);
+    lower_cases(cases, case_count, default_label);
+    free(cases);
+
+    vec_iter(match_arm *arm, match->arms, {
+        emit_label(first_arm_label + i);
+        emit_statements(arm->statements);
+        emit("jmp " LABEL, end_label);
+    })
+
+    if (match->default_statements != NULL) {
+        emit_label(default_label);
+        emit_statements(match->default_statements);
+    }
+    emit_label(end_label);
+}
+
+static bool has_entry_function(program_node *program) {
+    ast_node *function = function_lookup(&program->global_namespace, ENTRY_FUNCTION);
+    return function != NULL && ((function_node*) function->node)->extern_symbol == NULL;
+}
+
+/**
+ * Appends a section buffered in memory to the output
+ * @param name Name of the section
+ * @param section_out Stream the section was written to, closed by this function
+ * @param buffer Buffer backing the stream
+ * @param size Size of the buffer
+ */
+static void emit_section(char *name, FILE *section_out, char **buffer, size_t *size) {
+    fclose(section_out);
+    if (*size > 0) {
+        emit("section %s", name);
+        fwrite(*buffer, sizeof(char), *size, gen->text_out);
+    }
+    free(*buffer);
+}
+
+/**
+ * Moves what a definition wrote to a buffered section into a section of the definition's own, so the linker can
+ * drop it along with the definition when nothing refers to it
+ * @param name Name of the section
+ * @param attributes Attributes of the section
+ * @param symbol Name of the definition
+ * @param section_out Stream the section is written to, reopened empty
+ * @param buffer Buffer backing the stream
+ * @param size Size of the buffer
+ */
+static void flush_definition_section(char *name, char *attributes, char *symbol, FILE **section_out, char **buffer,
+    size_t *size) {
+
+    fflush(*section_out);
+    if (*size == 0)
+        return;
+
+    fclose(*section_out);
+    emit(DEFINITION_SECTION, name, gen->module, symbol, attributes);
+    fwrite(*buffer, sizeof(char), *size, gen->text_out);
+    free(*buffer);
+    *section_out = open_memstream(buffer, size);
+}
+
+static char *definition_symbol(ast_node *definition) {
+    if (definition->generate_assembly == &function_assembly)
+        return ((function_node*) definition->node)->name;
+    return var_name(((binary_operation_node*) definition->node)->left);
+}
+
+/**
+ * Starts the assembly for a program on the calling thread, the entry point is emitted if the program defines one.
+ * Definitions can be emitted once every function of the program is declared, from the same thread
+ * @param root Root of the program's AST
+ * @param output File the assembly is written to
+ */
+void begin_assembly(ast_node *root, FILE *output) {
+    program_node *program = root->node;
+    gen = malloc(sizeof(assembler));
+    gen->text_out = output;
+    gen->rodata_out = open_memstream(&gen->rodata, &gen->rodata_size);
+    gen->data_out = open_memstream(&gen->data, &gen->data_size);
+    gen->bss_out = open_memstream(&gen->bss, &gen->bss_size);
+    gen->label_count = 0;
+    gen->stack_depth = 0;
+    gen->parallel_bodies = vec_new();
+    gen->runtime_symbols = vec_new();
+    gen->module = program->module;
+
+    emit("section " TEXT_SECTION);
+    if (program->entry && has_entry_function(program)) {
+        emit("global _start");
+        fputs("_start:\n", gen->text_out);
+        emit_runtime_call(INIT_RUNTIME);
+        emit("call " FUNCTION_SYMBOL, gen->module, ENTRY_FUNCTION);
+        emit("mov rdi, rax");
+        emit_runtime_call(EXIT_RUNTIME);
+    }
+}
+
+/**
+ * Emits a definition and then the data it uses, so nothing about a function has to be kept once it is emitted.
+ * Every definition gets sections of its own, so a linker collecting unused sections drops whatever no reachable
+ * code refers to, across modules
+ * @param definition Function or global variable definition
+ */
+void stream_definition_assembly(ast_node *definition) {
+    definition->generate_assembly(definition);
+
+    char *symbol = definition_symbol(definition);
+    flush_definition_section(RODATA_SECTION, RODATA_ATTRIBUTES, symbol, &gen->rodata_out, &gen->rodata,
+        &gen->rodata_size);
+    flush_definition_section(DATA_SECTION, DATA_ATTRIBUTES, symbol, &gen->data_out, &gen->data, &gen->data_size);
+    flush_definition_section(BSS_SECTION, BSS_ATTRIBUTES, symbol, &gen->bss_out, &gen->bss, &gen->bss_size);
+}
+
+/**
+ * Finishes the assembly for a program
+ */
+void end_assembly() {
+    emit_section(RODATA_SECTION, gen->rodata_out, &gen->rodata, &gen->rodata_size);
+    emit_section(DATA_SECTION, gen->data_out, &gen->data, &gen->data_size);
+    emit_section(BSS_SECTION, gen->bss_out, &gen->bss, &gen->bss_size);
+    vec_free(gen->parallel_bodies);
+    vec_free(gen->runtime_symbols);
+    free(gen);
+    gen = NULL;
+}
+
+/**
+ * Generates nasm assembly for a program
+ * @param root Root of the program's AST
+ * @param output File the assembly is written to
+ */
+void generate_assembly(ast_node *root, FILE *output) {
+    program_node *program = root->node;
+    begin_assembly(root, output);
+    vec_iter(ast_node *definition, program->definitions, stream_definition_assembly(definition))
+    end_assembly();
+}
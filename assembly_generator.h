@@ -1,9 +1,17 @@
 #ifndef ASSEMBLY_GENERATOR_H
 #define ASSEMBLY_GENERATOR_H
 
+#include <stdio.h>
+
 #include "ast_node.h"
 
-void generate_assembly(ast_node *);
+void generate_assembly(ast_node *root, FILE *output);
+
+void begin_assembly(ast_node *root, FILE *output);
+
+void stream_definition_assembly(ast_node *definition);
+
+void end_assembly();
 
 void function_assembly(ast_node*);
 
@@ -19,8 +27,28 @@ void add_assembly(ast_node*);
 
 void sub_assembly(ast_node*);
 
+void or_assembly(ast_node*);
+
+void xor_assembly(ast_node*);
+
+void and_assembly(ast_node*);
+
 void load_assembly(ast_node*);
 
 void literal_assembly(ast_node*);
 
+void global_var_assembly(ast_node*);
+
+void call_assembly(ast_node*);
+
+void return_assembly(ast_node*);
+
+void print_assembly(ast_node*);
+
+void for_assembly(ast_node*);
+
+void parallel_for_assembly(ast_node*);
+
+void match_assembly(ast_node*);
+
 #endif //ASSEMBLY_GENERATOR_H
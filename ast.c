@@ -7,18 +7,220 @@
 #include <string.h>
 
 #include "assembly_generator.h"
+#include "dag.h"
+#include "diagnostics.h"
 #include "expression.h"
+#include "interner.h"
+#include "module.h"
+#include "pattern.h"
+#include "pipeline.h"
 #include "types.h"
 #include "util.h"
 
 #define MIN_SYMBOL_DEF_LEN 4
+#define SYMBOL_DECLARATION_LEN 2
 #define PARAM_MIN_TOKENS 3
 #define PARAM_START 3
 #define PARAM_SEP ","
 
+#define MIN_KEYWORD_STATEMENT_LEN 2
+#define IMPORT_LEN 2
+#define FOR_HEADER_MIN_LEN 6
+#define REDUCTION_LEN 2
+#define MAX_HIDDEN_NAME_LEN 32
+#define NOT_SKIPPING SIZE_MAX
+
 #define ASSIGNMENT "="
 #define PAREN_OPEN "("
 #define PAREN_CLOSE ")"
+#define NEGATE "-"
+#define REDUCE_ADD "+"
+#define REDUCE_OR "|"
+#define REDUCE_XOR "^"
+#define REDUCE_AND "&"
+
+#define LOOP_VAR_TYPE "i64"
+#define MATCH_TYPE "i64"
+#define RUNTIME_PARAM_TYPE "i64"
+#define END_VAR ".end%lu"
+#define PARALLEL_BODY_NAME "%s.parallel%lu"
+
+#define ENTRY_FUNCTION "main"
+
+#define IMPORT "import"
+#define PURE "pure"
+#define RETURN "return"
+#define PRINT "print"
+#define MATCH "match"
+#define CASE "case"
+#define ELSE "else"
+#define FOR "for"
+#define PARALLEL "parallel"
+#define DYNAMIC "dynamic"
+#define REDUCE "reduce"
+
+typedef struct runtime_function_s {
+    char *name;
+    char *symbol;
+    size_t param_count;
+    char *return_type;
+} runtime_function;
+
+static runtime_function runtime_functions[] = {
+    {"alloc", "rt_alloc", 1, "i64"},
+    {"free", "rt_free", 1, "i64"},
+    {"arena", "rt_arena_new", 0, "i64"},
+    {"arena_alloc", "rt_arena_alloc", 2, "i64"},
+    {"arena_reset", "rt_arena_reset", 1, "i64"},
+    {"arena_free", "rt_arena_free", 1, "i64"},
+    {"load", "rt_load", 1, "i64"},
+    {"store", "rt_store", 2, "i64"},
+    {"read_i64", "rt_read_i64", 0, "i64"},
+    {"read_line", "rt_read_line", 0, "str"},
+    {}
+};
+
+typedef struct block_s {
+    size_t indent;
+    vec statements;
+    ast_node *owner;
+} block;
+
+/**
+ * State of a pass over the lines of a file, kept in memory so it survives a line being abandoned after an error
+ */
+typedef struct parser_s {
+    compilation *unit;
+    uint32_t file;
+    lexed_line lexed;
+    ast_node *root;
+    vec blocks;
+    vec namespaces;
+    ast_node *open_function;
+    void (*function_defined)(void*, ast_node*, ast_node*);
+    void *defined_context;
+    bool share_expressions;
+    bool skip_definitions;
+    bool definitions_started;
+    size_t line_indent;
+    size_t skip_indent;
+} parser;
+
+/**
+ * Bodies waiting to be parsed when bodies are parsed on demand, a function's body is queued when the first call to
+ * it is resolved
+ */
+typedef struct lazy_bodies_s {
+    parser *top_level;
+    vec pending;
+    size_t next;
+} lazy_bodies;
+
+/**
+ * Opens a new indentation delimited block
+ * @param blocks Stack of open blocks
+ * @param indent Indent level of the statements in the block
+ * @param statements Where statements in the block are added, NULL if the block has its own line syntax
+ * @param owner Node that owns the block
+ */
+static void push_block(vec blocks, size_t indent, vec statements, ast_node *owner) {
+    block *new_block = malloc(sizeof(block));
+    new_block->indent = indent;
+    new_block->statements = statements;
+    new_block->owner = owner;
+    vec_push(blocks, new_block);
+}
+
+static void release_blocks(void *blocks) {
+    vec_iter(block *curr_block, (vec) blocks, free(curr_block))
+    vec_free(blocks);
+}
+
+static void release_vec(void *values) {
+    vec_free(values);
+}
+
+/**
+ * Runs a parse of the line lexed last, the line's tokens are freed afterwards and are held while it is parsed, so
+ * an error ending the compile frees them too
+ * @param parse Parses the line, an error abandons the line
+ * @param state Parser that lexed the line
+ * @param lexed Tokens of the line
+ * @return bool: whether the line parsed without errors
+ */
+static bool parse_lexed_line(void (*parse)(void*), void *state, lexed_line *lexed) {
+    hold_partial(lexed->tokenv, &release_vec);
+    hold_partial(lexed->token_offsets, &release_vec);
+    bool parsed = run_recoverable(parse, state);
+    unhold_partial(lexed->token_offsets);
+    unhold_partial(lexed->tokenv);
+    vec_free(lexed->tokenv);
+    vec_free(lexed->token_offsets);
+    return parsed;
+}
+
+static bool opens_namespace(ast_node *owner) {
+    return owner != NULL
+        && (owner->generate_assembly == &function_assembly || owner->generate_assembly == &parallel_for_assembly);
+}
+
+static void pop_block(vec blocks, vec namespaces) {
+    block *closed_block = vec_pop(blocks);
+    if (opens_namespace(closed_block->owner)) {
+        vec_pop(namespaces);
+    }
+    free(closed_block);
+}
+
+static bool inside_parallel_for(vec blocks) {
+    vec_iter(block *curr_block, blocks, {
+        if (curr_block->owner != NULL && curr_block->owner->generate_assembly == &parallel_for_assembly)
+            return true;
+    })
+
+    return false;
+}
+
+/**
+ * Finds a token outside of any parentheses
+ * @param tokenv Tokens
+ * @param start Index to start searching from
+ * @param end Index to stop searching at
+ * @param token Token to find
+ * @return size_t: index of the token, end if it was not found
+ */
+static size_t find_top_level_token(vec tokenv, size_t start, size_t end, char *token) {
+    size_t depth = 0;
+    for (size_t i = start; i < end; i++) {
+        char *curr_token = vec_get(tokenv, i);
+        depth += strcmp(curr_token, PAREN_OPEN) == 0;
+        depth -= strcmp(curr_token, PAREN_CLOSE) == 0;
+        if (depth == 0 && strcmp(curr_token, token) == 0)
+            return i;
+    }
+
+    return end;
+}
+
+/**
+ * Closes every block the current line is dedented out of
+ * @param blocks Stack of open blocks
+ * @param namespaces Namespaces hierarchy
+ * @param curr_line Current Line
+ * @return block*: the block the current line belongs to
+ */
+static block *enclosing_block(vec blocks, vec namespaces, line *curr_line) {
+    block *curr_block = vec_peek_end(blocks);
+    while (curr_block->indent > curr_line->indent) {
+        pop_block(blocks, namespaces);
+        curr_block = vec_peek_end(blocks);
+    }
+
+    if (curr_block->indent != curr_line->indent)
+        raise_compiler_error("Unexpected indent", curr_line);
+
+    return curr_block;
+}
 
 /**
  * Creates a AST Node for a variable definition
@@ -29,30 +231,55 @@
  * @return ast_node*: node for this variable defintion
  */
 static ast_node *var_def_node(vec tokenv, type *var_type, line *curr_line, namespace *ns) {
-    puts("Defining var");
-    // TODO: fix type
-    ast_node *var_node = var_node_new(var_type, vec_get(tokenv, curr_line->start + 1));
+    char *var_name = vec_get(tokenv, curr_line->start + 1);
+    assert_unique_var(var_name, ns, curr_line);
+    ast_node *var_node = var_declare(ns, var_type, var_name);
 
-    assert_unique_var(var_node->node, ns, curr_line);
-    vec_push(ns->vars, var_node);
+    ast_node *value = parse_typed_expression(tokenv, curr_line, curr_line->start + 3, curr_line->end, ns, var_type);
+    if (ns->parent == NULL) {
+        hold_node(value);
+        assert_constant(value, curr_line);
+        unhold_partial(value);
+        return global_var_node_new(var_type, var_node, value);
+    }
 
-    return binary_operation_new(var_type, var_node,
-        parse_expression(tokenv, curr_line, curr_line->start + 3, curr_line->end, ns),
-        &assignment_assembly
-    );
+    return binary_operation_new(var_type, var_node, value, &assignment_assembly);
 }
 
 /**
- * Creates AST Node for a function definition
+ * Creates a AST Node for a module level variable declared without an initializer
  * @param tokenv Tokens
- * @param ret_type Return type of the function
+ * @param var_type Data type of the variable
  * @param curr_line Current Line
- * @param namespaces Namespaces hierarchy
- * @return ast_node*: node for this function defintion
+ * @param ns Global namespace
+ * @return ast_node*: node for this variable declaration
+ */
+static ast_node *global_declaration_node(vec tokenv, type *var_type, line *curr_line, namespace *ns) {
+    char *var_name = vec_get(tokenv, curr_line->start + 1);
+    assert_valid_symbol(var_name, curr_line);
+    assert_unique_var(var_name, ns, curr_line);
+
+    return global_var_node_new(var_type, var_declare(ns, var_type, var_name), NULL);
+}
+
+/**
+ * Declares a function from its signature so it can be called before its definition
+ * @param tokenv Tokens
+ * @param ret_type Return type of the function
+ * @param curr_line Line of the function's signature
+ * @param ns Global namespace
+ * @return ast_node*: node for this function, its body is added when the definition is parsed
  */
-static ast_node *function_def_node(vec tokenv, type *ret_type, line *curr_line, vec namespaces) {
-    ast_node *node = function_node_new(ret_type, vec_get(tokenv, curr_line->start + 1));
+static ast_node *function_signature(vec tokenv, type *ret_type, line *curr_line, namespace *ns) {
+    char *name = vec_get(tokenv, curr_line->start + 1);
+    assert_valid_symbol(name, curr_line);
+    if (function_lookup(ns, name) != NULL)
+        raise_compiler_error("`%s` is already defined", curr_line, name);
+
+    ast_node *node = function_node_new(ret_type, name, ns);
     function_node *func_node = node->node;
+    func_node->definition = *curr_line;
+    hold_node(node);
 
     size_t i = curr_line->start + PARAM_START;
     i += i + 1 == curr_line->end && strcmp(vec_get(tokenv, i), PAREN_CLOSE) == 0; // check if no paramerters
@@ -71,23 +298,164 @@ static ast_node *function_def_node(vec tokenv, type *ret_type, line *curr_line,
         i++;
         assert_unique_var(param_name, &func_node->func_namespace, curr_line);
 
-        function_node_add_var(func_node, var_node_new(param_type, param_name));
+        function_node_add_var(func_node, param_type, param_name);
         func_node->param_count++;
     }
 
+    unhold_partial(node);
+    namespace_add_function(ns, node);
+    return node;
+}
+
+/**
+ * Creates AST Node for a function definition, the function was already declared by its signature
+ * @param tokenv Tokens
+ * @param curr_line Current Line
+ * @param blocks Stack of open blocks
+ * @param namespaces Namespaces hierarchy
+ * @return ast_node*: node for this function defintion
+ */
+static ast_node *function_def_node(vec tokenv, line *curr_line, vec blocks, vec namespaces) {
+    if (vec_len(blocks) != 1)
+        raise_compiler_error("Functions can only be defined at the top level", curr_line);
+
+    ast_node *node = function_lookup(vec_peek_end(namespaces), vec_get(tokenv, curr_line->start + 1));
+    function_node *func_node = node == NULL ? NULL : node->node;
+    if (func_node == NULL || func_node->extern_symbol != NULL
+        || func_node->definition.position.offset != curr_line->position.offset) {
+        // the signature was rejected and reported when functions were declared
+        abandon_recoverable();
+    }
+
     vec_push(namespaces, &func_node->func_namespace);
+    push_block(blocks, curr_line->indent + 1, func_node->statements, node);
     return node;
 }
 
+/**
+ * Removes the pure attribute from the start of a definition
+ * @param tokenv Tokens
+ * @param def_line Line of the definition, advanced past the attribute
+ * @return bool: whether the definition is marked pure
+ */
+static bool strip_pure_attribute(vec tokenv, line *def_line) {
+    if (def_line->start == def_line->end || strcmp(vec_get(tokenv, def_line->start), PURE) != 0)
+        return false;
+
+    def_line->start++;
+    return true;
+}
+
+static bool function_definition_line(vec tokenv, line *def_line) {
+    return def_line->end - def_line->start >= MIN_SYMBOL_DEF_LEN
+        && valid_type(vec_get(tokenv, def_line->start))
+        && strcmp(vec_get(tokenv, def_line->start + 2), PAREN_OPEN) == 0;
+}
+
+static bool defines_function(vec tokenv, line *curr_line) {
+    line def_line = *curr_line;
+    strip_pure_attribute(tokenv, &def_line);
+    return function_definition_line(tokenv, &def_line);
+}
+
+/**
+ * Declares the functions implemented by the runtime library, their parameters are i64s
+ * @param ns Global namespace
+ */
+static void declare_runtime_functions(namespace *ns) {
+    for (runtime_function *function = runtime_functions; function->name != NULL; function++) {
+        ast_node *node = function_node_new(get_type(function->return_type), function->name, ns);
+        function_node *func_node = node->node;
+        for (size_t i = 0; i < function->param_count; i++) {
+            function_node_add_var(func_node, get_type(RUNTIME_PARAM_TYPE), "");
+        }
+        func_node->param_count = function->param_count;
+        func_node->extern_symbol = function->symbol;
+        namespace_add_function(ns, node);
+    }
+}
+
+/**
+ * Declares the function or imports the module of a top level line
+ * @param context Parser of the declaration pass
+ */
+static void declare_line(void *context) {
+    parser *state = context;
+    vec tokenv = state->lexed.tokenv;
+    namespace *ns = vec_peek_end(state->namespaces);
+    line_iterator iter;
+    init_line_iterator(&iter, state->file, tokenv, state->lexed.token_offsets);
+    line *curr_line = next_line(&iter);
+    if (curr_line->start == curr_line->end)
+        return;
+
+    if (state->open_function != NULL) {
+        ((function_node*) state->open_function->node)->definition_end = curr_line->position.offset;
+        state->open_function = NULL;
+    }
+
+    if (strcmp(vec_get(tokenv, curr_line->start), IMPORT) == 0) {
+        if (state->definitions_started)
+            raise_compiler_error("Imports must come before definitions", curr_line);
+        if (curr_line->end - curr_line->start != IMPORT_LEN)
+            raise_compiler_error("Expected `%s module`", curr_line, IMPORT);
+
+        char *module = vec_get(tokenv, curr_line->start + 1);
+        assert_valid_symbol(module, curr_line);
+        import_module(module, curr_line, ns);
+        return;
+    }
+    state->definitions_started = true;
+
+    line def_line = *curr_line;
+    bool pure = strip_pure_attribute(tokenv, &def_line);
+    if (function_definition_line(tokenv, &def_line)) {
+        ast_node *node = function_signature(tokenv, get_type(vec_get(tokenv, def_line.start)), &def_line, ns);
+        function_node *func_node = node->node;
+        func_node->declared_pure = pure;
+        func_node->pure = pure;
+        state->open_function = node;
+    }
+}
+
+/**
+ * Declares every top level function and the functions of imported modules before any body is parsed, so calls can
+ * refer to functions defined later. Only top level lines are lexed for this pass, a line with an error is skipped.
+ * A function's definition is recorded as ending where the next top level line starts
+ * @param filename Name of the source file
+ * @param ns Global namespace
+ */
+static void declare_functions(compilation *unit, char *filename, namespace *ns) {
+    parser state = {
+        .unit = unit,
+        .file = source_file_id(filename),
+        .namespaces = vec_new(),
+        .open_function = NULL,
+        .definitions_started = false,
+    };
+    vec_push(state.namespaces, ns);
+    hold_partial(state.namespaces, &release_vec);
+    line_queue *queue = start_lexer(unit->shared, unit->strings, filename, true, unit->threaded_lexing);
+
+    while (next_lexed_line(queue, &state.lexed)) {
+        parse_lexed_line(&declare_line, &state, &state.lexed);
+    }
+
+    finish_lexer(queue);
+    unhold_partial(state.namespaces);
+    vec_free(state.namespaces);
+}
+
 /**
  * Creates a AST Node for a symbol definition
  * @param tokenv Tokens
  * @param symbol_type Data type of the variable
  * @param curr_line Current Line
+ * @param blocks Stack of open blocks
  * @param namespaces Namespace to add the variable in
  * @return ast_node*: node for this variable defintion
  */
-static ast_node *symbol_definition(vec tokenv, type *symbol_type, line *curr_line, vec namespaces) {
+static ast_node *symbol_definition(vec tokenv, type *symbol_type, line *curr_line, vec blocks, vec namespaces) {
     char *symbol = vec_get(tokenv, curr_line->start + 1);
     assert_valid_symbol(symbol, curr_line);
 
@@ -97,66 +465,592 @@ static ast_node *symbol_definition(vec tokenv, type *symbol_type, line *curr_lin
         return var_def_node(tokenv, symbol_type, curr_line, vec_peek_end(namespaces));
     }
     if (strcmp(token, PAREN_OPEN) == 0) {
-        return function_def_node(tokenv, symbol_type, curr_line, namespaces);
+        return function_def_node(tokenv, curr_line, blocks, namespaces);
     }
 
     raise_compiler_error("Invalid Definition", curr_line);
     return NULL;
 }
 
+/**
+ * Creates AST Node for a return statement
+ * @param tokenv Tokens
+ * @param curr_line Current Line
+ * @param blocks Stack of open blocks
+ * @param ns Namespace of the enclosing function
+ * @return ast_node*: node for this return statement
+ */
+static ast_node *return_statement(vec tokenv, line *curr_line, vec blocks, namespace *ns) {
+    if (inside_parallel_for(blocks))
+        raise_compiler_error("Cannot return from inside a `%s %s` loop", curr_line, PARALLEL, FOR);
+
+    if (curr_line->start + 1 == curr_line->end)
+        return return_node_new(NULL);
+
+    type *ret_type = ((block*) vec_get(blocks, 1))->owner->expr_type;
+    size_t value_start = curr_line->start + 1;
+    return return_node_new(parse_typed_expression(tokenv, curr_line, value_start, curr_line->end, ns, ret_type));
+}
+
+/**
+ * Creates AST Node for a print statement, its values are separated by commas
+ * @param tokenv Tokens
+ * @param curr_line Current Line
+ * @param ns Namespace of the enclosing function
+ * @return ast_node*: node for this print statement
+ */
+static ast_node *print_statement(vec tokenv, line *curr_line, namespace *ns) {
+    assert_has_min_tokens(MIN_KEYWORD_STATEMENT_LEN, curr_line->start, curr_line);
+
+    vec values = vec_new();
+    hold_nodes(values);
+    size_t value_start = curr_line->start + 1;
+    while (value_start < curr_line->end) {
+        size_t value_end = find_top_level_token(tokenv, value_start, curr_line->end, PARAM_SEP);
+        if (value_end == value_start || value_end + 1 == curr_line->end)
+            raise_compiler_error("Missing value to print", curr_line);
+
+        vec_push(values, parse_expression(tokenv, curr_line, value_start, value_end, ns));
+        value_start = value_end + 1;
+    }
+
+    unhold_partial(values);
+    return print_node_new(values);
+}
+
+/**
+ * Creates AST Node for a match statement, its arms are parsed from the lines of the opened block
+ * @param tokenv Tokens
+ * @param curr_line Current Line
+ * @param blocks Stack of open blocks
+ * @param ns Namespace of the enclosing function
+ * @return ast_node*: node for this match statement
+ */
+static ast_node *match_statement(vec tokenv, line *curr_line, vec blocks, namespace *ns) {
+    assert_has_min_tokens(MIN_KEYWORD_STATEMENT_LEN, curr_line->start, curr_line);
+
+    type *match_type = get_type(MATCH_TYPE);
+    ast_node *value = parse_typed_expression(tokenv, curr_line, curr_line->start + 1, curr_line->end, ns, match_type);
+    ast_node *node = match_node_new(value);
+
+    push_block(blocks, curr_line->indent + 1, NULL, node);
+    return node;
+}
+
+/**
+ * Parses a single case value, an i64 literal with an optional leading minus. The sign is parsed together with the
+ * digits so the smallest i64 is a valid case
+ * @param tokenv Tokens
+ * @param i Index of the value's first token, advanced past the value
+ * @param curr_line Current Line
+ * @return int64_t: the case value
+ */
+static int64_t parse_case_value(vec tokenv, size_t *i, line *curr_line) {
+    bool negative = strcmp(vec_get(tokenv, *i), NEGATE) == 0;
+    if (negative && ++*i == curr_line->end)
+        raise_compiler_error("Incomplete case", curr_line);
+
+    char *literal = vec_get(tokenv, (*i)++);
+    size_t literal_len = strlen(literal);
+    char signed_literal[literal_len + 2];
+    signed_literal[0] = *NEGATE;
+    memcpy(signed_literal + 1, literal, literal_len + 1);
+    char *value = negative ? signed_literal : literal;
+    if (*literal == *NEGATE || !valid_i64_literal(value))
+        raise_compiler_error_at("Case value `%s` is not an i64 literal", token_span(curr_line, *i - 1), value);
+
+    return strtol(value, NULL, 0);
+}
+
+/**
+ * Adds an arm to a match statement
+ * @param tokenv Tokens
+ * @param curr_line Current Line
+ * @param blocks Stack of open blocks
+ * @param match Match statement the arm belongs to
+ */
+static void match_arm_def(vec tokenv, line *curr_line, vec blocks, match_node *match) {
+    char *token = vec_get(tokenv, curr_line->start);
+
+    if (strcmp(token, ELSE) == 0) {
+        if (match->default_statements != NULL)
+            raise_compiler_error("Duplicate `else` arm", curr_line);
+        if (curr_line->start + 1 != curr_line->end)
+            raise_compiler_error("Unexpected tokens after `else`", curr_line);
+
+        match->default_statements = vec_new();
+        push_block(blocks, curr_line->indent + 1, match->default_statements, NULL);
+        return;
+    }
+
+    assert_token_equals(token, CASE, curr_line);
+    assert_has_min_tokens(MIN_KEYWORD_STATEMENT_LEN, curr_line->start, curr_line);
+    match_arm *arm = match_node_add_arm(match);
+
+    size_t i = curr_line->start + 1;
+    while (i < curr_line->end) {
+        int64_t value = parse_case_value(tokenv, &i, curr_line);
+        if (match_node_has_value(match, value))
+            raise_compiler_error("Duplicate case value `%ld`", curr_line, value);
+        vec_push_val(arm->values, value);
+
+        if (i < curr_line->end && strcmp(vec_get(tokenv, i++), PARAM_SEP) != 0)
+            raise_compiler_error("Expected `%s`", curr_line, PARAM_SEP);
+        if (i == curr_line->end && strcmp(vec_get(tokenv, i - 1), PARAM_SEP) == 0)
+            raise_compiler_error("Incomplete case", curr_line);
+    }
+
+    push_block(blocks, curr_line->indent + 1, arm->statements, NULL);
+}
+
+/**
+ * Creates the name of a variable or function the compiler introduces, it contains a `.` so it cannot clash with
+ * names in the source
+ * @param format Format of the name, takes the prefix if there is one and then the id
+ * @param prefix Name the hidden one is derived from, NULL if the format has none
+ * @param id Unique id for the name
+ * @return char*: the interned name
+ */
+static char *hidden_name(char *format, char *prefix, size_t id) {
+    size_t len = MAX_HIDDEN_NAME_LEN + (prefix == NULL ? 0 : strlen(prefix));
+    char name[len];
+    if (prefix == NULL) {
+        snprintf(name, len, format, id);
+    } else {
+        snprintf(name, len, format, prefix, id);
+    }
+    return intern_str(bound_compilation()->strings, name, strlen(name));
+}
+
+static void (*reduction_operator(char *token))(ast_node*) {
+    if (strcmp(token, REDUCE_ADD) == 0)
+        return &add_assembly;
+    if (strcmp(token, REDUCE_OR) == 0)
+        return &or_assembly;
+    if (strcmp(token, REDUCE_XOR) == 0)
+        return &xor_assembly;
+    if (strcmp(token, REDUCE_AND) == 0)
+        return &and_assembly;
+    return NULL;
+}
+
+/**
+ * Parses the reductions of a parallel for loop, each is an operator followed by a variable of the enclosing
+ * function. The loop body gets a private copy of each variable which is combined back in after the loop
+ * @param tokenv Tokens
+ * @param i Index of the `reduce` keyword, or the line's end if there are no reductions
+ * @param curr_line Current Line
+ * @param loop Parallel for loop
+ * @param ns Namespace enclosing the loop
+ */
+static void parse_reductions(vec tokenv, size_t i, line *curr_line, for_node *loop, namespace *ns) {
+    if (i++ == curr_line->end)
+        return;
+
+    while (i < curr_line->end) {
+        assert_has_min_tokens(REDUCTION_LEN, i, curr_line);
+
+        char *operator_token = vec_get(tokenv, i++);
+        void (*combine)(ast_node*) = reduction_operator(operator_token);
+        if (combine == NULL)
+            raise_compiler_error_at("Cannot reduce over `%s`", token_span(curr_line, i - 1), operator_token);
+
+        char *var_name = vec_get(tokenv, i++);
+        ast_node *var = var_lookup(ns, var_name);
+        if (var == NULL)
+            raise_compiler_error_at("Undefined variable `%s`", token_span(curr_line, i - 1), var_name);
+        if (var_lookup(&loop->body->func_namespace, var_name) != var)
+            raise_compiler_error_at("`%s` is already reduced", token_span(curr_line, i - 1), var_name);
+        assert_type(var, get_type(LOOP_VAR_TYPE), token_span(curr_line, i - 1));
+
+        parallel_for_node_add_reduction(loop, combine, var);
+
+        if (i < curr_line->end) {
+            assert_token_equals(vec_get(tokenv, i++), PARAM_SEP, curr_line);
+            if (i == curr_line->end)
+                raise_compiler_error("Incomplete reduction", curr_line);
+        }
+    }
+}
+
+/**
+ * Creates the function a parallel for loop's body is outlined into
+ * @param var_name Name of the loop variable
+ * @param curr_line Current Line
+ * @param blocks Stack of open blocks, the one above the root belongs to the enclosing function
+ * @param ns Namespace enclosing the loop
+ * @return function_node*: body function with its hidden parameters defined
+ */
+static function_node *parallel_body_new(char *var_name, line *curr_line, vec blocks, namespace *ns) {
+    function_node *enclosing = ((block*) vec_get(blocks, 1))->owner->node;
+    char *name = hidden_name(PARALLEL_BODY_NAME, enclosing->name, bound_compilation()->parallel_body_count++);
+    type *i64 = get_type(LOOP_VAR_TYPE);
+    ast_node *node = function_node_new(i64, name, ns);
+    function_node *body = node->node;
+    free(node);
+
+    char *param_names[PARALLEL_BODY_PARAMS] = {var_name, ".end", ".context", ".thread", ".accumulators"};
+    for (size_t i = 0; i < PARALLEL_BODY_PARAMS; i++) {
+        function_node_add_var(body, i64, param_names[i]);
+    }
+    body->param_count = PARALLEL_BODY_PARAMS;
+    body->definition = *curr_line;
+    body->func_namespace.dag = ns->dag;
+    return body;
+}
+
+/**
+ * Creates AST Node for a for loop over the range [start, end), `parallel for` splits the range over threads
+ * @param tokenv Tokens
+ * @param curr_line Current Line
+ * @param blocks Stack of open blocks
+ * @param namespaces Namespaces hierarchy
+ * @return ast_node*: node for this loop
+ */
+static ast_node *for_statement(vec tokenv, line *curr_line, vec blocks, vec namespaces) {
+    size_t i = curr_line->start;
+    bool parallel = strcmp(vec_get(tokenv, i), PARALLEL) == 0;
+    bool dynamic = false;
+    if (parallel && ++i < curr_line->end && strcmp(vec_get(tokenv, i), DYNAMIC) == 0) {
+        dynamic = true;
+        i++;
+    }
+
+    assert_has_min_tokens(FOR_HEADER_MIN_LEN, i, curr_line);
+    assert_token_equals(vec_get(tokenv, i), FOR, curr_line);
+    char *var_name = vec_get(tokenv, i + 1);
+    assert_valid_symbol(var_name, curr_line);
+    assert_token_equals(vec_get(tokenv, i + 2), ASSIGNMENT, curr_line);
+
+    size_t range_start = i + 3;
+    size_t range_end = find_top_level_token(tokenv, range_start, curr_line->end, REDUCE);
+    size_t range_sep = find_top_level_token(tokenv, range_start, range_end, PARAM_SEP);
+    if (range_sep == range_start || range_sep + 1 >= range_end)
+        raise_compiler_error("Expected `%s %s = start, end`", curr_line, FOR, var_name);
+
+    namespace *ns = vec_peek_end(namespaces);
+    type *i64 = get_type(LOOP_VAR_TYPE);
+    ast_node *start = parse_typed_expression(tokenv, curr_line, range_start, range_sep, ns, i64);
+    hold_node(start);
+    ast_node *end = parse_typed_expression(tokenv, curr_line, range_sep + 1, range_end, ns, i64);
+    hold_node(end);
+    assert_unique_var(var_name, ns, curr_line);
+
+    ast_node *node;
+    if (parallel) {
+        if (inside_parallel_for(blocks))
+            raise_compiler_error("`%s %s` loops cannot be nested", curr_line, PARALLEL, FOR);
+
+        function_node *body = parallel_body_new(var_name, curr_line, blocks, ns);
+        unhold_partial(end);
+        unhold_partial(start);
+        node = parallel_for_node_new(body, start, end, dynamic);
+        hold_node(node);
+        parse_reductions(tokenv, range_end, curr_line, node->node, ns);
+        unhold_partial(node);
+        vec_push(namespaces, &body->func_namespace);
+    } else {
+        if (range_end != curr_line->end)
+            raise_compiler_error("Only `%s %s` loops can reduce", curr_line, PARALLEL, FOR);
+
+        unhold_partial(end);
+        unhold_partial(start);
+        ast_node *var = var_declare(ns, i64, var_name);
+        ast_node *end_var = var_declare(ns, i64, hidden_name(END_VAR, NULL, bound_compilation()->loop_count++));
+        node = for_node_new(var, start, end, end_var);
+    }
+
+    push_block(blocks, curr_line->indent + 1, ((for_node*) node->node)->statements, node);
+    return node;
+}
+
 /**
  * Creates an abstract syntax tree node for the current line
  * @param tokenv Tokens
  * @param curr_line Current line
+ * @param blocks Stack of open blocks
  * @param namespaces Namespaces hierarchy
- * @return ast_node: AST node for the current line
+ * @return ast_node: AST node for the current line, NULL if the line is not a statement
  */
-static ast_node *create_ast_node(vec tokenv, line *curr_line, vec namespaces) {
+static ast_node *create_ast_node(vec tokenv, line *curr_line, vec blocks, vec namespaces) {
+    block *curr_block = vec_peek_end(blocks);
+
+    if (curr_block->owner != NULL && curr_block->owner->generate_assembly == &match_assembly) {
+        match_arm_def(tokenv, curr_line, blocks, curr_block->owner->node);
+        return NULL;
+    }
+
+    line def_line = *curr_line;
+    if (strip_pure_attribute(tokenv, &def_line)) {
+        if (!function_definition_line(tokenv, &def_line))
+            raise_compiler_error("Only functions can be `%s`", curr_line, PURE);
+        curr_line = &def_line;
+    }
+
     char *token = vec_get(tokenv, curr_line->start);
+    if (strcmp(token, IMPORT) == 0) {
+        if (vec_len(blocks) != 1)
+            raise_compiler_error("Modules can only be imported at the top level", curr_line);
+        return NULL;
+    }
 
-    // printf("Cheking def %s %lu\n", token, curr_line->start);
     type *symbol_type = get_type(token);
     if (symbol_type != NULL) {
-        // puts("DEF");
+        if (vec_len(blocks) == 1 && curr_line->end - curr_line->start == SYMBOL_DECLARATION_LEN)
+            return global_declaration_node(tokenv, symbol_type, curr_line, vec_peek_end(namespaces));
+
         assert_has_min_tokens(MIN_SYMBOL_DEF_LEN, curr_line->start, curr_line);
-        return symbol_definition(tokenv, symbol_type, curr_line, namespaces);
+        return symbol_definition(tokenv, symbol_type, curr_line, blocks, namespaces);
     }
 
-    puts("Parsing");
-    namespace *ns = vec_get(namespaces, 0);
-    printf("len: %lu\n", vec_len(ns->vars));
+    if (vec_len(blocks) == 1)
+        raise_compiler_error("Statements must be inside a function", curr_line);
+
+    if (strcmp(token, RETURN) == 0)
+        return return_statement(tokenv, curr_line, blocks, vec_peek_end(namespaces));
+    if (strcmp(token, MATCH) == 0)
+        return match_statement(tokenv, curr_line, blocks, vec_peek_end(namespaces));
+    if (strcmp(token, PRINT) == 0)
+        return print_statement(tokenv, curr_line, vec_peek_end(namespaces));
+    if (strcmp(token, FOR) == 0 || strcmp(token, PARALLEL) == 0)
+        return for_statement(tokenv, curr_line, blocks, namespaces);
+
     return parse_expression(tokenv, curr_line, curr_line->start, curr_line->end, vec_peek_end(namespaces));
 }
 
 /**
- * Generate an abstract syntax tree for the source code
- * @param tokenv Vector of tokens in the source code
- * @param filename Name of file to generate the AST for
- * @return ast_node Root of the code's abstarct syntax tree
+ * Marks a function whose last line has been parsed as defined and hands it to the caller
+ * @param state Parser the function was defined in
+ * @param function Function that was completed, NULL if no function is open
  */
-ast_node *generate_ast(char *filename, vec tokenv) {
-    vec namespaces = vec_new();
+static void complete_function(parser *state, ast_node *function) {
+    if (function == NULL)
+        return;
 
-    line_iterator iter;
-    init_line_iterator(&iter, filename, tokenv);
+    ((function_node*) function->node)->defined = true;
+    if (state->function_defined != NULL) {
+        state->function_defined(state->defined_context, state->root, function);
+    }
+}
 
+/**
+ * Parses a line into the AST. The lines nested under a line with an error are skipped along with it, since
+ * whatever block it opens is missing
+ * @param context Parser of the file
+ */
+static void parse_line(void *context) {
+    parser *state = context;
+    line_iterator iter;
+    init_line_iterator(&iter, state->file, state->lexed.tokenv, state->lexed.token_offsets);
     line *curr_line = next_line(&iter);
-    while (curr_line != NULL) {
+    if (curr_line->start == curr_line->end)
+        return;
+
+    state->line_indent = curr_line->indent;
+    if (curr_line->indent > state->skip_indent)
+        return;
+    state->skip_indent = NOT_SKIPPING;
+
+    block *curr_block = enclosing_block(state->blocks, state->namespaces, curr_line);
+    if (vec_len(state->blocks) == 1) {
+        ast_node *completed = state->open_function;
+        state->open_function = NULL;
+        complete_function(state, completed);
+    }
+    if (state->skip_definitions && defines_function(state->lexed.tokenv, curr_line))
+        return;
 
-        if (vec_len(namespaces) > 0) {
-            namespace *ns = vec_get(namespaces, 0);
-            printf("curr len: %lu\n", vec_len(ns->vars));
+    ast_node *node = create_ast_node(state->lexed.tokenv, curr_line, state->blocks, state->namespaces);
+    if (node != NULL) {
+        vec_push(curr_block->statements, node);
+    }
+    if (node != NULL && node->generate_assembly == &function_assembly) {
+        state->open_function = node;
+        if (state->share_expressions) {
+            ((function_node*) node->node)->func_namespace.dag = dag_new();
         }
+    }
+}
 
-        if (curr_line->start < curr_line->end) {
-            ast_node *node = create_ast_node(tokenv, curr_line, namespaces);
-            puts("Node:");
-            ast_tree_print(node);
+/**
+ * Parses every line from a queue, then closes the blocks still open and completes the last function
+ * @param state Parser with the root block open
+ * @param queue Lexed lines
+ */
+static void parse_lines(parser *state, line_queue *queue) {
+    hold_partial(state->blocks, &release_blocks);
+    hold_partial(state->namespaces, &release_vec);
+    while (next_lexed_line(queue, &state->lexed)) {
+        state->line_indent = NOT_SKIPPING;
+        if (!parse_lexed_line(&parse_line, state, &state->lexed)) {
+            state->skip_indent = state->line_indent;
         }
-        curr_line = next_line(&iter);
     }
+    finish_lexer(queue);
 
-    vec_free(namespaces);
+    while (vec_len(state->blocks) > 0) {
+        pop_block(state->blocks, state->namespaces);
+    }
+    unhold_partial(state->namespaces);
+    unhold_partial(state->blocks);
+    complete_function(state, state->open_function);
+    vec_free(state->blocks);
+    vec_free(state->namespaces);
+}
 
-    return NULL;
+/**
+ * Creates a parser over the top level of a file, with the root block and the global namespace open
+ * @param unit Compilation the file belongs to
+ * @param filename Name of the source file
+ * @param root Root of the program's AST
+ * @param options How the file is parsed
+ * @param function_defined Called with its context, the root and each function once it is defined, NULL if not
+ * needed
+ * @param context First argument to function_defined
+ * @return parser: the parser
+ */
+static parser top_level_parser(compilation *unit, char *filename, ast_node *root, parse_options options,
+    void (*function_defined)(void*, ast_node*, ast_node*), void *context) {
+
+    program_node *program = root->node;
+    parser state = {
+        .unit = unit,
+        .file = source_file_id(filename),
+        .root = root,
+        .blocks = vec_new(),
+        .namespaces = vec_new(),
+        .open_function = NULL,
+        .function_defined = function_defined,
+        .defined_context = context,
+        .share_expressions = options.share_expressions,
+        .skip_definitions = false,
+        .skip_indent = NOT_SKIPPING,
+    };
+    vec_push(state.namespaces, &program->global_namespace);
+    push_block(state.blocks, 0, program->definitions, root);
+    return state;
+}
+
+/**
+ * Parses a function's definition, lexing only the lines between its signature and the next top level line
+ * @param lazy Bodies parsed on demand
+ * @param function Function whose body was not parsed yet
+ */
+static void parse_body(lazy_bodies *lazy, ast_node *function) {
+    function_node *func_node = function->node;
+    parser *top_level = lazy->top_level;
+    char *filename = source_file_path(top_level->file);
+    parser state = top_level_parser(top_level->unit, filename, top_level->root,
+        (parse_options) {.share_expressions = top_level->share_expressions}, top_level->function_defined,
+        top_level->defined_context);
+    compilation *unit = top_level->unit;
+    parse_lines(&state, start_range_lexer(unit->shared, unit->strings, filename,
+        func_node->definition.position.offset, func_node->definition_end));
+}
+
+static void parse_pending_bodies(lazy_bodies *lazy) {
+    while (lazy->next < vec_len(lazy->pending)) {
+        parse_body(lazy, vec_get(lazy->pending, lazy->next++));
+    }
+}
+
+/**
+ * Notes that a call to a function was resolved, when bodies are parsed on demand the function's body is queued to
+ * be parsed. A call in a global initializer is evaluated right away, so the body and everything it calls are
+ * parsed before the initializer is checked
+ * @param function Function being called
+ * @param ns Namespace of the call
+ */
+void use_function(ast_node *function, namespace *ns) {
+    function_node *func_node = function->node;
+    lazy_bodies *lazy = bound_compilation()->lazy_bodies;
+    if (lazy == NULL || func_node->used || func_node->extern_symbol != NULL)
+        return;
+
+    func_node->used = true;
+    vec_push(lazy->pending, function);
+    if (ns->parent == NULL) {
+        parse_pending_bodies(lazy);
+    }
+}
+
+/**
+ * Parses the bodies of the functions a module needs. The entry module only needs main and what it calls, any
+ * function of another module may be called by the modules importing it
+ * @param lazy Bodies parsed on demand
+ * @param program Program node
+ * @param entry Whether the module is the program's entry point
+ */
+static void parse_used_bodies(lazy_bodies *lazy, program_node *program, bool entry) {
+    vec_iter(ast_node *function, program->global_namespace.functions, {
+        if (!entry || strcmp(((function_node*) function->node)->name, ENTRY_FUNCTION) == 0) {
+            use_function(function, &program->global_namespace);
+        }
+    })
+    parse_pending_bodies(lazy);
+}
+
+/**
+ * Reports an entry module without a main function of its own, the program would have nowhere to start. A main
+ * imported from another module was already reported as a redefinition
+ * @param program Program node of the entry module
+ * @param filename Name of the entry module's file
+ */
+static void check_entry_function(program_node *program, char *filename) {
+    ast_node *function = function_lookup(&program->global_namespace, ENTRY_FUNCTION);
+    if (has_errors() || (function != NULL && ((function_node*) function->node)->extern_symbol == NULL))
+        return;
+
+    line module_start = {0, 0, 0, span_new(source_file_id(filename), 0), NULL};
+    report_compiler_error("Entry module does not define `%s`", &module_start, ENTRY_FUNCTION);
+}
+
+/**
+ * Generate an abstract syntax tree for the source code. Lexing runs on its own thread ahead of the parser and
+ * each line's tokens are dropped once the line is parsed, so only a bounded window of tokens is held at a time.
+ * Each function is handed to the caller as soon as its body is complete, so it can be compiled and released
+ * before the rest of the file is parsed. Errors are collected and parsing resumes at the next line, so every
+ * error in the file is reported by one compile. When bodies are parsed lazily, only top level lines are lexed up
+ * front and a function's body is lexed and parsed once a call to it is found, starting from the functions the
+ * module needs, so bodies that are never called are never parsed
+ * @param unit Compilation bound to the calling thread
+ * @param filename Name of file to generate the AST for
+ * @param entry Whether the file is the program's entry module
+ * @param options How the file is parsed
+ * @param function_defined Called with its context, the root and each function once it is defined, NULL if not
+ * needed
+ * @param context First argument to function_defined
+ * @return ast_node Root of the code's abstarct syntax tree
+ */
+ast_node *generate_ast(compilation *unit, char *filename, bool entry, parse_options options,
+    void (*function_defined)(void *context, ast_node *root, ast_node *function), void *context) {
+
+    ast_node *root = program_node_new();
+    program_node *program = root->node;
+    unit->root = root;
+
+    line_queue *queue = start_lexer(unit->shared, unit->strings, filename, options.lazy_bodies,
+        unit->threaded_lexing);
+    parser state = top_level_parser(unit, filename, root, options, function_defined, context);
+    declare_runtime_functions(&program->global_namespace);
+    declare_functions(unit, filename, &program->global_namespace);
+
+    if (!options.lazy_bodies) {
+        parse_lines(&state, queue);
+    } else {
+        lazy_bodies lazy = {&state, vec_new(), 0};
+        unit->lazy_bodies = &lazy;
+        hold_partial(lazy.pending, &release_vec);
+        state.skip_definitions = true;
+        parse_lines(&state, queue);
+        parse_used_bodies(&lazy, program, entry);
+        unhold_partial(lazy.pending);
+        vec_free(lazy.pending);
+        unit->lazy_bodies = NULL;
+    }
+
+    if (entry) {
+        check_entry_function(program, filename);
+    }
+    return root;
 }
@@ -2,8 +2,17 @@
 #define AST_H
 
 #include "ast_node.h"
+#include "context.h"
 #include "vec.h"
 
-ast_node *generate_ast(char *filename, vec tokenv);
+typedef struct parse_options_s {
+    bool share_expressions;
+    bool lazy_bodies;
+} parse_options;
+
+void use_function(ast_node *function, namespace *ns);
+
+ast_node *generate_ast(compilation *unit, char *filename, bool entry, parse_options options,
+    void (*function_defined)(void *context, ast_node *root, ast_node *function), void *context);
 
 #endif //AST_H
@@ -5,15 +5,25 @@
 #include <string.h>
 
 #include "assembly_generator.h"
+#include "dag.h"
 #include "pattern.h"
 #include "util.h"
 
-#define NUM_BINARY_OPERATORS 6
+#define NUM_BINARY_OPERATORS 10
+#define INITIAL_FUNCTION_SLOTS 64
+#define FNV_OFFSET 0xcbf29ce484222325
+#define FNV_PRIME 0x100000001b3
 
 void function_print(ast_node *node, size_t level);
 void var_print(ast_node *node, size_t _);
 void literal_print(ast_node *node, size_t _);
 void binary_operation_print(ast_node *node, size_t level);
+void call_print(ast_node *node, size_t level);
+void return_print(ast_node *node, size_t level);
+void print_statement_print(ast_node *node, size_t level);
+void match_print(ast_node *node, size_t level);
+void for_print(ast_node *node, size_t level);
+void program_print(ast_node *node, size_t level);
 void ast_node_print(ast_node *node, size_t level);
 
 ast_node *ast_node_new(type *expr_type, void *node, void (*generate_assembly)(ast_node*),
@@ -31,27 +41,153 @@ ast_node *ast_node_new(type *expr_type, void *node, void (*generate_assembly)(as
 void var_node_free(ast_node *node) { free(node); }
 
 /**
- * Creates a new AST node for a variable
+ * Frees nothing, references to a variable share the node of its declaration which the namespace frees, and
+ * nodes of an expression DAG belong to the DAG
+ * @param _ Shared node
+ */
+static void shared_node_free(ast_node *_) {}
+
+bool shared_node(ast_node *node) {
+    return node->free_func == &shared_node_free;
+}
+
+/**
+ * Marks a node as shared so the nodes using it leave freeing it to its owner
+ * @param node Node
+ */
+void share_node(ast_node *node) {
+    node->free_func = &shared_node_free;
+}
+
+static void var_free(ast_node *node) {
+    free(node->node);
+    free(node);
+}
+
+static void free_vars(vec vars) {
+    vec_iter(ast_node *var, vars, var_free(var))
+    vec_free(vars);
+}
+
+/**
+ * Declares a variable in a namespace. The declaration's node is the variable's only record, every reference to
+ * the variable points at it and reads its scope depth and slot instead of looking the name up again
+ * @param ns Namespace to declare the variable in
  * @param var_type Data type of the variable
  * @param var_name Name of the variable
  * @return ast_node*: AST node for the variable
  */
-ast_node *var_node_new(type *var_type, char *var_name) {
-    // TODO: free function
-    return ast_node_new(var_type, var_name, &load_assembly, &var_node_free, &var_print);
+ast_node *var_declare(namespace *ns, type *var_type, char *var_name) {
+    var_node *var = malloc(sizeof(var_node));
+    var->name = var_name;
+    var->scope = ns->depth;
+    var->slot = vec_len(ns->vars);
+
+    ast_node *node = ast_node_new(var_type, var, &load_assembly, &shared_node_free, &var_print);
+    vec_push(ns->vars, node);
+    return node;
+}
+
+char *var_name(ast_node *var) {
+    return ((var_node*) var->node)->name;
+}
+
+/**
+ * Creates a reference to a variable that is a node of its own, for expressions that are replaced in place
+ * @param var Variable
+ * @return ast_node*: AST node for the reference, freed by its parent
+ */
+ast_node *var_ref_copy(ast_node *var) {
+    return ast_node_new(var->expr_type, var->node, &load_assembly, &var_node_free, &var_print);
 }
 
+/**
+ * Index of a namespace's functions by name, a module importing large interfaces declares thousands of functions
+ * and looks each new name up before declaring it
+ */
+struct function_index_s {
+    size_t capacity;
+    size_t count;
+    ast_node **slots;
+};
+
 void init_namespace(namespace *ns) {
     ns->vars = vec_new();
+    ns->functions = vec_new();
+    ns->functions_by_name = NULL;
     ns->parent = NULL;
+    ns->depth = 0;
+    ns->dag = NULL;
 }
 
-ast_node *var_lookup(namespace *ns, char *name) {
-    printf("%lu\n", vec_len(ns->vars));
+static size_t hash_name(char *name) {
+    uint64_t hash = FNV_OFFSET;
+    for (; *name != '\0'; name++) {
+        hash = (hash ^ (unsigned char) *name) * FNV_PRIME;
+    }
+    return hash ^ (hash >> 29);
+}
+
+static ast_node **find_function_slot(function_index *index, char *name) {
+    size_t mask = index->capacity - 1;
+    for (size_t i = hash_name(name) & mask;; i = (i + 1) & mask) {
+        ast_node *function = index->slots[i];
+        if (function == NULL || strcmp(((function_node*) function->node)->name, name) == 0)
+            return index->slots + i;
+    }
+}
 
+static void index_function(function_index *index, ast_node *function) {
+    ast_node **slot = find_function_slot(index, ((function_node*) function->node)->name);
+    if (*slot != NULL)
+        return;
+
+    *slot = function;
+    if (++index->count << 1 <= index->capacity)
+        return;
+
+    size_t capacity = index->capacity;
+    ast_node **slots = index->slots;
+    index->capacity = capacity << 1;
+    index->slots = calloc(index->capacity, sizeof(ast_node*));
+    index->count = 0;
+    for (size_t i = 0; i < capacity; i++) {
+        if (slots[i] != NULL) {
+            index_function(index, slots[i]);
+        }
+    }
+    free(slots);
+}
+
+/**
+ * Adds a function to a namespace, a lookup of a name declared twice finds the first declaration
+ * @param ns Namespace
+ * @param function Function
+ */
+void namespace_add_function(namespace *ns, ast_node *function) {
+    if (ns->functions_by_name == NULL) {
+        ns->functions_by_name = malloc(sizeof(function_index));
+        ns->functions_by_name->capacity = INITIAL_FUNCTION_SLOTS;
+        ns->functions_by_name->count = 0;
+        ns->functions_by_name->slots = calloc(INITIAL_FUNCTION_SLOTS, sizeof(ast_node*));
+    }
+    vec_push(ns->functions, function);
+    index_function(ns->functions_by_name, function);
+}
+
+static void free_function_index(namespace *ns) {
+    if (ns->functions_by_name == NULL)
+        return;
+
+    free(ns->functions_by_name->slots);
+    free(ns->functions_by_name);
+    ns->functions_by_name = NULL;
+}
+
+ast_node *var_lookup(namespace *ns, char *name) {
     while (ns != NULL) {
         vec_iter(ast_node *curr_var, ns->vars, {
-            if (strcmp(name, curr_var->node) == 0) {
+            if (strcmp(name, var_name(curr_var)) == 0) {
                 return curr_var;
             }
         })
@@ -61,47 +197,330 @@ ast_node *var_lookup(namespace *ns, char *name) {
     return NULL;
 }
 
+ast_node *function_lookup(namespace *ns, char *name) {
+    for (; ns != NULL; ns = ns->parent) {
+        if (ns->functions_by_name == NULL)
+            continue;
+
+        ast_node *function = *find_function_slot(ns->functions_by_name, name);
+        if (function != NULL)
+            return function;
+    }
+
+    return NULL;
+}
+
+static void free_nodes(vec nodes) {
+    vec_iter(ast_node *node, nodes, node->free_func(node))
+    vec_free(nodes);
+}
+
 void function_node_free(ast_node *node) {
     function_node *func_node = node->node;
     free(node);
 
-    vec_iter(ast_node *var_node, func_node->func_namespace.vars, var_node->free_func(var_node))
-    vec_free(func_node->func_namespace.vars);
-    vec_iter(ast_node *statement, func_node->statements, statement->free_func(statement))
-    vec_free(func_node->statements);
+    free_nodes(func_node->statements);
+    dag_free(func_node->func_namespace.dag);
+    free_vars(func_node->func_namespace.vars);
+    vec_free(func_node->func_namespace.functions);
+    free_function_index(&func_node->func_namespace);
 
     free(func_node);
 }
 
-ast_node *function_node_new(type *ret_type, char *name) {
+/**
+ * Frees the body of a function once it is no longer needed, its signature stays so later calls and the module's
+ * interface can still use it
+ * @param func_node Function
+ */
+void function_node_free_body(function_node *func_node) {
+    free_nodes(func_node->statements);
+    func_node->statements = vec_new();
+    dag_free(func_node->func_namespace.dag);
+    func_node->func_namespace.dag = NULL;
+
+    vec vars = func_node->func_namespace.vars;
+    while (vec_len(vars) > func_node->param_count) {
+        var_free(vec_pop(vars));
+    }
+    func_node->defined = false;
+}
+
+ast_node *function_node_new(type *ret_type, char *name, namespace *parent) {
     function_node *func_node = malloc(sizeof(function_node));
     func_node->name = name;
     func_node->param_count = 0;
     func_node->statements = vec_new();
     init_namespace(&func_node->func_namespace);
+    func_node->func_namespace.parent = parent;
+    func_node->func_namespace.depth = parent->depth + 1;
+    func_node->pure = false;
+    func_node->declared_pure = false;
+    func_node->defined = false;
+    func_node->used = false;
+    func_node->reachable = false;
+    func_node->definition_end = UINT32_MAX;
+    func_node->extern_symbol = NULL;
     return ast_node_new(ret_type, func_node, &function_assembly, &function_node_free, &function_print);
 }
 
-void function_node_add_var(function_node *func_node, ast_node *var_node) {
-    vec_push(func_node->func_namespace.vars, var_node);
+ast_node *function_node_add_var(function_node *func_node, type *var_type, char *var_name) {
+    return var_declare(&func_node->func_namespace, var_type, var_name);
 }
 
+/**
+ * Creates a new AST node for a literal
+ * @param literal_type Data type of the literal
+ * @param value Literal token, it is interned so the node does not own it
+ * @return ast_node*: AST node for the literal
+ */
 ast_node *literal_node_new(type *literal_type, char *value) {
-    // TODO: free
-    return ast_node_new(literal_type, value, &literal_assembly, NULL, &literal_print);
+    return ast_node_new(literal_type, value, &literal_assembly, &var_node_free, &literal_print);
+}
+
+/**
+ * Frees a binary operation and its operands
+ * @param node Binary operation node
+ */
+void binary_operation_free(ast_node *node) {
+    binary_operation_node *op_node = node->node;
+    op_node->left->free_func(op_node->left);
+    if (op_node->right != NULL) {
+        op_node->right->free_func(op_node->right);
+    }
+    free(op_node);
+    free(node);
 }
 
 ast_node *binary_operation_new(type *operation_type, ast_node *left, ast_node *right, void (*generate_assembly)(ast_node*)) {
     binary_operation_node *node = malloc(sizeof(binary_operation_node));
     node->left = left;
     node->right = right;
-    // TODO: free
-    return ast_node_new(operation_type, node, generate_assembly, NULL, &binary_operation_print);
+    return ast_node_new(operation_type, node, generate_assembly, &binary_operation_free, &binary_operation_print);
+}
+
+/**
+ * Creates a new AST node for a module level variable definition
+ * @param var_type Data type of the variable
+ * @param var Variable being defined
+ * @param value Constant initializer, NULL if the variable is zero-initialized
+ * @return ast_node*: AST node for the definition
+ */
+ast_node *global_var_node_new(type *var_type, ast_node *var, ast_node *value) {
+    return binary_operation_new(var_type, var, value, &global_var_assembly);
+}
+
+void call_free(ast_node *node) {
+    call_node *call = node->node;
+    free_nodes(call->args);
+    free(call);
+    free(node);
+}
+
+/**
+ * Creates a new AST node for a function call
+ * @param function Function being called
+ * @param args Argument expressions
+ * @return ast_node*: AST node for the call
+ */
+ast_node *call_node_new(ast_node *function, vec args) {
+    call_node *call = malloc(sizeof(call_node));
+    call->function = function;
+    call->args = args;
+    return ast_node_new(function->expr_type, call, &call_assembly, &call_free, &call_print);
+}
+
+void return_free(ast_node *node) {
+    ast_node *value = node->node;
+    if (value != NULL) {
+        value->free_func(value);
+    }
+    free(node);
+}
+
+ast_node *return_node_new(ast_node *value) {
+    return ast_node_new(value == NULL ? NULL : value->expr_type, value, &return_assembly, &return_free, &return_print);
+}
+
+void print_free(ast_node *node) {
+    free_nodes(node->node);
+    free(node);
+}
+
+/**
+ * Creates a new AST node for a print statement
+ * @param values Expressions printed in order, separated by spaces and followed by a newline
+ * @return ast_node*: AST node for the print statement
+ */
+ast_node *print_node_new(vec values) {
+    return ast_node_new(NULL, values, &print_assembly, &print_free, &print_statement_print);
+}
+
+void match_free(ast_node *node) {
+    match_node *match = node->node;
+    match->value->free_func(match->value);
+    vec_iter(match_arm *arm, match->arms, {
+        vec_free(arm->values);
+        free_nodes(arm->statements);
+        free(arm);
+    })
+    vec_free(match->arms);
+    if (match->default_statements != NULL) {
+        free_nodes(match->default_statements);
+    }
+    free(match);
+    free(node);
+}
+
+/**
+ * Creates a new AST node for a match statement, arms are added as their lines are parsed
+ * @param value Expression being matched on
+ * @return ast_node*: AST node for the match statement
+ */
+ast_node *match_node_new(ast_node *value) {
+    match_node *match = malloc(sizeof(match_node));
+    match->value = value;
+    match->arms = vec_new();
+    match->default_statements = NULL;
+    return ast_node_new(value->expr_type, match, &match_assembly, &match_free, &match_print);
+}
+
+match_arm *match_node_add_arm(match_node *match) {
+    match_arm *arm = malloc(sizeof(match_arm));
+    arm->values = vec_new();
+    arm->statements = vec_new();
+    vec_push(match->arms, arm);
+    return arm;
+}
+
+static int compare_match_values(void *a, void *b) {
+    return a != b;
+}
+
+bool match_node_has_value(match_node *match, int64_t value) {
+    vec_iter(match_arm *arm, match->arms, {
+        if (vec_conatins(arm->values, (void*) value, &compare_match_values))
+            return true;
+    })
+
+    return false;
+}
+
+static for_node *for_node_alloc(ast_node *start, ast_node *end) {
+    for_node *loop = malloc(sizeof(for_node));
+    loop->start = start;
+    loop->end = end;
+    loop->end_var = NULL;
+    loop->statements = vec_new();
+    loop->invariants = vec_new();
+    loop->body = NULL;
+    loop->dynamic = false;
+    loop->reductions = vec_new();
+    return loop;
+}
+
+/**
+ * Frees a for loop, its variables belong to the enclosing namespace. A parallel loop's outlined body shares the
+ * loop's statements and the enclosing function's DAG, and owns the variables of the loop body
+ * @param node For node
+ */
+void for_free(ast_node *node) {
+    for_node *loop = node->node;
+    loop->start->free_func(loop->start);
+    loop->end->free_func(loop->end);
+    free_nodes(loop->statements);
+    free_nodes(loop->invariants);
+    free_vec_and_elements(loop->reductions);
+
+    if (loop->body != NULL) {
+        free_vars(loop->body->func_namespace.vars);
+        vec_free(loop->body->func_namespace.functions);
+        free(loop->body);
+    }
+    free(loop);
+    free(node);
+}
+
+/**
+ * Creates a new AST node for a for loop over the range [start, end)
+ * @param var Loop variable
+ * @param start Expression for the first value of the loop variable
+ * @param end Expression for the end of the range, evaluated once before the loop
+ * @param end_var Hidden variable holding the end of the range
+ * @return ast_node*: AST node for the loop
+ */
+ast_node *for_node_new(ast_node *var, ast_node *start, ast_node *end, ast_node *end_var) {
+    for_node *loop = for_node_alloc(start, end);
+    loop->var = var;
+    loop->end_var = end_var;
+    return ast_node_new(NULL, loop, &for_assembly, &for_free, &for_print);
+}
+
+/**
+ * Creates a new AST node for a parallel for loop, its body is outlined into a function run by the threading
+ * runtime on chunks of the range
+ * @param body Outlined body, its first variables are laid out as in parallel_body_slot
+ * @param start Expression for the start of the range
+ * @param end Expression for the end of the range
+ * @param dynamic Whether chunks are handed out dynamically instead of split evenly up front
+ * @return ast_node*: AST node for the loop
+ */
+ast_node *parallel_for_node_new(function_node *body, ast_node *start, ast_node *end, bool dynamic) {
+    for_node *loop = for_node_alloc(start, end);
+    loop->var = vec_get(body->func_namespace.vars, PARALLEL_INDEX);
+    loop->body = body;
+    loop->dynamic = dynamic;
+    vec_free(body->statements);
+    body->statements = loop->statements;
+    return ast_node_new(NULL, loop, &parallel_for_assembly, &for_free, &for_print);
+}
+
+/**
+ * Adds a reduction to a parallel for loop, the loop body gets a private copy of the reduced variable
+ * @param loop Parallel for loop
+ * @param combine Assembly of the operator combining the copies
+ * @param target Variable of the enclosing function the copies are combined into
+ */
+void parallel_for_node_add_reduction(for_node *loop, void (*combine)(ast_node*), ast_node *target) {
+    reduction *loop_reduction = malloc(sizeof(reduction));
+    loop_reduction->combine = combine;
+    loop_reduction->var = function_node_add_var(loop->body, target->expr_type, var_name(target));
+    loop_reduction->target = target;
+    vec_push(loop->reductions, loop_reduction);
+}
+
+ast_node *program_node_new() {
+    program_node *program = malloc(sizeof(program_node));
+    program->definitions = vec_new();
+    init_namespace(&program->global_namespace);
+    program->module = NULL;
+    program->entry = false;
+    return ast_node_new(NULL, program, NULL, &program_node_free, &program_print);
+}
+
+/**
+ * Frees a program, its functions belong to the global namespace and its other definitions to the program
+ * @param node Program node
+ */
+void program_node_free(ast_node *node) {
+    program_node *program = node->node;
+    vec_iter(ast_node *definition, program->definitions, {
+        if (definition->generate_assembly != &function_assembly) {
+            definition->free_func(definition);
+        }
+    })
+    vec_free(program->definitions);
+    free_nodes(program->global_namespace.functions);
+    free_function_index(&program->global_namespace);
+    free_vars(program->global_namespace.vars);
+    dag_free(program->global_namespace.dag);
+    free(program);
+    free(node);
 }
 
 void function_print(ast_node *node, size_t level) {
     function_node *func_node = node->node;
-    printf("fn %s(", func_node->name);
+    printf("%sfn %s(", func_node->pure ? "pure " : "", func_node->name);
 
     vec vars = func_node->func_namespace.vars;
     for (size_t i = 0; i < func_node->param_count; i++) {
@@ -109,7 +528,7 @@ void function_print(ast_node *node, size_t level) {
         if (i != 0) {
             printf(", ");
         }
-        printf("%s %s", (char*) param->expr_type->name, (char*) param->node);
+        printf("%s %s", (char*) param->expr_type->name, var_name(param));
     }
     printf(") -> %s\n", node->expr_type->name);
 
@@ -117,7 +536,9 @@ void function_print(ast_node *node, size_t level) {
 }
 
 void var_print(ast_node *node, size_t _) {
-    printf("%s %s (%lu bytes)\n", node->expr_type->name, (char*) node->node, node->expr_type->size);
+    var_node *var = node->node;
+    printf("%s %s (%u:%u, %lu bytes)\n", node->expr_type->name, var->name, var->scope, var->slot,
+        node->expr_type->size);
 }
 
 void literal_print(ast_node *node, size_t _) {
@@ -127,11 +548,15 @@ void literal_print(ast_node *node, size_t _) {
 void binary_operation_print(ast_node *node, size_t level) {
     void *assembly_functions[NUM_BINARY_OPERATORS << 1] = {
         &assignment_assembly, "=",
+        &global_var_assembly, "=",
         &mul_assembly, "*",
         &div_assembly, "/",
         &mod_assembly, "%",
         &add_assembly, "+",
         &sub_assembly, "-",
+        &or_assembly, "|",
+        &xor_assembly, "^",
+        &and_assembly, "&",
     };
 
     void (*assembly)(ast_node*) = node->generate_assembly;
@@ -144,7 +569,62 @@ void binary_operation_print(ast_node *node, size_t level) {
 
     binary_operation_node *op_node = node->node;
     ast_node_print(op_node->left, level + 1);
-    ast_node_print(op_node->right, level + 1);
+    if (op_node->right != NULL) {
+        ast_node_print(op_node->right, level + 1);
+    }
+}
+
+void call_print(ast_node *node, size_t level) {
+    call_node *call = node->node;
+    printf("%s()\n", ((function_node*) call->function->node)->name);
+    vec_iter(ast_node *arg, call->args, ast_node_print(arg, level + 1))
+}
+
+void return_print(ast_node *node, size_t level) {
+    puts("return");
+    if (node->node != NULL) {
+        ast_node_print(node->node, level + 1);
+    }
+}
+
+void print_statement_print(ast_node *node, size_t level) {
+    puts("print");
+    vec_iter(ast_node *value, node->node, ast_node_print(value, level + 1))
+}
+
+void match_print(ast_node *node, size_t level) {
+    match_node *match = node->node;
+    puts("match");
+    ast_node_print(match->value, level + 1);
+
+    vec_iter(match_arm *arm, match->arms, {
+        printf("%*scase", (int) (level + 1) << 1, "");
+        for (size_t j = 0; j < vec_len(arm->values); j++) {
+            printf(" %ld", (int64_t) vec_get(arm->values, j));
+        }
+        puts("");
+        vec_iter(ast_node *statement, arm->statements, ast_node_print(statement, level + 2))
+    })
+
+    if (match->default_statements != NULL) {
+        printf("%*selse\n", (int) (level + 1) << 1, "");
+        vec_iter(ast_node *statement, match->default_statements, ast_node_print(statement, level + 2))
+    }
+}
+
+void for_print(ast_node *node, size_t level) {
+    for_node *loop = node->node;
+    printf("%sfor %s\n", loop->body != NULL ? "parallel " : "", var_name(loop->var));
+    ast_node_print(loop->start, level + 1);
+    ast_node_print(loop->end, level + 1);
+    vec_iter(ast_node *invariant, loop->invariants, ast_node_print(invariant, level + 1))
+    vec_iter(ast_node *statement, loop->statements, ast_node_print(statement, level + 1))
+}
+
+void program_print(ast_node *node, size_t level) {
+    program_node *program = node->node;
+    puts("program");
+    vec_iter(ast_node *definition, program->definitions, ast_node_print(definition, level + 1))
 }
 
 /**
@@ -1,6 +1,9 @@
 #ifndef AST_NODE_H
 #define AST_NODE_H
 
+#include <stdint.h>
+
+#include "line_iterator.h"
 #include "types.h"
 #include "vec.h"
 
@@ -22,9 +25,21 @@ typedef struct assignment_s {
     ast_node *value;
 } assignment_node;
 
+typedef struct var_s {
+    char *name;
+    uint32_t scope;
+    uint32_t slot;
+} var_node;
+
+typedef struct function_index_s function_index;
+
 typedef struct namespace_s {
     vec vars;
+    vec functions;
+    function_index *functions_by_name;
     struct namespace_s *parent;
+    uint32_t depth;
+    struct dag_s *dag;
 } namespace;
 
 typedef struct function_s {
@@ -32,15 +47,111 @@ typedef struct function_s {
     size_t param_count;
     vec statements;
     namespace func_namespace;
+    bool pure;
+    bool declared_pure;
+    bool defined;
+    bool used;
+    bool reachable;
+    line definition;
+    uint32_t definition_end;
+    char *extern_symbol;
 } function_node;
 
-ast_node *var_node_new(type *var_type, char *var_name);
+typedef struct call_s {
+    ast_node *function;
+    vec args;
+} call_node;
+
+typedef struct match_arm_s {
+    vec values;
+    vec statements;
+} match_arm;
+
+typedef struct match_s {
+    ast_node *value;
+    vec arms;
+    vec default_statements;
+} match_node;
+
+typedef enum parallel_body_slot_e {
+    PARALLEL_INDEX,
+    PARALLEL_END,
+    PARALLEL_CONTEXT,
+    PARALLEL_THREAD,
+    PARALLEL_ACCUMULATORS,
+    PARALLEL_BODY_PARAMS,
+} parallel_body_slot;
+
+typedef struct reduction_s {
+    void (*combine)(ast_node*);
+    ast_node *var;
+    ast_node *target;
+} reduction;
+
+typedef struct for_s {
+    ast_node *var;
+    ast_node *start;
+    ast_node *end;
+    ast_node *end_var;
+    vec statements;
+    vec invariants;
+    function_node *body;
+    bool dynamic;
+    vec reductions;
+} for_node;
+
+typedef struct program_s {
+    vec definitions;
+    namespace global_namespace;
+    char *module;
+    bool entry;
+} program_node;
+
+ast_node *var_declare(namespace *ns, type *var_type, char *var_name);
 
 ast_node *var_lookup(namespace *ns, char *name);
 
-ast_node *function_node_new(type *ret_type, char *name);
+char *var_name(ast_node *var);
+
+bool shared_node(ast_node *node);
+
+void share_node(ast_node *node);
+
+ast_node *var_ref_copy(ast_node *var);
+
+ast_node *global_var_node_new(type *var_type, ast_node *var, ast_node *value);
+
+ast_node *function_node_new(type *ret_type, char *name, namespace *parent);
+
+void namespace_add_function(namespace *ns, ast_node *function);
+
+ast_node *function_lookup(namespace *ns, char *name);
+
+ast_node *call_node_new(ast_node *function, vec args);
+
+ast_node *function_node_add_var(function_node *func_node, type *var_type, char *var_name);
+
+void function_node_free_body(function_node *func_node);
+
+ast_node *return_node_new(ast_node *value);
+
+ast_node *print_node_new(vec values);
+
+ast_node *match_node_new(ast_node *value);
+
+match_arm *match_node_add_arm(match_node *match);
+
+bool match_node_has_value(match_node *match, int64_t value);
+
+ast_node *for_node_new(ast_node *var, ast_node *start, ast_node *end, ast_node *end_var);
+
+ast_node *parallel_for_node_new(function_node *body, ast_node *start, ast_node *end, bool dynamic);
+
+void parallel_for_node_add_reduction(for_node *loop, void (*combine)(ast_node*), ast_node *target);
+
+ast_node *program_node_new();
 
-void function_node_add_var(function_node *func_node, ast_node *var_node);
+void program_node_free(ast_node *node);
 
 ast_node *assignment_node_new(ast_node *var, ast_node *value);
 
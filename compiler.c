@@ -0,0 +1,138 @@
+#include "compiler.h"
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "context.h"
+#include "diagnostics.h"
+#include "module.h"
+#include "pipeline.h"
+
+/**
+ * A reusable compiler, the state every compile reads is built once when the compiler is created so a compile only
+ * pays for its own source
+ */
+struct compiler_s {
+    compiler_shared *shared;
+    compiler_allocator allocator;
+};
+
+static void *default_allocate(void *_, size_t size) {
+    return malloc(size);
+}
+
+static void default_release(void *_, void *ptr) {
+    free(ptr);
+}
+
+/**
+ * Creates a compiler, compiles on it may run on any number of threads at once, one at a time on each thread as
+ * compiler.h describes. Each compile interns its strings into an interner of its own that is freed when the compile
+ * returns, so compilers can be freed and created again at any time
+ * @param allocator Allocator of the compiler and its results, NULL to use malloc
+ * @return compiler*: the compiler
+ */
+compiler *compiler_new(compiler_allocator *allocator) {
+    compiler_allocator chosen = allocator != NULL ? *allocator
+        : (compiler_allocator) {&default_allocate, &default_release, NULL};
+    compiler *instance = chosen.allocate(chosen.context, sizeof(compiler));
+    instance->allocator = chosen;
+    instance->shared = compiler_shared_new();
+    return instance;
+}
+
+void compiler_free(compiler *instance) {
+    compiler_shared_free(instance->shared);
+    instance->allocator.release(instance->allocator.context, instance);
+}
+
+/**
+ * Moves a buffer written by a memory stream into memory from the compiler's allocator
+ * @param instance Compiler
+ * @param buffer Buffer, it is freed
+ * @param len Length of the buffer
+ * @return char*: NUL terminated copy of the buffer
+ */
+static char *hand_back(compiler *instance, char *buffer, size_t len) {
+    char *copy = instance->allocator.allocate(instance->allocator.context, len + 1);
+    memcpy(copy, buffer, len + 1);
+    free(buffer);
+    return copy;
+}
+
+/**
+ * Compiles the source of a module from memory to assembly without touching the file system, except to read the
+ * interfaces of the modules it imports. The compile runs on the calling thread
+ * @param instance Compiler
+ * @param path Path the module is compiled as, it names the module and appears in diagnostics
+ * @param source Source of the module, it does not have to be NUL terminated
+ * @param len Length of the source
+ * @param entry Whether the module is the program's entry point
+ * @param options How the source is parsed
+ * @return compile_result: the assembly and diagnostics of the module
+ */
+compile_result compile_source(compiler *instance, char *path, char *source, size_t len, bool entry,
+    parse_options options) {
+
+    compile_result result;
+    FILE *assembly = open_memstream(&result.assembly, &result.assembly_len);
+    compilation *unit = compilation_new(instance->shared);
+    unit->diagnostic_output = open_memstream(&result.diagnostics, &result.diagnostics_len);
+    bind_compilation(unit);
+
+    jmp_buf failure;
+    volatile bool compiled = false;
+    unit->failure = &failure;
+    if (setjmp(failure) == 0) {
+        compile_module_source(unit, path, source, len, entry, options, assembly);
+        flush_diagnostics();
+        compiled = true;
+    } else {
+        cancel_lexers();
+    }
+
+    if (unit->root != NULL) {
+        program_node_free(unit->root);
+    }
+    fclose(unit->diagnostic_output);
+    compilation_free(unit);
+    fclose(assembly);
+
+    result.compiled = compiled;
+    if (!compiled) {
+        free(result.assembly);
+        result.assembly = NULL;
+        result.assembly_len = 0;
+    } else {
+        result.assembly = hand_back(instance, result.assembly, result.assembly_len);
+    }
+    result.diagnostics = hand_back(instance, result.diagnostics, result.diagnostics_len);
+    return result;
+}
+
+void compile_result_free(compiler *instance, compile_result *result) {
+    if (result->assembly != NULL) {
+        instance->allocator.release(instance->allocator.context, result->assembly);
+    }
+    instance->allocator.release(instance->allocator.context, result->diagnostics);
+}
+
+/**
+ * Builds a program from its entry module on disk, each module is compiled to assembly and an interface next to its
+ * source. The build starts a worker pool of its own with the calling thread as its first worker, so builds on
+ * different threads run independently
+ * @param instance Compiler
+ * @param path Path of the entry module's source
+ * @param jobs Number of modules compiled at once
+ * @param stream Whether each function is compiled and released as soon as it is parsed
+ * @param options How each module's source is parsed
+ * @param linking How the program is assembled and linked, NULL to only write each module's assembly
+ * @return bool: whether every module compiled, and the program linked when it is linked
+ */
+bool compile_program(compiler *instance, char *path, size_t jobs, bool stream, parse_options options,
+    link_options *linking) {
+
+    return build_module(instance->shared, path, jobs, stream, options, linking);
+}
@@ -0,0 +1,52 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "ast.h"
+#include "toolchain.h"
+
+/**
+ * Allocates the compiler and the buffers it hands back to the caller, the memory a compile works in is released
+ * before the compile returns
+ */
+typedef struct compiler_allocator_s {
+    void *(*allocate)(void *context, size_t size);
+    void (*release)(void *context, void *ptr);
+    void *context;
+} compiler_allocator;
+
+/**
+ * A reusable compiler, compiles on it may run on any number of threads at once but a thread runs one compile at a
+ * time. A compile binds its state to the calling thread and the code generator keeps its own per thread, so a
+ * compile must not be started on a thread that is already inside one, for instance from a signal handler or an
+ * allocator callback. Nested compiles have to run on another thread
+ */
+typedef struct compiler_s compiler;
+
+/**
+ * Outcome of compiling a source buffer, both buffers are NUL terminated and allocated with the compiler's
+ * allocator. There is no assembly when the source did not compile
+ */
+typedef struct compile_result_s {
+    bool compiled;
+    char *assembly;
+    size_t assembly_len;
+    char *diagnostics;
+    size_t diagnostics_len;
+} compile_result;
+
+compiler *compiler_new(compiler_allocator *allocator);
+
+void compiler_free(compiler *instance);
+
+compile_result compile_source(compiler *instance, char *path, char *source, size_t len, bool entry,
+    parse_options options);
+
+void compile_result_free(compiler *instance, compile_result *result);
+
+bool compile_program(compiler *instance, char *path, size_t jobs, bool stream, parse_options options,
+    link_options *linking);
+
+#endif //COMPILER_H
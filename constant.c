@@ -0,0 +1,382 @@
+#include "constant.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "assembly_generator.h"
+#include "context.h"
+#include "pattern.h"
+
+#define MAX_EVALUATION_STEPS 1000000
+#define MAX_COMPILATION_STEPS 16000000
+#define MAX_CALL_DEPTH 256
+#define INITIAL_EVALUATION_CAPACITY 64
+
+#define FNV_OFFSET 0xcbf29ce484222325
+#define FNV_PRIME 0x100000001b3
+
+typedef struct interpreter_frame_s {
+    function_node *function;
+    int64_t *slots;
+    size_t depth;
+    int64_t result;
+} interpreter_frame;
+
+typedef enum execution_status_e {
+    EXECUTION_NORMAL,
+    EXECUTION_RETURNED,
+    EXECUTION_FAILED,
+} execution_status;
+
+/**
+ * Outcome of interpreting a pure function with some arguments, failed calls are remembered so a call that cannot
+ * be folded only spends its budget once per compilation
+ */
+typedef struct evaluation_s {
+    function_node *function;
+    uint64_t hash;
+    bool success;
+    int64_t value;
+    size_t arg_count;
+    int64_t args[];
+} evaluation;
+
+/**
+ * Calls interpreted by a compilation and the steps it has left for interpreting more
+ */
+struct evaluations_s {
+    size_t steps;
+    size_t capacity;
+    size_t count;
+    evaluation **slots;
+};
+
+static __thread size_t steps_remaining;
+static __thread bool reached_undefined;
+
+static bool evaluate(ast_node *node, interpreter_frame *frame, int64_t *value);
+static execution_status execute_statements(vec statements, interpreter_frame *frame);
+
+/**
+ * Applies a binary operator at compile time with the same wrapping behavior as the generated code
+ * @param generate_assembly Assembly generator identifying the operator
+ * @param left Left operand
+ * @param right Right operand
+ * @param value Set to the result
+ * @return bool: false if the operator is unknown or would trap at runtime
+ */
+bool evaluate_operator(void (*generate_assembly)(ast_node*), int64_t left, int64_t right, int64_t *value) {
+    if (generate_assembly == &add_assembly) {
+        *value = (int64_t) ((uint64_t) left + (uint64_t) right);
+    } else if (generate_assembly == &sub_assembly) {
+        *value = (int64_t) ((uint64_t) left - (uint64_t) right);
+    } else if (generate_assembly == &mul_assembly) {
+        *value = (int64_t) ((uint64_t) left * (uint64_t) right);
+    } else if (generate_assembly == &or_assembly) {
+        *value = left | right;
+    } else if (generate_assembly == &xor_assembly) {
+        *value = left ^ right;
+    } else if (generate_assembly == &and_assembly) {
+        *value = left & right;
+    } else if (generate_assembly == &div_assembly || generate_assembly == &mod_assembly) {
+        if (right == 0 || (left == INT64_MIN && right == -1))
+            return false;
+        *value = generate_assembly == &div_assembly ? left / right : left % right;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+bool arithmetic_operation(ast_node *node) {
+    void (*assembly)(ast_node*) = node->generate_assembly;
+    return assembly == &add_assembly || assembly == &sub_assembly || assembly == &mul_assembly
+        || assembly == &div_assembly || assembly == &mod_assembly
+        || assembly == &or_assembly || assembly == &xor_assembly || assembly == &and_assembly;
+}
+
+/**
+ * Finds the slot of a variable in the frame of the function being interpreted
+ * @param frame Current frame, NULL outside of a function
+ * @param node Variable
+ * @return int64_t*: the variable's slot, NULL if it is not a local of the function
+ */
+static int64_t *frame_slot(interpreter_frame *frame, ast_node *node) {
+    var_node *var = node->node;
+    if (frame == NULL || var->scope != frame->function->func_namespace.depth)
+        return NULL;
+
+    return frame->slots + var->slot;
+}
+
+static struct evaluations_s *compilation_evaluations() {
+    compilation *unit = bound_compilation();
+    if (unit->evaluations == NULL) {
+        struct evaluations_s *evaluations = malloc(sizeof(struct evaluations_s));
+        evaluations->steps = MAX_COMPILATION_STEPS;
+        evaluations->capacity = INITIAL_EVALUATION_CAPACITY;
+        evaluations->count = 0;
+        evaluations->slots = calloc(evaluations->capacity, sizeof(evaluation*));
+        unit->evaluations = evaluations;
+    }
+    return unit->evaluations;
+}
+
+void free_evaluations(compilation *unit) {
+    struct evaluations_s *evaluations = unit->evaluations;
+    if (evaluations == NULL)
+        return;
+
+    for (size_t i = 0; i < evaluations->capacity; i++) {
+        free(evaluations->slots[i]);
+    }
+    free(evaluations->slots);
+    free(evaluations);
+}
+
+static uint64_t evaluation_hash(function_node *function, int64_t *args, size_t arg_count) {
+    uint64_t hash = (FNV_OFFSET ^ (uintptr_t) function) * FNV_PRIME;
+    for (size_t i = 0; i < arg_count; i++) {
+        hash = (hash ^ (uint64_t) args[i]) * FNV_PRIME;
+    }
+    return hash ^ (hash >> 29);
+}
+
+static evaluation **find_evaluation_slot(struct evaluations_s *evaluations, function_node *function,
+    uint64_t hash, int64_t *args, size_t arg_count) {
+
+    size_t mask = evaluations->capacity - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        evaluation *entry = evaluations->slots[i];
+        if (entry == NULL || (entry->hash == hash && entry->function == function && entry->arg_count == arg_count
+            && memcmp(entry->args, args, arg_count * sizeof(int64_t)) == 0))
+            return evaluations->slots + i;
+    }
+}
+
+static void remember_evaluation(function_node *function, uint64_t hash, int64_t *args, size_t arg_count,
+    bool success, int64_t value) {
+
+    struct evaluations_s *evaluations = compilation_evaluations();
+    evaluation *entry = malloc(sizeof(evaluation) + arg_count * sizeof(int64_t));
+    entry->function = function;
+    entry->hash = hash;
+    entry->success = success;
+    entry->value = value;
+    entry->arg_count = arg_count;
+    memcpy(entry->args, args, arg_count * sizeof(int64_t));
+    *find_evaluation_slot(evaluations, function, hash, args, arg_count) = entry;
+    if (++evaluations->count << 1 <= evaluations->capacity)
+        return;
+
+    size_t capacity = evaluations->capacity;
+    evaluation **slots = evaluations->slots;
+    evaluations->capacity = capacity << 1;
+    evaluations->slots = calloc(evaluations->capacity, sizeof(evaluation*));
+    for (size_t i = 0; i < capacity; i++) {
+        if (slots[i] != NULL) {
+            *find_evaluation_slot(evaluations, slots[i]->function, slots[i]->hash, slots[i]->args,
+                slots[i]->arg_count) = slots[i];
+        }
+    }
+    free(slots);
+}
+
+/**
+ * Interprets a call to a pure function. The outcome is remembered for the function and its arguments, unless it
+ * depended on a function whose body was not parsed yet
+ * @param call Call node
+ * @param frame Frame of the caller, NULL outside of a function
+ * @param value Set to the function's return value
+ * @return bool: whether the call could be evaluated
+ */
+static bool evaluate_call(call_node *call, interpreter_frame *frame, int64_t *value) {
+    function_node *func_node = call->function->node;
+    size_t depth = frame == NULL ? 0 : frame->depth + 1;
+    if (!func_node->pure || func_node->extern_symbol != NULL || depth == MAX_CALL_DEPTH)
+        return false;
+    if (!func_node->defined) {
+        reached_undefined = true;
+        return false;
+    }
+
+    interpreter_frame callee = {
+        .function = func_node,
+        .slots = calloc(vec_len(func_node->func_namespace.vars) + 1, sizeof(int64_t)),
+        .depth = depth,
+        .result = 0,
+    };
+
+    size_t arg_count = vec_len(call->args);
+    bool success = true;
+    for (size_t i = 0; success && i < arg_count; i++) {
+        success = evaluate(vec_get(call->args, i), frame, callee.slots + i);
+    }
+    if (!success) {
+        free(callee.slots);
+        return false;
+    }
+
+    uint64_t hash = evaluation_hash(func_node, callee.slots, arg_count);
+    evaluation *known = *find_evaluation_slot(compilation_evaluations(), func_node, hash, callee.slots, arg_count);
+    if (known != NULL) {
+        free(callee.slots);
+        *value = known->value;
+        return known->success;
+    }
+
+    int64_t *args = malloc((arg_count + 1) * sizeof(int64_t));
+    memcpy(args, callee.slots, arg_count * sizeof(int64_t));
+    bool undefined_before = reached_undefined;
+    reached_undefined = false;
+    success = execute_statements(func_node->statements, &callee) != EXECUTION_FAILED;
+    if (!reached_undefined) {
+        remember_evaluation(func_node, hash, args, arg_count, success, callee.result);
+    }
+    reached_undefined |= undefined_before;
+
+    *value = callee.result;
+    free(args);
+    free(callee.slots);
+    return success;
+}
+
+/**
+ * Evaluates an expression, every node evaluated within an interpreted function costs a step. Nodes outside any
+ * function are bounded by the size of the expression and cost nothing
+ */
+static bool evaluate(ast_node *node, interpreter_frame *frame, int64_t *value) {
+    if (frame != NULL) {
+        if (steps_remaining == 0)
+            return false;
+        steps_remaining--;
+    }
+
+    void (*assembly)(ast_node*) = node->generate_assembly;
+    if (assembly == &literal_assembly) {
+        if (node->expr_type->validate_literal != &valid_i64_literal)
+            return false;
+        *value = strtol(node->node, NULL, 0);
+        return true;
+    }
+
+    if (assembly == &load_assembly) {
+        int64_t *slot = frame_slot(frame, node);
+        if (slot == NULL)
+            return false;
+        *value = *slot;
+        return true;
+    }
+
+    if (assembly == &call_assembly)
+        return evaluate_call(node->node, frame, value);
+
+    binary_operation_node *op_node = node->node;
+    if (assembly == &assignment_assembly) {
+        int64_t *slot = frame_slot(frame, op_node->left);
+        if (slot == NULL || !evaluate(op_node->right, frame, value))
+            return false;
+        *slot = *value;
+        return true;
+    }
+
+    int64_t left, right;
+    return arithmetic_operation(node)
+        && evaluate(op_node->left, frame, &left)
+        && evaluate(op_node->right, frame, &right)
+        && evaluate_operator(assembly, left, right, value);
+}
+
+static execution_status execute_match(match_node *match, interpreter_frame *frame) {
+    int64_t value;
+    if (!evaluate(match->value, frame, &value))
+        return EXECUTION_FAILED;
+
+    vec_iter(match_arm *arm, match->arms, {
+        for (size_t j = 0; j < vec_len(arm->values); j++) {
+            if ((int64_t) vec_get(arm->values, j) == value)
+                return execute_statements(arm->statements, frame);
+        }
+    })
+
+    return match->default_statements == NULL
+        ? EXECUTION_NORMAL
+        : execute_statements(match->default_statements, frame);
+}
+
+/**
+ * Interprets a sequential for loop, every iteration costs a step so long loops run out of budget. Parallel loops
+ * are never evaluated at compile time
+ * @param loop For loop
+ * @param frame Current frame
+ * @return execution_status: how the loop finished
+ */
+static execution_status execute_for(for_node *loop, interpreter_frame *frame) {
+    int64_t *var = frame_slot(frame, loop->var);
+    int64_t start, end;
+    if (loop->body != NULL || var == NULL
+        || !evaluate(loop->end, frame, &end) || !evaluate(loop->start, frame, &start))
+        return EXECUTION_FAILED;
+
+    if (start < end && execute_statements(loop->invariants, frame) != EXECUTION_NORMAL)
+        return EXECUTION_FAILED;
+
+    for (*var = start; *var < end; (*var)++) {
+        if (steps_remaining == 0)
+            return EXECUTION_FAILED;
+        steps_remaining--;
+
+        execution_status status = execute_statements(loop->statements, frame);
+        if (status != EXECUTION_NORMAL)
+            return status;
+    }
+
+    return EXECUTION_NORMAL;
+}
+
+static execution_status execute_statement(ast_node *statement, interpreter_frame *frame) {
+    int64_t value = 0;
+
+    if (statement->generate_assembly == &return_assembly) {
+        if (statement->node != NULL && !evaluate(statement->node, frame, &value))
+            return EXECUTION_FAILED;
+        frame->result = value;
+        return EXECUTION_RETURNED;
+    }
+
+    if (statement->generate_assembly == &match_assembly)
+        return execute_match(statement->node, frame);
+    if (statement->generate_assembly == &for_assembly || statement->generate_assembly == &parallel_for_assembly)
+        return execute_for(statement->node, frame);
+
+    return evaluate(statement, frame, &value) ? EXECUTION_NORMAL : EXECUTION_FAILED;
+}
+
+static execution_status execute_statements(vec statements, interpreter_frame *frame) {
+    vec_iter(ast_node *statement, statements, {
+        execution_status status = execute_statement(statement, frame);
+        if (status != EXECUTION_NORMAL)
+            return status;
+    })
+
+    return EXECUTION_NORMAL;
+}
+
+/**
+ * Evaluates an expression at compile time on the bound compilation. Calls to pure functions are interpreted within
+ * a step budget per expression, drawn from a budget for the whole compilation, and the outcome of every call is
+ * remembered so a call that could not be folded is not interpreted again
+ * @param node Root of the expression
+ * @param value Set to the value of the expression
+ * @return bool: whether the expression is an i64 constant
+ */
+bool evaluate_constant(ast_node *node, int64_t *value) {
+    struct evaluations_s *evaluations = compilation_evaluations();
+    size_t budget = evaluations->steps < MAX_EVALUATION_STEPS ? evaluations->steps : MAX_EVALUATION_STEPS;
+    steps_remaining = budget;
+    reached_undefined = false;
+    bool evaluated = evaluate(node, NULL, value);
+    evaluations->steps -= budget - steps_remaining;
+    return evaluated;
+}
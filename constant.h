@@ -0,0 +1,18 @@
+#ifndef CONSTANT_H
+#define CONSTANT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ast_node.h"
+#include "context.h"
+
+bool evaluate_operator(void (*generate_assembly)(ast_node*), int64_t left, int64_t right, int64_t *value);
+
+bool arithmetic_operation(ast_node *node);
+
+bool evaluate_constant(ast_node *node, int64_t *value);
+
+void free_evaluations(compilation *unit);
+
+#endif //CONSTANT_H
@@ -0,0 +1,85 @@
+#include "context.h"
+
+#include <stdlib.h>
+
+#include "constant.h"
+#include "diagnostics.h"
+#include "pattern.h"
+#include "span.h"
+
+static __thread compilation *bound;
+
+compiler_shared *compiler_shared_new() {
+    compiler_shared *shared = malloc(sizeof(compiler_shared));
+    compile_patterns(shared);
+    return shared;
+}
+
+void compiler_shared_free(compiler_shared *shared) {
+    free_patterns(shared);
+    free(shared);
+}
+
+/**
+ * Creates the state of a compilation
+ * @param shared State shared with every other compilation
+ * @return compilation*: the compilation
+ */
+compilation *compilation_new(compiler_shared *shared) {
+    compilation *unit = malloc(sizeof(compilation));
+    unit->shared = shared;
+    unit->strings = interner_new();
+    unit->source_files = NULL;
+    unit->diagnostics = NULL;
+    unit->diagnostic_output = stderr;
+    unit->error_count = 0;
+    unit->recovery = NULL;
+    unit->failure = NULL;
+    unit->partials = NULL;
+    unit->partial_count = 0;
+    unit->partial_capacity = 0;
+    unit->lexers = NULL;
+    unit->threaded_lexing = true;
+    unit->root = NULL;
+    unit->interfaces = NULL;
+    unit->lazy_bodies = NULL;
+    unit->loop_count = 0;
+    unit->parallel_body_count = 0;
+    unit->temp_count = 0;
+    unit->evaluations = NULL;
+    return unit;
+}
+
+/**
+ * Frees a compilation and every string it interned, its diagnostics should be flushed first and its AST freed by
+ * the caller. The thread it was bound to is unbound
+ * @param unit Compilation
+ */
+void compilation_free(compilation *unit) {
+    discard_diagnostics(unit);
+    free_spans(unit);
+    free_evaluations(unit);
+    free(unit->partials);
+    if (unit->lexers != NULL) {
+        vec_free(unit->lexers);
+    }
+    if (bound == unit) {
+        bound = NULL;
+    }
+    interner_free(unit->strings);
+    free(unit);
+}
+
+/**
+ * Binds a compilation to the calling thread. Errors reported and spans resolved on the thread belong to it, so the
+ * front end and code generator reach it without threading it through every node callback. A thread is bound to one
+ * compilation at a time, binding another replaces it
+ * @param unit Compilation, NULL to unbind
+ */
+void bind_compilation(compilation *unit) {
+    bound = unit;
+}
+
+compilation *bound_compilation() {
+    return bound;
+}
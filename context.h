@@ -0,0 +1,68 @@
+#ifndef CONTEXT_H
+#define CONTEXT_H
+
+#include <regex.h>
+#include <setjmp.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "interner.h"
+#include "vec.h"
+
+/**
+ * State every compilation in the process reads and none writes, built once before the first compilation starts
+ */
+typedef struct compiler_shared_s {
+    regex_t token_regex;
+    regex_t symbol_regex;
+} compiler_shared;
+
+/**
+ * Something a recoverable action built but has not attached to the AST yet, released if the action is abandoned
+ */
+typedef struct partial_s {
+    void *object;
+    void (*release)(void*);
+} partial;
+
+/**
+ * State of a single compilation, no two compilations share any of it so compilations on different threads run
+ * independently. A compilation is bound to the thread running it, its strings are interned into its own interner
+ * and released with it
+ */
+typedef struct compilation_s {
+    compiler_shared *shared;
+    interner *strings;
+    vec source_files;
+    vec diagnostics;
+    FILE *diagnostic_output;
+    size_t error_count;
+    jmp_buf *recovery;
+    jmp_buf *failure;
+    partial *partials;
+    size_t partial_count;
+    size_t partial_capacity;
+    vec lexers;
+    bool threaded_lexing;
+    struct ast_node_s *root;
+    struct shared_cache_s *interfaces;
+    struct lazy_bodies_s *lazy_bodies;
+    size_t loop_count;
+    size_t parallel_body_count;
+    size_t temp_count;
+    struct evaluations_s *evaluations;
+} compilation;
+
+compiler_shared *compiler_shared_new();
+
+void compiler_shared_free(compiler_shared *shared);
+
+compilation *compilation_new(compiler_shared *shared);
+
+void compilation_free(compilation *unit);
+
+void bind_compilation(compilation *unit);
+
+compilation *bound_compilation();
+
+#endif //CONTEXT_H
@@ -0,0 +1,168 @@
+#include "dag.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "assembly_generator.h"
+#include "constant.h"
+#include "context.h"
+#include "interner.h"
+
+#define INITIAL_CAPACITY 64
+#define MAX_LOAD_SHIFT 1
+#define MAX_I64_LITERAL_LEN 21
+#define HASH_MULTIPLIER 0x9e3779b97f4a7c15
+
+/**
+ * Hash-consing table of a function's pure expressions, each literal and arithmetic operation is built once and
+ * shared by every expression using it. Operands are shared before the operations using them, so two operations
+ * are identical exactly when their operator and operand nodes are
+ */
+struct dag_s {
+    size_t capacity;
+    size_t count;
+    ast_node **slots;
+};
+
+dag *dag_new() {
+    dag *nodes = malloc(sizeof(dag));
+    nodes->capacity = INITIAL_CAPACITY;
+    nodes->count = 0;
+    nodes->slots = calloc(INITIAL_CAPACITY, sizeof(ast_node*));
+    return nodes;
+}
+
+/**
+ * Hashes the key of a node, a literal is keyed by its type and interned text and an operation by its operands
+ * @param kind Assembly generator of the node
+ * @param first Type of a literal, left operand of an operation
+ * @param second Text of a literal, right operand of an operation
+ * @return uint64_t: hash of the key
+ */
+static uint64_t hash_key(void *kind, void *first, void *second) {
+    uint64_t hash = (uintptr_t) kind;
+    hash = (hash ^ (uintptr_t) first) * HASH_MULTIPLIER;
+    hash = (hash ^ (uintptr_t) second) * HASH_MULTIPLIER;
+    return hash ^ (hash >> 29);
+}
+
+static uint64_t hash_node(ast_node *node) {
+    if (node->generate_assembly == &literal_assembly)
+        return hash_key(node->generate_assembly, node->expr_type, node->node);
+
+    binary_operation_node *op_node = node->node;
+    return hash_key(node->generate_assembly, op_node->left, op_node->right);
+}
+
+static bool same_node(ast_node *node, void *kind, void *first, void *second) {
+    if (node->generate_assembly != kind)
+        return false;
+    if (kind == &literal_assembly)
+        return node->expr_type == first && node->node == second;
+
+    binary_operation_node *op_node = node->node;
+    return op_node->left == first && op_node->right == second;
+}
+
+static ast_node **find_slot(dag *nodes, void *kind, void *first, void *second) {
+    size_t mask = nodes->capacity - 1;
+    for (size_t i = hash_key(kind, first, second) & mask;; i = (i + 1) & mask) {
+        ast_node *node = nodes->slots[i];
+        if (node == NULL || same_node(node, kind, first, second))
+            return nodes->slots + i;
+    }
+}
+
+static void grow(dag *nodes) {
+    size_t capacity = nodes->capacity;
+    ast_node **slots = nodes->slots;
+    nodes->capacity = capacity << 1;
+    nodes->slots = calloc(nodes->capacity, sizeof(ast_node*));
+
+    size_t mask = nodes->capacity - 1;
+    for (size_t i = 0; i < capacity; i++) {
+        if (slots[i] == NULL)
+            continue;
+
+        size_t j = hash_node(slots[i]) & mask;
+        while (nodes->slots[j] != NULL) {
+            j = (j + 1) & mask;
+        }
+        nodes->slots[j] = slots[i];
+    }
+    free(slots);
+}
+
+static ast_node *insert(dag *nodes, ast_node **slot, ast_node *node) {
+    share_node(node);
+    *slot = node;
+    if (++nodes->count << MAX_LOAD_SHIFT > nodes->capacity) {
+        grow(nodes);
+    }
+    return node;
+}
+
+/**
+ * Gets the node for a literal
+ * @param nodes DAG of the function, NULL to build a node of its own
+ * @param literal_type Data type of the literal
+ * @param value Interned literal token
+ * @return ast_node*: node for the literal
+ */
+ast_node *dag_literal(dag *nodes, type *literal_type, char *value) {
+    if (nodes == NULL)
+        return literal_node_new(literal_type, value);
+
+    ast_node **slot = find_slot(nodes, &literal_assembly, literal_type, value);
+    return *slot != NULL ? *slot : insert(nodes, slot, literal_node_new(literal_type, value));
+}
+
+/**
+ * Gets the node for an arithmetic operation. Operations on shared operands are shared too, and are folded into a
+ * literal when both operands are constant, since a shared node is never rewritten in place by the optimizer
+ * @param nodes DAG of the function, NULL to build a node of its own
+ * @param operation_type Data type of the result
+ * @param left Left operand
+ * @param right Right operand
+ * @param generate_assembly Assembly of the operator
+ * @return ast_node*: node for the operation
+ */
+ast_node *dag_binary_operation(dag *nodes, type *operation_type, ast_node *left, ast_node *right,
+    void (*generate_assembly)(ast_node*)) {
+
+    if (nodes == NULL || !shared_node(left) || !shared_node(right))
+        return binary_operation_new(operation_type, left, right, generate_assembly);
+
+    int64_t left_value, right_value, value;
+    if (left->generate_assembly == &literal_assembly && right->generate_assembly == &literal_assembly
+        && evaluate_constant(left, &left_value) && evaluate_constant(right, &right_value)
+        && evaluate_operator(generate_assembly, left_value, right_value, &value)) {
+        char literal[MAX_I64_LITERAL_LEN];
+        size_t len = snprintf(literal, MAX_I64_LITERAL_LEN, "%ld", value);
+        return dag_literal(nodes, operation_type, intern_str(bound_compilation()->strings, literal, len));
+    }
+
+    ast_node **slot = find_slot(nodes, generate_assembly, left, right);
+    if (*slot != NULL)
+        return *slot;
+    return insert(nodes, slot, binary_operation_new(operation_type, left, right, generate_assembly));
+}
+
+void dag_free(dag *nodes) {
+    if (nodes == NULL)
+        return;
+
+    for (size_t i = 0; i < nodes->capacity; i++) {
+        ast_node *node = nodes->slots[i];
+        if (node == NULL)
+            continue;
+
+        if (node->generate_assembly != &literal_assembly) {
+            free(node->node);
+        }
+        free(node);
+    }
+    free(nodes->slots);
+    free(nodes);
+}
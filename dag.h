@@ -0,0 +1,17 @@
+#ifndef DAG_H
+#define DAG_H
+
+#include "ast_node.h"
+
+typedef struct dag_s dag;
+
+dag *dag_new();
+
+ast_node *dag_literal(dag *nodes, type *literal_type, char *value);
+
+ast_node *dag_binary_operation(dag *nodes, type *operation_type, ast_node *left, ast_node *right,
+    void (*generate_assembly)(ast_node*));
+
+void dag_free(dag *nodes);
+
+#endif //DAG_H
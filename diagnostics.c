@@ -0,0 +1,246 @@
+#include "diagnostics.h"
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "context.h"
+#include "vec.h"
+
+#define MAX_ERRORS 100
+#define INITIAL_PARTIAL_CAPACITY 16
+#define DIAGNOSTIC_MESSAGE "%s: %s:%lu:%lu: %s\n"
+#define SNIPPET_INDENT "    "
+
+typedef struct diagnostic_s {
+    severity level;
+    span position;
+    size_t order;
+    char *message;
+} diagnostic;
+
+static char *severity_names[] = {"WARNING", "ERROR"};
+
+static bool duplicate_diagnostic(vec diagnostics, diagnostic *new_diagnostic) {
+    vec_iter(diagnostic *curr, diagnostics, {
+        if (curr->position.file == new_diagnostic->position.file
+            && curr->position.offset == new_diagnostic->position.offset && curr->level == new_diagnostic->level
+            && strcmp(curr->message, new_diagnostic->message) == 0)
+            return true;
+    })
+
+    return false;
+}
+
+/**
+ * Adds a diagnostic to the buffer of the bound compilation, a diagnostic already reported at the same place is
+ * dropped since top level lines are read by more than one pass. Too many errors end the compile
+ * @param level Severity of the diagnostic
+ * @param position Where in the source the diagnostic points
+ * @param message Format of the message
+ * @param args Format arguments
+ */
+void add_diagnostic(severity level, span position, char *message, va_list args) {
+    compilation *unit = bound_compilation();
+    if (unit->diagnostics == NULL) {
+        unit->diagnostics = vec_new();
+    }
+
+    diagnostic *new_diagnostic = malloc(sizeof(diagnostic));
+    new_diagnostic->level = level;
+    new_diagnostic->position = position;
+    new_diagnostic->order = vec_len(unit->diagnostics);
+    size_t message_len;
+    FILE *out = open_memstream(&new_diagnostic->message, &message_len);
+    vfprintf(out, message, args);
+    fclose(out);
+
+    if (duplicate_diagnostic(unit->diagnostics, new_diagnostic)) {
+        free(new_diagnostic->message);
+        free(new_diagnostic);
+        return;
+    }
+
+    vec_push(unit->diagnostics, new_diagnostic);
+    if (level == SEVERITY_ERROR && ++unit->error_count == MAX_ERRORS) {
+        flush_diagnostics();
+        fprintf(unit->diagnostic_output, "fatal error: too many errors\n");
+        abandon_compilation();
+    }
+}
+
+bool has_errors() {
+    return bound_compilation()->error_count > 0;
+}
+
+/**
+ * Holds something being built until it is attached to the AST, an error abandoning the action building it
+ * releases it instead of leaking it
+ * @param object Object being built
+ * @param release Frees the object along with whatever it owns
+ */
+void hold_partial(void *object, void (*release)(void*)) {
+    compilation *unit = bound_compilation();
+    if (unit->partial_count == unit->partial_capacity) {
+        unit->partial_capacity = unit->partial_capacity == 0 ? INITIAL_PARTIAL_CAPACITY : unit->partial_capacity << 1;
+        unit->partials = realloc(unit->partials, unit->partial_capacity * sizeof(partial));
+    }
+    unit->partials[unit->partial_count++] = (partial) {object, release};
+}
+
+/**
+ * Stops holding an object once something else owns it, objects are usually unheld in the reverse of the order
+ * they were held in
+ * @param object Object held by hold_partial
+ */
+void unhold_partial(void *object) {
+    compilation *unit = bound_compilation();
+    for (size_t i = unit->partial_count; i > 0; i--) {
+        if (unit->partials[i - 1].object == object) {
+            memmove(unit->partials + i - 1, unit->partials + i, (unit->partial_count - i) * sizeof(partial));
+            unit->partial_count--;
+            return;
+        }
+    }
+}
+
+/**
+ * Releases the objects held since a point, newest first
+ * @param unit Compilation
+ * @param count Number of objects held at the point
+ */
+static void release_partials(compilation *unit, size_t count) {
+    while (unit->partial_count > count) {
+        partial *held = unit->partials + --unit->partial_count;
+        held->release(held->object);
+    }
+}
+
+/**
+ * Runs an action that may raise an error, an error abandons the rest of the action instead of the compile and
+ * releases what the action held
+ * @param action Action to run
+ * @param context Argument to the action
+ * @return bool: whether the action ran to completion
+ */
+bool run_recoverable(void (*action)(void*), void *context) {
+    compilation *unit = bound_compilation();
+    jmp_buf *outer = unit->recovery;
+    size_t held = unit->partial_count;
+    jmp_buf point;
+    unit->recovery = &point;
+
+    bool completed = setjmp(point) == 0;
+    if (completed) {
+        action(context);
+    } else {
+        release_partials(unit, held);
+    }
+
+    unit->recovery = outer;
+    unit->partial_count = held;
+    return completed;
+}
+
+/**
+ * Abandons the innermost recoverable action after an error was reported, outside of one the compile ends with
+ * every diagnostic collected so far
+ */
+void abandon_recoverable() {
+    compilation *unit = bound_compilation();
+    if (unit->recovery != NULL)
+        longjmp(*unit->recovery, 1);
+
+    abandon_compilation();
+}
+
+/**
+ * Ends the bound compilation with every diagnostic collected so far. A compilation with a failure point returns
+ * to it, any other ends the process
+ */
+void abandon_compilation() {
+    compilation *unit = bound_compilation();
+    release_partials(unit, 0);
+    flush_diagnostics();
+    if (unit->failure != NULL) {
+        unit->recovery = NULL;
+        longjmp(*unit->failure, 1);
+    }
+    exit(1);
+}
+
+static int compare_diagnostics(const void *a, const void *b) {
+    const diagnostic *first = *(diagnostic**) a;
+    const diagnostic *second = *(diagnostic**) b;
+    int file_order = strcmp(source_file_path(first->position.file), source_file_path(second->position.file));
+    if (file_order != 0)
+        return file_order;
+    if (first->position.offset != second->position.offset)
+        return first->position.offset < second->position.offset ? -1 : 1;
+    return first->order < second->order ? -1 : first->order > second->order;
+}
+
+/**
+ * Prints the source line a diagnostic points at with a caret under its column, the indentation of the line is
+ * kept so the caret lines up with tabs
+ * @param out Where diagnostics are printed
+ * @param position Where the diagnostic points
+ * @param column Column of the position
+ */
+static void print_snippet(FILE *out, span position, size_t column) {
+    char *snippet = span_snippet(position);
+    if (snippet == NULL)
+        return;
+
+    fprintf(out, SNIPPET_INDENT "%s\n" SNIPPET_INDENT, snippet);
+    for (size_t i = 0; i + 1 < column && snippet[i] != '\0'; i++) {
+        fputc(snippet[i] == '\t' ? '\t' : ' ', out);
+    }
+    fputs("^\n", out);
+    free(snippet);
+}
+
+/**
+ * Prints every diagnostic the bound compilation collected so far in source order and empties the buffer. Line,
+ * column and the source line are only worked out here, from the span of each diagnostic
+ */
+void flush_diagnostics() {
+    vec diagnostics = bound_compilation()->diagnostics;
+    FILE *out = bound_compilation()->diagnostic_output;
+    if (diagnostics == NULL)
+        return;
+
+    size_t count = vec_len(diagnostics);
+    diagnostic **sorted = malloc(count * sizeof(diagnostic*));
+    vec_iter(diagnostic *curr, diagnostics, sorted[i] = curr)
+    qsort(sorted, count, sizeof(diagnostic*), &compare_diagnostics);
+
+    for (size_t i = 0; i < count; i++) {
+        span position = sorted[i]->position;
+        size_t line_num, column;
+        span_location(position, &line_num, &column);
+        fprintf(out, DIAGNOSTIC_MESSAGE, severity_names[sorted[i]->level], source_file_path(position.file),
+            line_num, column, sorted[i]->message);
+        print_snippet(out, position, column);
+        free(sorted[i]->message);
+        free(sorted[i]);
+    }
+
+    free(sorted);
+    vec_free(diagnostics);
+    bound_compilation()->diagnostics = NULL;
+}
+
+/**
+ * Drops the diagnostics of a compilation without printing them
+ * @param unit Compilation
+ */
+void discard_diagnostics(compilation *unit) {
+    if (unit->diagnostics == NULL)
+        return;
+
+    vec_iter(diagnostic *curr, unit->diagnostics, free(curr->message))
+    free_vec_and_elements(unit->diagnostics);
+    unit->diagnostics = NULL;
+}
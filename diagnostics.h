@@ -0,0 +1,33 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <stdarg.h>
+#include <stdbool.h>
+
+#include "context.h"
+#include "span.h"
+
+typedef enum severity_e {
+    SEVERITY_WARNING,
+    SEVERITY_ERROR,
+} severity;
+
+void add_diagnostic(severity level, span position, char *message, va_list args);
+
+bool has_errors();
+
+void hold_partial(void *object, void (*release)(void*));
+
+void unhold_partial(void *object);
+
+bool run_recoverable(void (*action)(void*), void *context);
+
+void abandon_recoverable();
+
+void abandon_compilation();
+
+void flush_diagnostics();
+
+void discard_diagnostics(compilation *unit);
+
+#endif //DIAGNOSTICS_H
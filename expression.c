@@ -2,13 +2,17 @@
 #include <string.h>
 
 #include "assembly_generator.h"
+#include "ast.h"
+#include "dag.h"
+#include "diagnostics.h"
 #include "expression.h"
 #include "types.h"
 #include "pattern.h"
 #include "util.h"
 
-#define COMMON_PRECEDENCE_GROUPS 3
+#define COMMON_PRECEDENCE_GROUPS 6
 #define MAX_OPERATORS_PER_GROUP 3
+#define OPERAND_TYPE "i64"
 
 #define ASSIGNMENT "="
 #define ADD "+"
@@ -16,9 +20,13 @@
 #define MUL "*"
 #define DIV "/"
 #define MOD "%"
+#define OR "|"
+#define XOR "^"
+#define AND "&"
 
 #define PAREN_OPEN "("
 #define PAREN_CLOSE ")"
+#define ARG_SEP ","
 
 typedef struct expression_parser_s {
     vec tokenv;
@@ -44,6 +52,9 @@ static ast_node *div_parser(expression_parser *parser);
 static ast_node *mod_parser(expression_parser *parser);
 static ast_node *add_parser(expression_parser *parser);
 static ast_node *sub_parser(expression_parser *parser);
+static ast_node *or_parser(expression_parser *parser);
+static ast_node *xor_parser(expression_parser *parser);
+static ast_node *and_parser(expression_parser *parser);
 static ast_node *parse_sub_expression(expression_parser *parser);
 
 operator operators[COMMON_PRECEDENCE_GROUPS][MAX_OPERATORS_PER_GROUP + 1] = {
@@ -51,6 +62,18 @@ operator operators[COMMON_PRECEDENCE_GROUPS][MAX_OPERATORS_PER_GROUP + 1] = {
         {.operator_token = "=", .parse_func = &assignment_parser},
         {}
     },
+    {
+        {.operator_token = "|", .parse_func = &or_parser},
+        {}
+    },
+    {
+        {.operator_token = "^", .parse_func = &xor_parser},
+        {}
+    },
+    {
+        {.operator_token = "&", .parse_func = &and_parser},
+        {}
+    },
     {
         {"+", &add_parser},
         {"-", &sub_parser},
@@ -64,16 +87,29 @@ operator operators[COMMON_PRECEDENCE_GROUPS][MAX_OPERATORS_PER_GROUP + 1] = {
     },
 };
 
+/**
+ * Parses the operands of an arithmetic operator, both must be i64 which is also the type of the result
+ * @param parser Expression parser, its token is the operator
+ * @param assembly_generator Assembly of the operator
+ * @return ast_node*: node for the operation
+ */
 static ast_node *binary_operation_parser(expression_parser *parser, void (*assembly_generator)(ast_node*)) {
     expression_parser left_parser = *parser;
     left_parser.end = parser->token_index;
     ast_node *left = parse_sub_expression(&left_parser);
+    hold_node(left);
 
     expression_parser right_parser = *parser;
     right_parser.start = parser->token_index + 1;
     ast_node *right = parse_sub_expression(&right_parser);
-
-    return binary_operation_new(right->expr_type, left, right, assembly_generator);
+    hold_node(right);
+
+    type *operand_type = get_type(OPERAND_TYPE);
+    assert_type(left, operand_type, token_span(parser->line, parser->start));
+    assert_type(right, operand_type, token_span(parser->line, parser->token_index + 1));
+    unhold_partial(right);
+    unhold_partial(left);
+    return dag_binary_operation(parser->ns->dag, operand_type, left, right, assembly_generator);
 }
 
 static ast_node *mul_parser(expression_parser *parser) {
@@ -96,18 +132,36 @@ static ast_node *sub_parser(expression_parser *parser) {
     return binary_operation_parser(parser, &sub_assembly);
 }
 
+static ast_node *or_parser(expression_parser *parser) {
+    return binary_operation_parser(parser, &or_assembly);
+}
+
+static ast_node *xor_parser(expression_parser *parser) {
+    return binary_operation_parser(parser, &xor_assembly);
+}
+
+static ast_node *and_parser(expression_parser *parser) {
+    return binary_operation_parser(parser, &and_assembly);
+}
+
 static ast_node *assignment_parser(expression_parser *parser) {
-    puts("Assignment");
     if (parser->token_index - parser->expr_start != 1) {
-        raise_compiler_error("Invalid Assignment", parser->line);
+        raise_compiler_error_at("Invalid Assignment", token_span(parser->line, parser->token_index));
     }
-    ast_node *var_node = var_lookup(parser->ns, vec_get(parser->tokenv, parser->token_index - 1));
+    size_t name_index = parser->token_index - 1;
+    char *name = vec_get(parser->tokenv, name_index);
+    ast_node *var_node = var_lookup(parser->ns, name);
+    if (var_node == NULL)
+        raise_compiler_error_at("Undefined variable `%s`", token_span(parser->line, name_index), name);
 
     expression_parser val_parser = *parser;
     val_parser.start = parser->token_index + 1;
     ast_node *value = parse_sub_expression(&val_parser);
+    hold_node(value);
+    assert_type(value, var_node->expr_type, token_span(parser->line, val_parser.start));
+    unhold_partial(value);
 
-    return binary_operation_new(value->expr_type, var_node, value, &assignment_assembly);
+    return binary_operation_new(var_node->expr_type, var_node, value, &assignment_assembly);
 }
 
 static ast_node *compile_operator(expression_parser *parser) {
@@ -121,7 +175,6 @@ static ast_node *compile_operator(expression_parser *parser) {
 }
 
 static ast_node *parse_parenthetical_expression(expression_parser *parser) {
-    printf("Parsing parens %lu %lu", parser->start, parser->end);
     parser->start++;
     parser->end--;
     parser->op_group_index = 0;
@@ -132,39 +185,93 @@ static ast_node *parse_value(expression_parser *parser) {
     char *token = vec_get(parser->tokenv, parser->start);
     type *literal_type = get_literal_type(token);
     if (literal_type != NULL) {
-        // printf("Literal Type %s\n", literal_type->name);
-        return literal_node_new(literal_type, token);
+        return dag_literal(parser->ns->dag, literal_type, token);
     }
 
     ast_node *var = var_lookup(parser->ns, token);
     if (var != NULL) {
-        return var_node_new(var->expr_type, token);
+        return var;
     }
 
-    raise_compiler_error("Invalid Value", parser->line);
+    raise_compiler_error_at("Invalid Value", token_span(parser->line, parser->start));
     return NULL;
 }
 
-static ast_node *parse_sub_expression(expression_parser *parser) {
+/**
+ * Gets the index of the parenthesis opening the group closed at an index
+ * @param parser Expression parser
+ * @param close_index Index of a closing parenthesis
+ * @return size_t: index of the matching opening parenthesis
+ */
+static size_t matching_paren(expression_parser *parser, size_t close_index) {
+    return parser->paren_matches[close_index - parser->expr_start];
+}
 
-    printf("Expr: ");
-    for (size_t i = parser->start; i < parser->end; i++) {
-        printf("%s ", (char*) vec_get(parser->tokenv, i));
+/**
+ * Parses a call to a function, arguments are separated by commas outside of nested parentheses
+ * @param parser Expression parser spanning the call
+ * @return ast_node*: node for the call
+ */
+static ast_node *parse_call(expression_parser *parser) {
+    char *name = vec_get(parser->tokenv, parser->start);
+    ast_node *function = function_lookup(parser->ns, name);
+    if (function == NULL)
+        raise_compiler_error_at("Undefined function `%s`", token_span(parser->line, parser->start), name);
+    function_node *func_node = function->node;
+    use_function(function, parser->ns);
+
+    vec args = vec_new();
+    hold_nodes(args);
+    size_t args_end = parser->end - 1;
+    size_t arg_start = parser->start + 2;
+    size_t depth = 0;
+
+    for (size_t i = arg_start; i < args_end; i++) {
+        char *token = vec_get(parser->tokenv, i);
+        depth += strcmp(token, PAREN_OPEN) == 0;
+        depth -= strcmp(token, PAREN_CLOSE) == 0;
+
+        if (depth == 0 && (strcmp(token, ARG_SEP) == 0 || i + 1 == args_end)) {
+            expression_parser arg_parser = *parser;
+            arg_parser.start = arg_start;
+            arg_parser.end = i + (strcmp(token, ARG_SEP) != 0);
+            arg_parser.op_group_index = 0;
+            if (arg_parser.start == arg_parser.end)
+                raise_compiler_error_at("Missing argument", token_span(parser->line, i));
+
+            ast_node *arg = parse_sub_expression(&arg_parser);
+            vec_push(args, arg);
+            if (vec_len(args) <= func_node->param_count) {
+                ast_node *param = vec_get(func_node->func_namespace.vars, vec_len(args) - 1);
+                assert_type(arg, param->expr_type, token_span(parser->line, arg_start));
+            }
+            arg_start = i + 1;
+        }
     }
-    puts("");
 
+    if (vec_len(args) != func_node->param_count)
+        raise_compiler_error_at("`%s` takes %lu arguments but %lu were given", token_span(parser->line, parser->start),
+            name, func_node->param_count, vec_len(args));
+
+    unhold_partial(args);
+    return call_node_new(function, args);
+}
+
+static ast_node *parse_sub_expression(expression_parser *parser) {
     if (parser->start + 1 == parser->end) {
         return parse_value(parser);
     }
 
     vec tokenv = parser->tokenv;
-    puts(vec_get(tokenv, parser->start));
-    puts(vec_get(tokenv, parser->end));
-    printf("Group: %lu\n", parser->op_group_index);
-
-    if (strcmp(vec_get(tokenv, parser->start), PAREN_OPEN) == 0
-        && strcmp(vec_get(tokenv, parser->end - 1), PAREN_CLOSE) == 0) {
-        return parse_parenthetical_expression(parser);
+    if (strcmp(vec_get(tokenv, parser->end - 1), PAREN_CLOSE) == 0) {
+        size_t open_index = matching_paren(parser, parser->end - 1);
+        if (open_index == parser->start) {
+            return parse_parenthetical_expression(parser);
+        }
+        if (open_index == parser->start + 1
+            && valid_symbol(bound_compilation()->shared, vec_get(tokenv, parser->start))) {
+            return parse_call(parser);
+        }
     }
 
     for (; parser->op_group_index < COMMON_PRECEDENCE_GROUPS; parser->op_group_index++) {
@@ -172,13 +279,9 @@ static ast_node *parse_sub_expression(expression_parser *parser) {
         parser->token_index = parser->end - 1;
         while (parser->token_index >= parser->start) {
             parser->token = vec_get(tokenv, parser->token_index);
-            printf("Token: %s\n", parser->token);
 
             if (strcmp(parser->token, PAREN_CLOSE) == 0) {
-                for (size_t i = 0; i < parser->end - parser->start; i++) {
-                    printf("%lu, ", parser->paren_matches[i]);
-                }
-                parser->token_index = parser->paren_matches[parser->token_index - parser->expr_start];
+                parser->token_index = matching_paren(parser, parser->token_index);
             }
             else {
                 ast_node *operator_node = compile_operator(parser);
@@ -186,12 +289,11 @@ static ast_node *parse_sub_expression(expression_parser *parser) {
                     return operator_node;
                 }
             }
-            printf("Index: %lu\n", parser->token_index);
             parser->token_index--;
         }
     }
 
-    // figure out compiler error
+    raise_compiler_error_at("Invalid expression", token_span(parser->line, parser->start));
     return NULL;
 }
 
@@ -209,16 +311,19 @@ static void match_parens(expression_parser *parser) {
             vec_push_val(open_parens, i);
         } else if (strcmp(token, PAREN_CLOSE) == 0) {
             if (vec_len(open_parens) == 0) {
-                raise_compiler_error("Mismatched Parentheses", parser->line);;
+                vec_free(open_parens);
+                raise_compiler_error_at("Mismatched Parentheses", token_span(parser->line, i));
             }
             parser->paren_matches[i - parser->start] = vec_pop_val(open_parens, size_t);
         }
     }
 
-    // printf("Len: %lu\n", vec_len(open_parens));
     if (vec_len(open_parens) != 0) {
-        raise_compiler_error("Mismatched Parentheses", parser->line);
+        size_t unmatched = vec_pop_val(open_parens, size_t);
+        vec_free(open_parens);
+        raise_compiler_error_at("Mismatched Parentheses", token_span(parser->line, unmatched));
     }
+    vec_free(open_parens);
 }
 
 ast_node *parse_expression(vec tokenv, line *curr_line, size_t start, size_t end, namespace *ns) {
@@ -237,3 +342,21 @@ ast_node *parse_expression(vec tokenv, line *curr_line, size_t start, size_t end
 
     return parse_sub_expression(&parser);
 }
+
+/**
+ * Parses an expression whose type is fixed by its context
+ * @param tokenv Tokens
+ * @param curr_line Current Line
+ * @param start Index of the expression's first token
+ * @param end Index after the expression's last token
+ * @param ns Namespace the expression is in
+ * @param expected Type the expression must have
+ * @return ast_node*: node for the expression
+ */
+ast_node *parse_typed_expression(vec tokenv, line *curr_line, size_t start, size_t end, namespace *ns, type *expected) {
+    ast_node *node = parse_expression(tokenv, curr_line, start, end, ns);
+    hold_node(node);
+    assert_type(node, expected, token_span(curr_line, start));
+    unhold_partial(node);
+    return node;
+}
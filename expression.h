@@ -5,4 +5,6 @@
 
 ast_node *parse_expression(vec tokenv, line *curr_line, size_t start, size_t end, namespace *ns);
 
+ast_node *parse_typed_expression(vec tokenv, line *curr_line, size_t start, size_t end, namespace *ns, type *expected);
+
 #endif //EXPRESSION_H
@@ -0,0 +1,280 @@
+#include "interner.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SHARD_BITS 6
+#define SHARDS (1 << SHARD_BITS)
+#define INITIAL_SHARD_CAPACITY 16
+#define MAX_SEGMENTS 40
+#define FIRST_SEGMENT_BITS 4
+#define FIRST_STRING_CHUNK_SIZE (1 << 10)
+#define MAX_STRING_CHUNK_SIZE (64 << 10)
+#define STRING_ALIGNMENT 8
+
+#define FNV_OFFSET 0xcbf29ce484222325
+#define FNV_PRIME 0x100000001b3
+
+typedef struct interned_s {
+    uint64_t hash;
+    size_t id;
+    size_t len;
+    char str[];
+} interned;
+
+typedef struct intern_table_s {
+    size_t capacity;
+    struct intern_table_s *retired;
+    _Atomic(interned*) slots[];
+} intern_table;
+
+typedef struct string_chunk_s {
+    struct string_chunk_s *next;
+    size_t size;
+    size_t used;
+    _Alignas(STRING_ALIGNMENT) char bytes[];
+} string_chunk;
+
+/**
+ * Part of an interner, a string's hash picks its shard. Lookups only read the table with atomic loads, inserts
+ * take the shard's lock, and a grown table replaces the old one which stays readable until the interner is freed.
+ * Strings are allocated from the shard's own chunks while its lock is held
+ */
+typedef struct shard_s {
+    pthread_mutex_t lock;
+    _Atomic(intern_table*) table;
+    atomic_size_t count;
+    _Atomic(interned**) segments[MAX_SEGMENTS];
+    string_chunk *chunks;
+} shard;
+
+/**
+ * Strings of one compilation, its lexer and parser threads intern into it at once. Everything it interned is
+ * released together when the compilation is freed, so a long running process does not keep the strings of every
+ * compile it ran
+ */
+struct interner_s {
+    shard shards[SHARDS];
+};
+
+static uint64_t hash_string(const char *str, size_t len) {
+    uint64_t hash = FNV_OFFSET;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char) str[i]) * FNV_PRIME;
+    }
+    return hash ^ (hash >> 29);
+}
+
+static intern_table *intern_table_new(size_t capacity) {
+    intern_table *table = calloc(1, sizeof(intern_table) + capacity * sizeof(_Atomic(interned*)));
+    table->capacity = capacity;
+    return table;
+}
+
+/**
+ * Allocates an interned string from its shard's chunks, the caller holds the shard's lock. Chunks double in size up
+ * to a limit, so an interner holding a few strings stays small
+ * @param s Shard of the string
+ * @param len Length of the string
+ * @return interned*: uninitialized entry with room for the string and its terminator
+ */
+static interned *string_alloc(shard *s, size_t len) {
+    size_t size = (sizeof(interned) + len + 1 + STRING_ALIGNMENT - 1) & ~(size_t) (STRING_ALIGNMENT - 1);
+    string_chunk *chunk = s->chunks;
+
+    if (chunk == NULL || chunk->size - chunk->used < size) {
+        size_t chunk_size = chunk == NULL ? FIRST_STRING_CHUNK_SIZE : chunk->size << 1;
+        chunk_size = chunk_size > MAX_STRING_CHUNK_SIZE ? MAX_STRING_CHUNK_SIZE : chunk_size;
+        chunk_size = size > chunk_size ? size : chunk_size;
+        string_chunk *added = malloc(sizeof(string_chunk) + chunk_size);
+        added->size = chunk_size;
+        added->used = 0;
+        bool oversized = chunk != NULL && size > MAX_STRING_CHUNK_SIZE;
+        added->next = oversized ? chunk->next : chunk;
+        if (oversized) {
+            chunk->next = added;
+        } else {
+            s->chunks = added;
+        }
+        chunk = added;
+    }
+
+    interned *entry = (interned*) (chunk->bytes + chunk->used);
+    chunk->used += size;
+    return entry;
+}
+
+/**
+ * Gets the slot holding the entry with a local index, entries live in segments of doubling size that never move,
+ * so ids can be resolved without locking
+ * @param s Shard of the entry
+ * @param index Index of the entry within its shard
+ * @return interned**: the slot, NULL if its segment does not exist yet
+ */
+static interned **segment_slot(shard *s, size_t index) {
+    size_t biased = (index >> FIRST_SEGMENT_BITS) + 1;
+    size_t segment = 63 - __builtin_clzll(biased);
+    size_t offset = index - ((((size_t) 1 << segment) - 1) << FIRST_SEGMENT_BITS);
+
+    interned **entries = atomic_load_explicit(&s->segments[segment], memory_order_acquire);
+    return entries == NULL ? NULL : entries + offset;
+}
+
+static interned *probe(intern_table *table, uint64_t hash, const char *str, size_t len, size_t *slot) {
+    size_t mask = table->capacity - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        interned *entry = atomic_load_explicit(&table->slots[i], memory_order_acquire);
+        if (entry == NULL || (entry->hash == hash && entry->len == len && memcmp(entry->str, str, len) == 0)) {
+            *slot = i;
+            return entry;
+        }
+    }
+}
+
+static void grow(shard *s, intern_table *table) {
+    intern_table *grown = intern_table_new(table->capacity << 1);
+    for (size_t i = 0; i < table->capacity; i++) {
+        interned *entry = atomic_load_explicit(&table->slots[i], memory_order_relaxed);
+        if (entry == NULL)
+            continue;
+
+        size_t slot;
+        probe(grown, entry->hash, entry->str, entry->len, &slot);
+        atomic_store_explicit(&grown->slots[slot], entry, memory_order_relaxed);
+    }
+
+    grown->retired = table;
+    atomic_store_explicit(&s->table, grown, memory_order_release);
+}
+
+/**
+ * Inserts a string the lock free lookup missed, it is probed again under the shard's lock since another thread
+ * may have inserted it in the meantime
+ */
+static interned *insert(interner *strings, shard *s, uint64_t hash, const char *str, size_t len) {
+    pthread_mutex_lock(&s->lock);
+    intern_table *table = atomic_load_explicit(&s->table, memory_order_relaxed);
+    size_t slot;
+    interned *entry = probe(table, hash, str, len, &slot);
+    if (entry != NULL) {
+        pthread_mutex_unlock(&s->lock);
+        return entry;
+    }
+
+    size_t index = atomic_load_explicit(&s->count, memory_order_relaxed);
+    size_t segment = 63 - __builtin_clzll((index >> FIRST_SEGMENT_BITS) + 1);
+    if (atomic_load_explicit(&s->segments[segment], memory_order_relaxed) == NULL) {
+        interned **entries = calloc((size_t) 1 << (segment + FIRST_SEGMENT_BITS), sizeof(interned*));
+        atomic_store_explicit(&s->segments[segment], entries, memory_order_release);
+    }
+
+    entry = string_alloc(s, len);
+    entry->hash = hash;
+    entry->id = (index << SHARD_BITS) | (s - strings->shards);
+    entry->len = len;
+    memcpy(entry->str, str, len);
+    entry->str[len] = '\0';
+
+    *segment_slot(s, index) = entry;
+    atomic_store_explicit(&table->slots[slot], entry, memory_order_release);
+    atomic_store_explicit(&s->count, index + 1, memory_order_release);
+
+    if ((index + 1) << 1 > table->capacity) {
+        grow(s, table);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return entry;
+}
+
+static interned *lookup(interner *strings, const char *str, size_t len) {
+    uint64_t hash = hash_string(str, len);
+    shard *s = &strings->shards[hash >> (64 - SHARD_BITS)];
+
+    size_t slot;
+    interned *entry = probe(atomic_load_explicit(&s->table, memory_order_acquire), hash, str, len, &slot);
+    return entry != NULL ? entry : insert(strings, s, hash, str, len);
+}
+
+interner *interner_new() {
+    interner *strings = malloc(sizeof(interner));
+    for (size_t i = 0; i < SHARDS; i++) {
+        shard *s = &strings->shards[i];
+        pthread_mutex_init(&s->lock, NULL);
+        atomic_init(&s->table, intern_table_new(INITIAL_SHARD_CAPACITY));
+        atomic_init(&s->count, 0);
+        for (size_t j = 0; j < MAX_SEGMENTS; j++) {
+            atomic_init(&s->segments[j], NULL);
+        }
+        s->chunks = NULL;
+    }
+    return strings;
+}
+
+/**
+ * Frees an interner and every string it interned, no thread may use it anymore
+ * @param strings Interner
+ */
+void interner_free(interner *strings) {
+    for (size_t i = 0; i < SHARDS; i++) {
+        shard *s = &strings->shards[i];
+        intern_table *table = atomic_load(&s->table);
+        while (table != NULL) {
+            intern_table *retired = table->retired;
+            free(table);
+            table = retired;
+        }
+        for (size_t j = 0; j < MAX_SEGMENTS; j++) {
+            free(atomic_load(&s->segments[j]));
+        }
+        string_chunk *chunk = s->chunks;
+        while (chunk != NULL) {
+            string_chunk *next = chunk->next;
+            free(chunk);
+            chunk = next;
+        }
+        pthread_mutex_destroy(&s->lock);
+    }
+    free(strings);
+}
+
+/**
+ * Interns a string, equal strings get the same id from any thread and an id never changes once assigned
+ * @param strings Interner
+ * @param str Start of the string, it does not have to be terminated
+ * @param len Length of the string
+ * @return size_t: id of the string
+ */
+size_t intern(interner *strings, const char *str, size_t len) {
+    return lookup(strings, str, len)->id;
+}
+
+/**
+ * Interns a string, equal strings share one canonical copy that lives until the interner is freed
+ * @param strings Interner
+ * @param str Start of the string, it does not have to be terminated
+ * @param len Length of the string
+ * @return char*: the canonical copy
+ */
+char *intern_str(interner *strings, const char *str, size_t len) {
+    return lookup(strings, str, len)->str;
+}
+
+char *interned_str(interner *strings, size_t id) {
+    shard *s = &strings->shards[id & (SHARDS - 1)];
+    size_t index = id >> SHARD_BITS;
+    if (index >= atomic_load_explicit(&s->count, memory_order_acquire))
+        return NULL;
+    return (*segment_slot(s, index))->str;
+}
+
+size_t interned_count(interner *strings) {
+    size_t count = 0;
+    for (size_t i = 0; i < SHARDS; i++) {
+        count += atomic_load_explicit(&strings->shards[i].count, memory_order_relaxed);
+    }
+    return count;
+}
@@ -0,0 +1,20 @@
+#ifndef INTERNER_H
+#define INTERNER_H
+
+#include <stddef.h>
+
+typedef struct interner_s interner;
+
+interner *interner_new();
+
+void interner_free(interner *strings);
+
+size_t intern(interner *strings, const char *str, size_t len);
+
+char *intern_str(interner *strings, const char *str, size_t len);
+
+char *interned_str(interner *strings, size_t id);
+
+size_t interned_count(interner *strings);
+
+#endif //INTERNER_H
@@ -11,14 +11,33 @@
 #define TAB_WIDTH (1 << TAB_SHIFT)
 #define SUSPICIOUS_INDENT -1
 
-void init_line_iterator(line_iterator *iter, char *filename, vec tokenv) {
+/**
+ * Starts a line iterator over tokens, which can begin partway through a file
+ * @param iter Line iterator
+ * @param file Id of the source file
+ * @param tokenv Tokens starting with the newline token of a line
+ * @param token_offsets Byte offset of each token in the file, NULL if unknown
+ */
+void init_line_iterator(line_iterator *iter, uint32_t file, vec tokenv, vec token_offsets) {
     iter->curr_line.start = 0;
     iter->curr_line.end = 0;
-    iter->curr_line.line_num = 0;
-    iter->curr_line.filename = filename;
+    iter->curr_line.position = span_new(file, 0);
+    iter->curr_line.token_offsets = token_offsets;
     iter->tokenv = tokenv;
 }
 
+/**
+ * Gets the span of a token on the line being parsed, the token offsets are only kept while the line is parsed
+ * @param curr_line Current line
+ * @param index Index of the token
+ * @return span: span of the token, the line's span if the offsets are not known
+ */
+span token_span(line *curr_line, size_t index) {
+    if (curr_line->token_offsets == NULL || index >= vec_len(curr_line->token_offsets))
+        return curr_line->position;
+    return span_new(curr_line->position.file, (size_t) vec_get(curr_line->token_offsets, index));
+}
+
 int get_indent_level(char *indent_token) {
     int count = 0;
     for (char *curr = indent_token; *curr != '\0'; curr++) {
@@ -40,10 +59,10 @@ line *next_line(line_iterator *iter) {
     vec tokenv = iter->tokenv;
     line *curr_line = &iter->curr_line;
 
-    curr_line->line_num++;
+    curr_line->position = token_span(curr_line, curr_line->end);
     int indent = get_indent_level(vec_get(tokenv, curr_line->end));
     if (indent == SUSPICIOUS_INDENT) {
-        raise_compiler_error("Indent size not a multiple of %d\n", curr_line, TAB_WIDTH);
+        raise_compiler_error("Indent size not a multiple of %d", curr_line, TAB_WIDTH);
     }
 
     curr_line->indent = indent;
@@ -52,6 +71,9 @@ line *next_line(line_iterator *iter) {
     while (curr_line->end < vec_len(tokenv)) {
         char *token = vec_get(tokenv, curr_line->end);
         if (*token == '\n') {
+            if (curr_line->start < curr_line->end) {
+                curr_line->position = token_span(curr_line, curr_line->start);
+            }
             return curr_line;
         }
         curr_line->end++;
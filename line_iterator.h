@@ -1,14 +1,15 @@
 #ifndef LINE_ITERATOR_H
 #define LINE_ITERATOR_H
 
+#include "span.h"
 #include "vec.h"
 
 typedef struct line_s {
-    size_t line_num;
     size_t start;
     size_t end;
     size_t indent;
-    char *filename;
+    span position;
+    vec token_offsets;
 } line;
 
 typedef struct line_iterator_s {
@@ -16,8 +17,10 @@ typedef struct line_iterator_s {
     line curr_line;
 } line_iterator;
 
-void init_line_iterator(line_iterator *iter, char *filename, vec tokenv);
+void init_line_iterator(line_iterator *iter, uint32_t file, vec tokenv, vec token_offsets);
 
 line *next_line(line_iterator *iter);
 
+span token_span(line *curr_line, size_t index);
+
 #endif //LINE_ITERATOR_H
@@ -1,39 +1,93 @@
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
-#include "ast.h"
-#include "ast_node.h"
-#include "pattern.h"
-#include "tokenizer.h"
-#include "types.h"
-#include "vec.h"
+#include "compiler.h"
 
-#define MIN_ARG_COUNT 2
+#define JOBS_FLAG "-j"
+#define JOBS_FLAG_LEN 2
+#define STREAM_FLAG "-s"
+#define DAG_FLAG "-d"
+#define LAZY_FLAG "-l"
+#define OUTPUT_FLAG "-o"
+#define RUNTIME_LIBRARY "runtime/libruntime.a"
+#define SELF_PATH "/proc/self/exe"
+#define DECIMAL 10
 
-void allocate_resources() {
-    compile_regexps();
-    compile_native_types();
-}
+/**
+ * Finds the runtime library, it is built next to the compiler
+ * @return char*: path of the runtime library
+ */
+static char *runtime_path() {
+    char self[PATH_MAX];
+    ssize_t len = readlink(SELF_PATH, self, sizeof(self));
+    while (len > 0 && self[len - 1] != '/') {
+        len--;
+    }
+    len = len < 0 ? 0 : len;
 
-void deallocate_resources() {
-    free_regexps();
-    free_types();
+    char *path = malloc(len + sizeof(RUNTIME_LIBRARY));
+    memcpy(path, self, len);
+    memcpy(path + len, RUNTIME_LIBRARY, sizeof(RUNTIME_LIBRARY));
+    return path;
 }
 
 int main(int argc, char *argv[]) {
-    if (argc < MIN_ARG_COUNT) {
+    size_t jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    bool stream = false;
+    parse_options options = {false, false};
+    char *source = NULL;
+    char *output = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], STREAM_FLAG) == 0) {
+            stream = true;
+            continue;
+        }
+        if (strcmp(argv[i], DAG_FLAG) == 0) {
+            options.share_expressions = true;
+            continue;
+        }
+        if (strcmp(argv[i], LAZY_FLAG) == 0) {
+            options.lazy_bodies = true;
+            continue;
+        }
+        if (strcmp(argv[i], OUTPUT_FLAG) == 0) {
+            if (i + 1 == argc) {
+                fprintf(stderr, "%s: fatal error: missing output file\n", argv[0]);
+                return 1;
+            }
+            output = argv[++i];
+            continue;
+        }
+        if (strncmp(argv[i], JOBS_FLAG, JOBS_FLAG_LEN) != 0) {
+            source = argv[i];
+            continue;
+        }
+
+        char *count = argv[i][JOBS_FLAG_LEN] != '\0' ? argv[i] + JOBS_FLAG_LEN : i + 1 < argc ? argv[++i] : "";
+        char *end;
+        long parsed = strtol(count, &end, DECIMAL);
+        if (*count == '\0' || *end != '\0' || parsed < 1) {
+            fprintf(stderr, "%s: fatal error: invalid job count `%s`\n", argv[0], count);
+            return 1;
+        }
+        jobs = parsed;
+    }
+
+    if (source == NULL) {
         fprintf(stderr, "%s: fatal error: no input files\n", argv[0]);
         return 1;
     }
 
-    allocate_resources();
+    link_options linking = {output, output != NULL ? runtime_path() : NULL};
+    compiler *instance = compiler_new(NULL);
 
-    vec tokenv = tokenize_file(argv[1]);
-    generate_ast(argv[1], tokenv);
-    free_vec_and_elements(tokenv);
+    bool built = compile_program(instance, source, jobs, stream, options, output != NULL ? &linking : NULL);
 
-    deallocate_resources();
+    compiler_free(instance);
+    free(linking.runtime);
 
-    return 0;
+    return built ? 0 : 1;
 }
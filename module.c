@@ -0,0 +1,1145 @@
+#include "module.h"
+
+#include <errno.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "assembly_generator.h"
+#include "ast.h"
+#include "diagnostics.h"
+#include "interner.h"
+#include "optimizer.h"
+#include "pattern.h"
+#include "pool.h"
+#include "shared_cache.h"
+#include "tokenizer.h"
+#include "toolchain.h"
+#include "types.h"
+#include "util.h"
+
+#define SOURCE_EXTENSION ".ro"
+#define ASSEMBLY_EXTENSION ".asm"
+#define INTERFACE_EXTENSION ".roi"
+#define ASSEMBLY_STAMP_EXTENSION ".asm.ros"
+#define OBJECT_STAMP_EXTENSION ".o.ros"
+#define PARTIAL_EXTENSION ".asm.part"
+#define OBJECT_EXTENSION ".o"
+#define PARTIAL_OBJECT_EXTENSION ".o.part"
+#define LINKED_ASSEMBLY_PATH "%s/%zu.asm"
+#define MAX_INDEX_DIGITS 20
+#define PATH_SEP '/'
+#define WORD_SEPS " \t\r\n"
+
+#define IMPORT "import"
+#define IMPORT_LEN 2
+#define EXTERN_SYMBOL "$%s.%s"
+
+#define INTERFACE_MAGIC "ROI\1"
+#define INTERFACE_MAGIC_LEN 4
+#define MAX_INTERFACE_FIELD 0xff
+#define MAX_INTERFACE_FUNCTIONS 0xffff
+#define PURE_FLAG 1
+
+#define STAMP_MAGIC "ROS\1"
+#define STAMP_MAGIC_LEN 4
+#define ENTRY_FLAG 1
+#define SHARE_EXPRESSIONS_FLAG 2
+#define LAZY_BODIES_FLAG 4
+
+#define INTERFACE_CACHE_NAME ".roi-cache"
+#define SETTLED_INTERFACE_NS 2000000000L
+#define NS_PER_SEC 1000000000L
+
+typedef struct import_decl_s {
+    char *name;
+    line import_line;
+} import_decl;
+
+typedef enum visit_state_e {
+    UNVISITED,
+    VISITING,
+    VISITED
+} visit_state;
+
+/**
+ * A function read from an interface, its name and parameter type ids point into the interface's contents
+ */
+typedef struct interface_function_s {
+    char *name;
+    size_t name_len;
+    type *ret_type;
+    bool pure;
+    size_t param_count;
+    unsigned char *param_ids;
+} interface_function;
+
+/**
+ * Position in the contents of an interface, contents read from the interface cache come from a file any process
+ * may write so every read is bounds checked
+ */
+typedef struct interface_reader_s {
+    unsigned char *next;
+    unsigned char *end;
+} interface_reader;
+
+/**
+ * Identity of an interface file when its contents were added to the interface cache. A file rewritten within one
+ * tick of the file system's clock can keep its size and modification time, so contents cached less than
+ * SETTLED_INTERFACE_NS after the file changed are only used once the file is read again and still matches
+ */
+typedef struct interface_record_s {
+    uint64_t device;
+    uint64_t inode;
+    uint64_t size;
+    struct timespec modified;
+    struct timespec recorded;
+} interface_record;
+
+typedef struct build_s build;
+
+typedef struct module_s {
+    build *owner;
+    char *path;
+    char *base;
+    char *assembly;
+    char *object;
+    vec imports;
+    vec dependencies;
+    vec dependents;
+    size_t cost;
+    size_t critical_path;
+    atomic_size_t waiting;
+    visit_state state;
+} module;
+
+/**
+ * State of one build, every module of the build points back to it. The build maps the interface cache of the entry
+ * module's directory, a file shared with every compiler process building modules there, and the compiles it forks
+ * inherit the mapping. Compiles are forked one at a time so a child never inherits a lock held by another thread. A
+ * linked build assembles each module into its object directory instead of writing assembly next to the module
+ */
+struct build_s {
+    compiler_shared *shared;
+    vec modules;
+    module *entry_module;
+    pool *workers;
+    task_group group;
+    atomic_bool failed;
+    atomic_size_t compiling;
+    bool streaming;
+    parse_options parsing;
+    char *assembly_dir;
+    shared_cache *interfaces;
+    pthread_mutex_t fork_lock;
+};
+
+/**
+ * Module being compiled one function at a time, its output is opened once its first function is compiled
+ */
+typedef struct stream_s {
+    module *mod;
+    bool entry;
+    FILE *output;
+} stream;
+
+static bool compile_child;
+
+static void raise_fatal_error(char *message, ...) {
+    va_list args;
+    va_start(args, message);
+
+    fprintf(stderr, "fatal error: ");
+    vfprintf(stderr, message, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+
+    if (compile_child) {
+        fflush(NULL);
+        _exit(1);
+    }
+    exit(1);
+}
+
+static char *concat(char *prefix, size_t prefix_len, char *suffix) {
+    size_t suffix_len = strlen(suffix);
+    char *str = malloc(prefix_len + suffix_len + 1);
+    memcpy(str, prefix, prefix_len);
+    memcpy(str + prefix_len, suffix, suffix_len + 1);
+    return str;
+}
+
+static char *scratch_path(char *base, char *extension) {
+    size_t base_len = strlen(base);
+    size_t extension_len = strlen(extension);
+    char *path = scratch_alloc(base_len + extension_len + 1);
+    memcpy(path, base, base_len);
+    memcpy(path + base_len, extension, extension_len + 1);
+    return path;
+}
+
+/**
+ * Gets the path of a module without its source extension, the module's outputs are written next to its source
+ * @param path Path of the module's source
+ * @return char*: path without the extension
+ */
+static char *module_base(char *path) {
+    size_t len = strlen(path);
+    size_t extension_len = strlen(SOURCE_EXTENSION);
+    if (len > extension_len && strcmp(path + len - extension_len, SOURCE_EXTENSION) == 0) {
+        len -= extension_len;
+    }
+    return concat(path, len, "");
+}
+
+static char *module_name(char *base) {
+    char *sep = strrchr(base, PATH_SEP);
+    return sep == NULL ? base : sep + 1;
+}
+
+/**
+ * Gets the base path of an imported module, modules are looked up in the importer's directory
+ * @param importer_path Path of the importing module's source
+ * @param name Name of the imported module
+ * @return char*: base path of the imported module
+ */
+static char *import_base(char *importer_path, char *name) {
+    char *sep = strrchr(importer_path, PATH_SEP);
+    return concat(importer_path, sep == NULL ? 0 : sep - importer_path + 1, name);
+}
+
+static bool modified_time(char *path, struct timespec *time) {
+    struct stat file_stat;
+    if (stat(path, &file_stat) != 0)
+        return false;
+
+    *time = file_stat.st_mtim;
+    return true;
+}
+
+static bool newer(struct timespec *a, struct timespec *b) {
+    return a->tv_sec > b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec > b->tv_nsec);
+}
+
+/**
+ * Finds the imports of a module without tokenizing it, only the leading lines are read since imports must come
+ * before any definition
+ * @param path Path of the module's source
+ * @return vec: import declarations in order
+ */
+static vec scan_imports(char *path) {
+    FILE *source = fopen(path, "r");
+    if (source == NULL)
+        raise_fatal_error("cannot open %s", path);
+
+    vec imports = vec_new();
+    uint32_t file = source_file_id(path);
+    line import_line = {0, 0, 0, span_new(file, 0), NULL};
+    char *text = NULL;
+    size_t capacity = 0;
+    ssize_t len;
+
+    for (size_t line_offset = 0; (len = getline(&text, &capacity, source)) != -1; line_offset += len) {
+        bool indented = *text == ' ' || *text == '\t';
+        char *keyword = strtok(text, WORD_SEPS);
+        if (keyword == NULL)
+            continue;
+        if (indented || strcmp(keyword, IMPORT) != 0)
+            break;
+
+        import_line.position = span_new(file, line_offset + (keyword - text));
+        char *name = strtok(NULL, WORD_SEPS);
+        if (name == NULL || strtok(NULL, WORD_SEPS) != NULL)
+            raise_compiler_error("Expected `%s module`", &import_line, IMPORT);
+        assert_valid_symbol(name, &import_line);
+
+        import_decl *decl = malloc(sizeof(import_decl));
+        decl->name = strdup(name);
+        decl->import_line = import_line;
+        vec_push(imports, decl);
+    }
+
+    free(text);
+    fclose(source);
+    return imports;
+}
+
+/**
+ * Gets how a module is compiled by its build, outputs compiled another way are not reused. The entry module only
+ * keeps main and what it reaches, so its outputs cannot stand in for the module imported by another program
+ * @param mod Module
+ * @return int: flags of the module's role and parse options
+ */
+static int build_flags(module *mod) {
+    int flags = 0;
+    if (mod == mod->owner->entry_module) {
+        flags |= ENTRY_FLAG;
+    }
+    if (mod->owner->parsing.share_expressions) {
+        flags |= SHARE_EXPRESSIONS_FLAG;
+    }
+    if (mod->owner->parsing.lazy_bodies) {
+        flags |= LAZY_BODIES_FLAG;
+    }
+    return flags;
+}
+
+/**
+ * Gets the path of the stamp of a module's output, its object in a linked build and its assembly otherwise. Each
+ * output has a stamp of its own, an object kept from a linked build is only reused if it was built the same way
+ * @param mod Module
+ * @return char*: path of the stamp
+ */
+static char *stamp_path(module *mod) {
+    return scratch_path(mod->base, mod->object != NULL ? OBJECT_STAMP_EXTENSION : ASSEMBLY_STAMP_EXTENSION);
+}
+
+/**
+ * Checks if a module's output was compiled the way its build compiles it, from the stamp written along with it
+ * @param mod Module
+ * @return bool: whether the stamp matches the build
+ */
+static bool stamp_matches(module *mod) {
+    FILE *stamp = fopen(stamp_path(mod), "rb");
+    if (stamp == NULL)
+        return false;
+
+    char contents[STAMP_MAGIC_LEN + 2];
+    size_t size = fread(contents, sizeof(char), sizeof(contents), stamp);
+    fclose(stamp);
+    return size == STAMP_MAGIC_LEN + 1 && memcmp(contents, STAMP_MAGIC, STAMP_MAGIC_LEN) == 0
+        && contents[STAMP_MAGIC_LEN] == build_flags(mod);
+}
+
+/**
+ * Writes the stamp of a module's output once it is complete, it is removed before the output is replaced so an
+ * output left by an interrupted compile never matches
+ * @param mod Module
+ */
+static void write_stamp(module *mod) {
+    char *path = stamp_path(mod);
+    FILE *stamp = fopen(path, "wb");
+    if (stamp == NULL)
+        raise_fatal_error("cannot open %s", path);
+    fwrite(STAMP_MAGIC, sizeof(char), STAMP_MAGIC_LEN, stamp);
+    fputc(build_flags(mod), stamp);
+    fclose(stamp);
+}
+
+/**
+ * Checks if a module's outputs are out of date, either its source changed since it was compiled, the interface
+ * of a module it imports did, or they were compiled in another role or with other parse options. The output is
+ * the module's object in a linked build and its assembly otherwise
+ * @param mod Module to check, the modules it imports must already be built
+ * @return bool: whether the module has to be compiled
+ */
+static bool stale(module *mod) {
+    struct timespec source_time, output_time, interface_time;
+    char *output_extension = mod->object != NULL ? OBJECT_EXTENSION : ASSEMBLY_EXTENSION;
+    if (!stamp_matches(mod)
+        || !modified_time(scratch_path(mod->base, output_extension), &output_time)
+        || !modified_time(scratch_path(mod->base, INTERFACE_EXTENSION), &interface_time)
+        || !modified_time(mod->path, &source_time)
+        || !newer(&output_time, &source_time))
+        return true;
+
+    vec_iter(module *dependency, mod->dependencies, {
+        struct timespec import_time;
+        if (!modified_time(scratch_path(dependency->base, INTERFACE_EXTENSION), &import_time)
+            || newer(&import_time, &output_time))
+            return true;
+    })
+
+    return false;
+}
+
+static void put_byte(FILE *out, size_t value, char *name) {
+    if (value > MAX_INTERFACE_FIELD)
+        raise_fatal_error("`%s` is too large for a module interface", name);
+    fputc((int) value, out);
+}
+
+/**
+ * Writes the interface of a module, the signature and purity of each of its functions. The file is left untouched
+ * when the interface did not change, so modules importing it are not compiled again
+ * @param base Base path of the module
+ * @param program Program node of the module
+ */
+static void write_interface(char *base, program_node *program) {
+    char *buffer;
+    size_t size;
+    FILE *out = open_memstream(&buffer, &size);
+    vec functions = program->global_namespace.functions;
+
+    size_t count = 0;
+    vec_iter(ast_node *function, functions, count += ((function_node*) function->node)->extern_symbol == NULL)
+    if (count > MAX_INTERFACE_FUNCTIONS)
+        raise_fatal_error("`%s` has too many functions for a module interface", program->module);
+
+    fwrite(INTERFACE_MAGIC, sizeof(char), INTERFACE_MAGIC_LEN, out);
+    fputc((int) (count & MAX_INTERFACE_FIELD), out);
+    fputc((int) (count >> 8), out);
+
+    vec_iter(ast_node *function, functions, {
+        function_node *func_node = function->node;
+        if (func_node->extern_symbol != NULL)
+            continue;
+
+        put_byte(out, strlen(func_node->name), func_node->name);
+        fputs(func_node->name, out);
+        put_byte(out, get_type_id(function->expr_type), func_node->name);
+        put_byte(out, func_node->pure ? PURE_FLAG : 0, func_node->name);
+        put_byte(out, func_node->param_count, func_node->name);
+        for (size_t j = 0; j < func_node->param_count; j++) {
+            ast_node *param = vec_get(func_node->func_namespace.vars, j);
+            put_byte(out, get_type_id(param->expr_type), func_node->name);
+        }
+    })
+    fclose(out);
+
+    char *interface_path = concat(base, strlen(base), INTERFACE_EXTENSION);
+    FILE *existing = fopen(interface_path, "rb");
+    bool changed = true;
+    if (existing != NULL) {
+        char *old = malloc(size + 1);
+        changed = fread(old, sizeof(char), size + 1, existing) != size || memcmp(old, buffer, size) != 0;
+        free(old);
+        fclose(existing);
+    }
+
+    if (changed) {
+        FILE *interface_out = fopen(interface_path, "wb");
+        if (interface_out == NULL)
+            raise_fatal_error("cannot open %s", interface_path);
+        fwrite(buffer, sizeof(char), size, interface_out);
+        fclose(interface_out);
+    }
+
+    free(interface_path);
+    free(buffer);
+}
+
+static FILE *open_output(char *base, char *extension) {
+    char *output_path = concat(base, strlen(base), extension);
+    FILE *output = fopen(output_path, "w");
+    if (output == NULL)
+        raise_fatal_error("cannot open %s", output_path);
+    free(output_path);
+    return output;
+}
+
+/**
+ * Opens where the assembly of a module goes, a file next to the module or, when the build is linked, a file in the
+ * build's assembly directory
+ * @param mod Module
+ * @param extension Extension of the file next to the module
+ * @return FILE*: the output
+ */
+static FILE *open_assembly(module *mod, char *extension) {
+    if (mod->assembly == NULL)
+        return open_output(mod->base, extension);
+
+    FILE *output = fopen(mod->assembly, "w");
+    if (output == NULL)
+        raise_fatal_error("cannot open %s", mod->assembly);
+    return output;
+}
+
+/**
+ * Closes the assembly of a module, the assembly of a linked build is assembled and removed. The object is written
+ * to a partial file that only replaces the module's object once it is fully assembled, so a failed assembler never
+ * leaves an object that looks up to date
+ * @param mod Module
+ * @param output Output opened by open_assembly
+ */
+static void close_assembly(module *mod, FILE *output) {
+    fclose(output);
+    if (mod->assembly == NULL)
+        return;
+
+    char *partial_path = scratch_path(mod->base, PARTIAL_OBJECT_EXTENSION);
+    bool assembled = assemble(mod->assembly, partial_path);
+    remove(mod->assembly);
+    if (!assembled) {
+        remove(partial_path);
+        raise_fatal_error("cannot assemble %s", mod->path);
+    }
+    if (rename(partial_path, mod->object) != 0)
+        raise_fatal_error("cannot write %s", mod->object);
+}
+
+static void begin_stream(stream *module_stream, ast_node *root) {
+    program_node *program = root->node;
+    program->module = module_name(module_stream->mod->base);
+    program->entry = module_stream->entry;
+    module_stream->output = open_assembly(module_stream->mod, PARTIAL_EXTENSION);
+    begin_assembly(root, module_stream->output);
+}
+
+/**
+ * Compiles a function as soon as its body is parsed and releases its body, only its signature is kept. Bodies of
+ * pure functions are kept so later calls to them can still be evaluated at compile time
+ * @param context Stream of the module
+ * @param root Root of the module's AST
+ * @param function Function that was defined
+ */
+static void stream_function(void *context, ast_node *root, ast_node *function) {
+    stream *module_stream = context;
+    if (module_stream->output == NULL) {
+        begin_stream(module_stream, root);
+    }
+
+    optimize_function(function);
+    if (!has_errors()) {
+        stream_definition_assembly(function);
+    }
+
+    function_node *func_node = function->node;
+    if (!func_node->pure) {
+        function_node_free_body(func_node);
+    }
+}
+
+/**
+ * Compiles a module one function at a time, memory use is bounded by the largest function instead of the file.
+ * The assembly is written to a partial file that only replaces the module's assembly once the whole module
+ * compiled, or to the build's assembly directory when the build is linked
+ * @param unit Compilation of the module
+ * @param mod Module to compile
+ * @return ast_node*: root of the module's AST, its functions only keep their signatures
+ */
+static ast_node *stream_module(compilation *unit, module *mod) {
+    char *base = mod->base;
+    stream module_stream = {mod, mod == mod->owner->entry_module, NULL};
+
+    ast_node *root = generate_ast(unit, mod->path, module_stream.entry, mod->owner->parsing, &stream_function,
+        &module_stream);
+    if (module_stream.output == NULL) {
+        begin_stream(&module_stream, root);
+    }
+    char *partial_path = concat(base, strlen(base), PARTIAL_EXTENSION);
+    if (has_errors()) {
+        fclose(module_stream.output);
+        remove(mod->assembly != NULL ? mod->assembly : partial_path);
+        abandon_compilation();
+    }
+
+    vec_iter(ast_node *definition, ((program_node*) root->node)->definitions, {
+        if (definition->generate_assembly != &function_assembly) {
+            stream_definition_assembly(definition);
+        }
+    })
+    end_assembly();
+    close_assembly(mod, module_stream.output);
+    if (mod->assembly != NULL) {
+        free(partial_path);
+        return root;
+    }
+
+    char *assembly_path = concat(base, strlen(base), ASSEMBLY_EXTENSION);
+    if (rename(partial_path, assembly_path) != 0)
+        raise_fatal_error("cannot write %s", assembly_path);
+    free(partial_path);
+    free(assembly_path);
+    return root;
+}
+
+/**
+ * Parses and optimizes a module, a module with errors ends its compilation once every line was parsed
+ * @param unit Compilation of the module
+ * @param path Path of the module's source
+ * @param name Name of the module
+ * @param entry Whether the module is the entry module
+ * @param parsing How the module's source is parsed
+ * @return ast_node*: root of the module's AST
+ */
+static ast_node *analyze_module(compilation *unit, char *path, char *name, bool entry, parse_options parsing) {
+    ast_node *root = generate_ast(unit, path, entry, parsing, NULL, NULL);
+    program_node *program = root->node;
+    program->module = name;
+    program->entry = entry;
+    optimize(root);
+    if (has_errors())
+        abandon_compilation();
+    return root;
+}
+
+/**
+ * Compiles a module to its assembly file, or its object in a linked build, and its interface as a compilation of its
+ * own
+ * @param mod Module to compile
+ * @param threaded_lexing Whether a core is left for lexing the module on a thread of its own
+ * @return bool: whether the module compiled
+ */
+static bool compile_module(module *mod, bool threaded_lexing) {
+    compilation *unit = compilation_new(mod->owner->shared);
+    unit->interfaces = mod->owner->interfaces;
+    unit->threaded_lexing = threaded_lexing;
+    bind_compilation(unit);
+
+    jmp_buf failure;
+    unit->failure = &failure;
+    if (setjmp(failure) != 0)
+        return false;
+
+    remove(stamp_path(mod));
+    if (mod->owner->streaming) {
+        write_interface(mod->base, stream_module(unit, mod)->node);
+        write_stamp(mod);
+        flush_diagnostics();
+        compilation_free(unit);
+        return true;
+    }
+
+    char *base = mod->base;
+    ast_node *root = analyze_module(unit, mod->path, module_name(base), mod == mod->owner->entry_module,
+        mod->owner->parsing);
+    FILE *output = open_assembly(mod, ASSEMBLY_EXTENSION);
+    generate_assembly(root, output);
+    close_assembly(mod, output);
+
+    write_interface(base, root->node);
+    write_stamp(mod);
+    flush_diagnostics();
+    compilation_free(unit);
+    return true;
+}
+
+/**
+ * Compiles a module whose source is in memory to assembly, nothing is written next to the module. The module's AST
+ * is left in the compilation for the caller to free
+ * @param unit Compilation bound to the calling thread, a module with errors ends it
+ * @param path Path the module is compiled as, the interfaces of its imports are read next to it
+ * @param source Source of the module
+ * @param len Length of the source
+ * @param entry Whether the module is the entry module
+ * @param options How the module's source is parsed
+ * @param output Where the assembly is written
+ */
+void compile_module_source(compilation *unit, char *path, char *source, size_t len, bool entry,
+    parse_options options, FILE *output) {
+
+    char *base = module_base(path);
+    char *name = module_name(base);
+    name = intern_str(unit->strings, name, strlen(name));
+    free(base);
+
+    source_file_text(path, source, len);
+    generate_assembly(analyze_module(unit, path, name, entry, options), output);
+}
+
+/**
+ * Adds a module and everything it imports to the module graph, only the imports of each module are read
+ * @param owner Build the module belongs to
+ * @param path Path of the module's source
+ * @param import_line Line importing the module, NULL for the entry module
+ * @return module*: the module
+ */
+static module *discover_module(build *owner, char *path, line *import_line) {
+    char *base = module_base(path);
+    vec_iter(module *mod, owner->modules, {
+        if (strcmp(mod->base, base) == 0) {
+            free(base);
+            return mod;
+        }
+    })
+
+    char *name = module_name(base);
+    struct stat source_stat;
+    if (stat(path, &source_stat) != 0) {
+        if (import_line != NULL)
+            raise_compiler_error("Module `%s` not found", import_line, name);
+        raise_fatal_error("%s not found", path);
+    }
+    if (!valid_symbol(owner->shared, name))
+        raise_fatal_error("`%s` is not a valid module name", name);
+
+    module *mod = malloc(sizeof(module));
+    mod->owner = owner;
+    mod->path = path;
+    mod->base = base;
+    mod->assembly = NULL;
+    mod->object = NULL;
+    mod->imports = scan_imports(path);
+    mod->dependencies = vec_new();
+    mod->dependents = vec_new();
+    mod->cost = source_stat.st_size;
+    mod->critical_path = 0;
+    atomic_store(&mod->waiting, vec_len(mod->imports));
+    mod->state = UNVISITED;
+    vec_push(owner->modules, mod);
+
+    vec_iter(import_decl *decl, mod->imports, {
+        char *import_base_path = import_base(path, decl->name);
+        char *import_path = concat(import_base_path, strlen(import_base_path), SOURCE_EXTENSION);
+        free(import_base_path);
+
+        module *dependency = discover_module(owner, import_path, &decl->import_line);
+        if (dependency->path != import_path) {
+            free(import_path);
+        }
+        vec_push(mod->dependencies, dependency);
+        vec_push(dependency->dependents, mod);
+    })
+
+    return mod;
+}
+
+/**
+ * Reports the first import cycle reachable from a module, before anything is compiled
+ * @param mod Module to search from
+ * @param chain Modules on the current import path
+ */
+static void check_cycles(module *mod, vec chain) {
+    mod->state = VISITING;
+    vec_push(chain, mod);
+
+    vec_iter(module *dependency, mod->dependencies, {
+        if (dependency->state == VISITING) {
+            char *cycle;
+            size_t cycle_len;
+            FILE *out = open_memstream(&cycle, &cycle_len);
+            bool in_cycle = false;
+            vec_iter(module *link, chain, {
+                in_cycle |= link == dependency;
+                if (in_cycle) {
+                    fprintf(out, "%s -> ", module_name(link->base));
+                }
+            })
+            fprintf(out, "%s", module_name(dependency->base));
+            fclose(out);
+
+            import_decl *decl = vec_get(mod->imports, i);
+            raise_compiler_error("Import cycle %s", &decl->import_line, cycle);
+        }
+        if (dependency->state == UNVISITED) {
+            check_cycles(dependency, chain);
+        }
+    })
+
+    vec_pop(chain);
+    mod->state = VISITED;
+}
+
+/**
+ * Computes the longest chain of compile work from a module to the end of the build, estimated by source size.
+ * Modules on the longest chains are started first so the build takes close to its critical path
+ * @param mod Module
+ * @return size_t: length of the module's critical path
+ */
+static size_t critical_path(module *mod) {
+    if (mod->critical_path != 0)
+        return mod->critical_path;
+
+    size_t longest = 0;
+    vec_iter(module *dependent, mod->dependents, {
+        size_t path = critical_path(dependent);
+        longest = path > longest ? path : longest;
+    })
+
+    mod->critical_path = mod->cost + longest + 1;
+    return mod->critical_path;
+}
+
+/**
+ * Sorts modules by their critical path, least critical first
+ * @param ready Modules to sort
+ */
+static void sort_by_critical_path(vec ready) {
+    for (size_t i = 1; i < vec_len(ready); i++) {
+        module *mod = vec_get(ready, i);
+        size_t j = i;
+        for (; j > 0 && ((module*) vec_get(ready, j - 1))->critical_path > mod->critical_path; j--) {
+            vec_set(ready, j, vec_get(ready, j - 1));
+        }
+        vec_set(ready, j, mod);
+    }
+}
+
+static int read_byte(interface_reader *in) {
+    return in->next < in->end ? *in->next++ : -1;
+}
+
+/**
+ * Reads the header of an interface
+ * @param in Interface, positioned at its start
+ * @param count Set to the number of functions of the interface
+ * @return bool: whether the header is valid
+ */
+static bool read_interface_header(interface_reader *in, size_t *count) {
+    if (in->end - in->next < INTERFACE_MAGIC_LEN + 2 || memcmp(in->next, INTERFACE_MAGIC, INTERFACE_MAGIC_LEN) != 0)
+        return false;
+
+    in->next += INTERFACE_MAGIC_LEN;
+    int count_low = read_byte(in);
+    *count = count_low | read_byte(in) << 8;
+    return true;
+}
+
+/**
+ * Reads a function from an interface
+ * @param in Interface, positioned at the function
+ * @param function Set to the function
+ * @return bool: whether the function is valid
+ */
+static bool read_function(interface_reader *in, interface_function *function) {
+    int name_len = read_byte(in);
+    if (name_len < 0 || in->end - in->next < name_len)
+        return false;
+    function->name = (char*) in->next;
+    function->name_len = name_len;
+    in->next += name_len;
+
+    function->ret_type = get_type_by_id(read_byte(in));
+    int flags = read_byte(in);
+    int param_count = read_byte(in);
+    if (function->ret_type == NULL || flags < 0 || param_count < 0 || in->end - in->next < param_count)
+        return false;
+    function->pure = flags & PURE_FLAG;
+    function->param_count = param_count;
+    function->param_ids = in->next;
+    in->next += param_count;
+
+    for (int i = 0; i < param_count; i++) {
+        if (get_type_by_id(function->param_ids[i]) == NULL)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Reads the contents of an interface file
+ * @param path Path of the interface
+ * @param size Set to the size of the contents
+ * @return char*: the contents, NULL if the interface does not exist
+ */
+static char *read_interface_contents(char *path, size_t *size) {
+    *size = 0;
+    FILE *in = fopen(path, "rb");
+    if (in == NULL)
+        return NULL;
+
+    char *contents = NULL;
+    long len = fseek(in, 0, SEEK_END) == 0 ? ftell(in) : -1;
+    if (len >= 0) {
+        rewind(in);
+        contents = malloc(len + 1);
+        *size = fread(contents, sizeof(char), len, in);
+    }
+    fclose(in);
+    return contents;
+}
+
+static bool settled(struct timespec *modified, struct timespec *at) {
+    return (at->tv_sec - modified->tv_sec) * NS_PER_SEC + (at->tv_nsec - modified->tv_nsec) >= SETTLED_INTERFACE_NS;
+}
+
+static bool same_file(interface_record *record, struct stat *file_stat) {
+    return record->device == file_stat->st_dev && record->inode == file_stat->st_ino
+        && record->size == file_stat->st_size && record->modified.tv_sec == file_stat->st_mtim.tv_sec
+        && record->modified.tv_nsec == file_stat->st_mtim.tv_nsec;
+}
+
+/**
+ * Adds the contents of an interface file to the interface cache, keyed by the file's path
+ * @param cache Interface cache
+ * @param path Path of the interface
+ * @param file_stat Identity of the file when it was read
+ * @param now Time the file was read
+ * @param contents Contents of the interface
+ * @param size Size of the contents
+ */
+static void publish_interface(shared_cache *cache, char *path, struct stat *file_stat, struct timespec *now,
+    char *contents, size_t size) {
+
+    interface_record record = {file_stat->st_dev, file_stat->st_ino, file_stat->st_size, file_stat->st_mtim, *now};
+    char *value = malloc(sizeof(interface_record) + size);
+    memcpy(value, &record, sizeof(interface_record));
+    memcpy(value + sizeof(interface_record), contents, size);
+    shared_cache_add(cache, path, strlen(path), value, sizeof(interface_record) + size);
+    free(value);
+}
+
+/**
+ * Loads the contents of an interface. Contents cached for the same file are used in place from the cache's mapping,
+ * so importing a module whose interface did not change costs a stat. Otherwise the file is read and added to the
+ * cache for every other compile, in this process or another one, that imports the module
+ * @param cache Interface cache, NULL to read the file
+ * @param path Path of the interface
+ * @param size Set to the size of the contents
+ * @param owned Set to the contents when they were read from the file and must be freed, NULL otherwise
+ * @return char*: the contents, NULL if the interface does not exist
+ */
+static char *load_interface(shared_cache *cache, char *path, size_t *size, char **owned) {
+    *owned = NULL;
+    struct stat file_stat;
+    if (stat(path, &file_stat) != 0)
+        return NULL;
+
+    size_t cached_size;
+    char *cached = cache == NULL ? NULL : shared_cache_find(cache, path, strlen(path), &cached_size);
+    interface_record record;
+    bool current = false;
+    if (cached != NULL && cached_size >= sizeof(interface_record)) {
+        memcpy(&record, cached, sizeof(interface_record));
+        current = same_file(&record, &file_stat);
+    }
+    if (current && settled(&record.modified, &record.recorded)) {
+        *size = cached_size - sizeof(interface_record);
+        return cached + sizeof(interface_record);
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    *owned = read_interface_contents(path, size);
+    if (*owned != NULL && cache != NULL && (!current || settled(&file_stat.st_mtim, &now))) {
+        publish_interface(cache, path, &file_stat, &now, *owned, *size);
+    }
+    return *owned;
+}
+
+/**
+ * Adds the interface of a built module to the interface cache before the modules importing it are compiled
+ * @param mod Module whose interface was written
+ */
+static void cache_interface(module *mod) {
+    char *path = scratch_path(mod->base, INTERFACE_EXTENSION);
+    size_t size;
+    char *owned;
+    load_interface(mod->owner->interfaces, path, &size, &owned);
+    free(owned);
+}
+
+/**
+ * Compiles a module in a child process and waits for it, a failed compile exits so it gets a process of its own.
+ * The child is a copy of one thread of a multithreaded process, so it ends with _exit once its output is flushed
+ * instead of running the exit handlers it inherited. The module is only lexed on a thread of its own when fewer
+ * modules are compiling than the build has workers, so lexers never oversubscribe the machine
+ * @param mod Module to compile
+ * @return bool: whether the module compiled
+ */
+static bool compile_in_child(module *mod) {
+    size_t compiling = atomic_fetch_add(&mod->owner->compiling, 1) + 1;
+    pthread_mutex_lock(&mod->owner->fork_lock);
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+        compile_child = true;
+        bool compiled = compile_module(mod, compiling < pool_workers(mod->owner->workers));
+        fflush(NULL);
+        _exit(compiled ? 0 : 1);
+    }
+
+    pthread_mutex_unlock(&mod->owner->fork_lock);
+    if (pid < 0)
+        raise_fatal_error("cannot start a compile job for %s", mod->path);
+
+    int status;
+    pid_t waited;
+    while ((waited = waitpid(pid, &status, 0)) < 0 && errno == EINTR) {}
+    atomic_fetch_sub(&mod->owner->compiling, 1);
+    return waited == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/**
+ * Builds a module on the pool, then starts every module that was only waiting on it. They are spawned most
+ * critical last, so this worker continues with the most critical one while idle workers steal the others. The worker
+ * waits on the module's compile child, so the pool's size bounds how many modules compile at once
+ * @param arg Module to build
+ */
+static void build_task(void *arg) {
+    module *mod = arg;
+    if ((mod == mod->owner->entry_module || stale(mod)) && !compile_in_child(mod)) {
+        atomic_store(&mod->owner->failed, true);
+        return;
+    }
+    if (vec_len(mod->dependents) > 0) {
+        cache_interface(mod);
+    }
+
+    vec ready = vec_new();
+    vec_iter(module *dependent, mod->dependents, {
+        if (atomic_fetch_sub(&dependent->waiting, 1) == 1) {
+            vec_push(ready, dependent);
+        }
+    })
+
+    sort_by_critical_path(ready);
+    vec_iter(module *dependent, ready, pool_spawn(&mod->owner->group, &build_task, dependent))
+    vec_free(ready);
+    scratch_reset();
+}
+
+/**
+ * Gives every module of a linked build an object next to its source, kept between builds like its assembly, and a
+ * file for its assembly in a new temporary assembly directory
+ * @param owner Build
+ * @return vec: paths of the assembly files, in the order the modules were found
+ */
+static vec assign_objects(build *owner) {
+    owner->assembly_dir = make_assembly_dir();
+    if (owner->assembly_dir == NULL)
+        raise_fatal_error("cannot create a directory for the assembly of %s", owner->entry_module->path);
+
+    vec assemblies = vec_new();
+    size_t assembly_len = strlen(owner->assembly_dir) + sizeof(LINKED_ASSEMBLY_PATH) + MAX_INDEX_DIGITS;
+    for (size_t i = 0; i < vec_len(owner->modules); i++) {
+        module *mod = vec_get(owner->modules, i);
+        mod->assembly = malloc(assembly_len);
+        snprintf(mod->assembly, assembly_len, LINKED_ASSEMBLY_PATH, owner->assembly_dir, i);
+        mod->object = concat(mod->base, strlen(mod->base), OBJECT_EXTENSION);
+        vec_push(assemblies, mod->assembly);
+    }
+    return assemblies;
+}
+
+/**
+ * Compiles a program starting from its entry module. The imports of every module are found first and cycles are
+ * reported before anything is compiled. Modules are then compiled on the worker pool as soon as the modules they
+ * import are built, each to its own assembly file and interface, and imported modules are only compiled again when
+ * they or their imports' interfaces changed. A linked build instead writes every module's assembly to a temporary
+ * directory and assembles it into an object next to the module, which is reused as long as the module is not
+ * stale. The objects are linked once all of them are up to date, the temporary directory is removed afterwards
+ * @param shared State shared by every compilation
+ * @param path Path of the entry module's source
+ * @param jobs Number of modules compiled at once, the build starts a worker pool of its own with that many workers
+ * @param stream Whether each function is compiled and released as soon as it is parsed
+ * @param options How each module's source is parsed
+ * @param linking How the program is linked, NULL to only write each module's assembly
+ * @return bool: whether every module compiled, and the program linked when it is linked
+ */
+bool build_module(compiler_shared *shared, char *path, size_t jobs, bool stream, parse_options options,
+    link_options *linking) {
+
+    compilation *unit = compilation_new(shared);
+    bind_compilation(unit);
+
+    char *cache_path = import_base(path, INTERFACE_CACHE_NAME);
+    build owner = {.shared = shared, .modules = vec_new(), .workers = pool_new(jobs), .streaming = stream,
+        .parsing = options, .interfaces = shared_cache_open(cache_path)};
+    free(cache_path);
+    pthread_mutex_init(&owner.fork_lock, NULL);
+    owner.entry_module = discover_module(&owner, path, NULL);
+
+    vec chain = vec_new();
+    check_cycles(owner.entry_module, chain);
+    vec_free(chain);
+    vec assemblies = linking != NULL ? assign_objects(&owner) : NULL;
+
+    vec ready = vec_new();
+    vec_iter(module *mod, owner.modules, {
+        critical_path(mod);
+        if (atomic_load(&mod->waiting) == 0) {
+            vec_push(ready, mod);
+        }
+    })
+
+    atomic_store(&owner.failed, false);
+    atomic_store(&owner.compiling, 0);
+    task_group_init(&owner.group, owner.workers);
+    sort_by_critical_path(ready);
+    for (size_t i = vec_len(ready); i > 0; i--) {
+        pool_inject(&owner.group, &build_task, vec_get(ready, i - 1));
+    }
+    task_group_wait(&owner.group);
+
+    if (assemblies != NULL) {
+        vec objects = vec_new();
+        vec_iter(module *mod, owner.modules, vec_push(objects, mod->object))
+        if (!atomic_load(&owner.failed) && !link_objects(objects, linking)) {
+            fprintf(stderr, "fatal error: cannot link %s\n", linking->output);
+            atomic_store(&owner.failed, true);
+        }
+        vec_iter(char *object, objects, free(object))
+        vec_free(objects);
+        remove_assembly_dir(owner.assembly_dir, assemblies);
+        free_vec_and_elements(assemblies);
+    }
+
+    vec_iter(module *mod, owner.modules, {
+        free(mod->path == path ? NULL : mod->path);
+        free(mod->base);
+        vec_iter(import_decl *decl, mod->imports, free(decl->name))
+        free_vec_and_elements(mod->imports);
+        vec_free(mod->dependencies);
+        vec_free(mod->dependents);
+    })
+    free_vec_and_elements(owner.modules);
+    if (owner.interfaces != NULL) {
+        shared_cache_close(owner.interfaces);
+    }
+    pthread_mutex_destroy(&owner.fork_lock);
+    pool_free(owner.workers);
+    vec_free(ready);
+    compilation_free(unit);
+    return !atomic_load(&owner.failed);
+}
+
+/**
+ * Declares the functions of an imported module from its interface, calls to them are resolved when linking. The
+ * interface is checked in full before anything is declared, since its contents may come from the interface cache
+ * @param name Name of the imported module
+ * @param import_line Line of the import
+ * @param ns Global namespace of the importing module
+ */
+void import_module(char *name, line *import_line, namespace *ns) {
+    char *base = import_base(source_file_path(import_line->position.file), name);
+    char *interface_path = concat(base, strlen(base), INTERFACE_EXTENSION);
+    free(base);
+    size_t size;
+    char *owned;
+    char *contents = load_interface(bound_compilation()->interfaces, interface_path, &size, &owned);
+    free(interface_path);
+    if (contents == NULL)
+        raise_compiler_error("Module `%s` has no interface", import_line, name);
+    if (owned != NULL) {
+        hold_partial(owned, &free);
+    }
+
+    interner *strings = bound_compilation()->strings;
+    interface_reader start = {(unsigned char*) contents, (unsigned char*) contents + size};
+    interface_reader in = start;
+    interface_function function;
+    size_t count = 0;
+    if (!read_interface_header(&in, &count))
+        raise_compiler_error("Invalid interface for `%s`", import_line, name);
+    for (size_t i = 0; i < count; i++) {
+        if (!read_function(&in, &function))
+            raise_compiler_error("Invalid interface for `%s`", import_line, name);
+        char *function_name = intern_str(strings, function.name, function.name_len);
+        if (function_lookup(ns, function_name) != NULL)
+            raise_compiler_error("`%s` is already defined", import_line, function_name);
+    }
+
+    in = start;
+    read_interface_header(&in, &count);
+    size_t symbol_capacity = strlen(name) + MAX_INTERFACE_FIELD + sizeof(EXTERN_SYMBOL);
+    char *symbol = malloc(symbol_capacity);
+    for (size_t i = 0; i < count; i++) {
+        read_function(&in, &function);
+        char *function_name = intern_str(strings, function.name, function.name_len);
+        ast_node *node = function_node_new(function.ret_type, function_name, ns);
+        function_node *func_node = node->node;
+        for (size_t j = 0; j < function.param_count; j++) {
+            function_node_add_var(func_node, get_type_by_id(function.param_ids[j]), "");
+        }
+        func_node->param_count = function.param_count;
+        func_node->pure = function.pure;
+        int symbol_len = snprintf(symbol, symbol_capacity, EXTERN_SYMBOL, name, function_name);
+        func_node->extern_symbol = intern_str(strings, symbol, symbol_len);
+        namespace_add_function(ns, node);
+    }
+
+    free(symbol);
+    if (owned != NULL) {
+        unhold_partial(owned);
+        free(owned);
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef MODULE_H
+#define MODULE_H
+
+#include "ast.h"
+#include "ast_node.h"
+#include "context.h"
+#include "line_iterator.h"
+#include "toolchain.h"
+
+bool build_module(compiler_shared *shared, char *path, size_t jobs, bool stream, parse_options options,
+    link_options *linking);
+
+void compile_module_source(compilation *unit, char *path, char *source, size_t len, bool entry,
+    parse_options options, FILE *output);
+
+void import_module(char *name, line *import_line, namespace *ns);
+
+#endif //MODULE_H
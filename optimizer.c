@@ -0,0 +1,668 @@
+#include "optimizer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "assembly_generator.h"
+#include "constant.h"
+#include "context.h"
+#include "interner.h"
+#include "pattern.h"
+#include "util.h"
+
+#define MAX_I64_LITERAL_LEN 21
+#define MAX_TEMP_NAME_LEN 32
+#define TEMP_NAME ".cse%lu"
+#define INVARIANT_NAME ".inv%lu"
+#define ENTRY_FUNCTION "main"
+
+static bool local_var(function_node *func_node, ast_node *var) {
+    return ((var_node*) var->node)->scope == func_node->func_namespace.depth;
+}
+
+static bool pure_statements(vec statements, function_node *func_node);
+
+/**
+ * Checks if a statement or expression only does arithmetic on the function's own variables and calls to pure
+ * functions
+ * @param node Statement or expression
+ * @param func_node Function the node is in
+ * @return bool: whether the node is pure
+ */
+static bool pure_node(ast_node *node, function_node *func_node) {
+    void (*assembly)(ast_node*) = node->generate_assembly;
+
+    if (assembly == &literal_assembly)
+        return true;
+    if (assembly == &load_assembly)
+        return local_var(func_node, node);
+    if (assembly == &return_assembly)
+        return node->node == NULL || pure_node(node->node, func_node);
+
+    if (assembly == &call_assembly) {
+        call_node *call = node->node;
+        if (!((function_node*) call->function->node)->pure)
+            return false;
+        vec_iter(ast_node *arg, call->args, {
+            if (!pure_node(arg, func_node))
+                return false;
+        })
+        return true;
+    }
+
+    if (assembly == &match_assembly) {
+        match_node *match = node->node;
+        vec_iter(match_arm *arm, match->arms, {
+            if (!pure_statements(arm->statements, func_node))
+                return false;
+        })
+        return pure_node(match->value, func_node)
+            && (match->default_statements == NULL || pure_statements(match->default_statements, func_node));
+    }
+
+    if (assembly == &for_assembly) {
+        for_node *loop = node->node;
+        return local_var(func_node, loop->var)
+            && pure_node(loop->start, func_node)
+            && pure_node(loop->end, func_node)
+            && pure_statements(loop->invariants, func_node)
+            && pure_statements(loop->statements, func_node);
+    }
+
+    binary_operation_node *op_node = node->node;
+    if (assembly == &assignment_assembly)
+        return local_var(func_node, op_node->left) && pure_node(op_node->right, func_node);
+
+    return arithmetic_operation(node) && pure_node(op_node->left, func_node) && pure_node(op_node->right, func_node);
+}
+
+static bool pure_statements(vec statements, function_node *func_node) {
+    vec_iter(ast_node *statement, statements, {
+        if (!pure_node(statement, func_node))
+            return false;
+    })
+
+    return true;
+}
+
+static void check_declared_purity(function_node *func_node) {
+    if (func_node->declared_pure && !func_node->pure)
+        report_compiler_error("`%s` is declared pure but uses globals or impure functions", &func_node->definition,
+            func_node->name);
+}
+
+/**
+ * Marks every function whose body is pure. All functions start out pure and impure ones are removed until
+ * nothing changes, so recursive pure functions stay pure. Functions defined elsewhere keep the purity they were
+ * declared with
+ * @param functions Functions in the program
+ */
+static void infer_purity(vec functions) {
+    vec_iter(ast_node *function, functions, {
+        function_node *func_node = function->node;
+        func_node->pure |= func_node->extern_symbol == NULL && func_node->defined;
+    })
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        vec_iter(ast_node *function, functions, {
+            function_node *func_node = function->node;
+            if (func_node->extern_symbol == NULL && func_node->pure && !pure_statements(func_node->statements, func_node)) {
+                func_node->pure = false;
+                changed = true;
+            }
+        })
+    }
+
+    vec_iter(ast_node *function, functions, check_declared_purity(function->node))
+}
+
+/**
+ * Replaces an expression with a node computed from other nodes, keeping the expression's address so its parent
+ * does not change. The replaced expression is freed
+ * @param node Expression to replace
+ * @param replacement Node to copy into the expression
+ */
+static void replace_node(ast_node *node, ast_node *replacement) {
+    ast_node replaced = *node;
+    *node = *replacement;
+    *replacement = replaced;
+    replacement->free_func(replacement);
+}
+
+/**
+ * Checks whether an expression has been folded into an i64 literal
+ * @param node Expression
+ * @return bool: whether the expression is an i64 literal
+ */
+static bool constant_literal(ast_node *node) {
+    return node->generate_assembly == &literal_assembly && node->expr_type->validate_literal == &valid_i64_literal;
+}
+
+/**
+ * Evaluates constant subexpressions and pure calls with constant arguments at compile time. Operands are folded
+ * before the operation using them, so each subexpression is evaluated once. Shared nodes of an expression DAG were
+ * folded when they were built
+ * @param node Expression
+ */
+static void fold_constants(ast_node *node) {
+    void (*assembly)(ast_node*) = node->generate_assembly;
+    int64_t value;
+
+    if (shared_node(node))
+        return;
+
+    bool constant = false;
+    if (assembly == &call_assembly) {
+        constant = true;
+        vec_iter(ast_node *arg, ((call_node*) node->node)->args, {
+            fold_constants(arg);
+            constant = constant && constant_literal(arg);
+        })
+    } else if (assembly == &assignment_assembly) {
+        fold_constants(((binary_operation_node*) node->node)->right);
+    } else if (arithmetic_operation(node)) {
+        binary_operation_node *op_node = node->node;
+        fold_constants(op_node->left);
+        fold_constants(op_node->right);
+        constant = constant_literal(op_node->left) && constant_literal(op_node->right);
+    }
+
+    if (constant && evaluate_constant(node, &value)) {
+        char literal[MAX_I64_LITERAL_LEN];
+        size_t len = snprintf(literal, MAX_I64_LITERAL_LEN, "%ld", value);
+        char *interned = intern_str(bound_compilation()->strings, literal, len);
+        replace_node(node, literal_node_new(node->expr_type, interned));
+    }
+}
+
+/**
+ * Gets the expression evaluated by a statement before any nested statements
+ * @param statement Statement
+ * @return ast_node*: the statement's expression, NULL if it has none
+ */
+static ast_node *statement_expression(ast_node *statement) {
+    if (statement->generate_assembly == &match_assembly)
+        return ((match_node*) statement->node)->value;
+    if (statement->generate_assembly == &return_assembly)
+        return statement->node;
+    if (statement->generate_assembly == &for_assembly || statement->generate_assembly == &parallel_for_assembly
+        || statement->generate_assembly == &print_assembly)
+        return NULL;
+    return statement;
+}
+
+static bool equal_expressions(ast_node *a, ast_node *b) {
+    void (*assembly)(ast_node*) = a->generate_assembly;
+    if (a == b)
+        return true;
+    if (assembly != b->generate_assembly)
+        return false;
+
+    if (assembly == &literal_assembly)
+        return a->expr_type == b->expr_type && strcmp(a->node, b->node) == 0;
+    if (assembly == &load_assembly)
+        return a->node == b->node;
+
+    if (assembly == &call_assembly) {
+        call_node *a_call = a->node;
+        call_node *b_call = b->node;
+        if (a_call->function != b_call->function)
+            return false;
+        vec_iter(ast_node *arg, a_call->args, {
+            if (!equal_expressions(arg, vec_get(b_call->args, i)))
+                return false;
+        })
+        return true;
+    }
+
+    binary_operation_node *a_op = a->node;
+    binary_operation_node *b_op = b->node;
+    return arithmetic_operation(a)
+        && equal_expressions(a_op->left, b_op->left)
+        && equal_expressions(a_op->right, b_op->right);
+}
+
+/**
+ * Checks if an expression gives the same value anywhere in a statement, it may only read the function's own
+ * variables, which nothing in the statement besides its final assignment can write
+ * @param node Expression
+ * @param func_node Function the expression is in
+ * @return bool: whether the expression is stable
+ */
+static bool stable_expression(ast_node *node, function_node *func_node) {
+    return node->generate_assembly != &assignment_assembly && pure_node(node, func_node);
+}
+
+static void collect_calls(ast_node *node, vec calls) {
+    void (*assembly)(ast_node*) = node->generate_assembly;
+
+    if (assembly == &call_assembly) {
+        vec_push(calls, node);
+        vec_iter(ast_node *arg, ((call_node*) node->node)->args, collect_calls(arg, calls))
+    } else if (assembly == &assignment_assembly) {
+        collect_calls(((binary_operation_node*) node->node)->right, calls);
+    } else if (arithmetic_operation(node)) {
+        binary_operation_node *op_node = node->node;
+        collect_calls(op_node->left, calls);
+        collect_calls(op_node->right, calls);
+    }
+}
+
+static ast_node *find_common_call(vec calls, function_node *func_node) {
+    for (size_t i = 0; i < vec_len(calls); i++) {
+        ast_node *call = vec_get(calls, i);
+        if (!stable_expression(call, func_node))
+            continue;
+
+        for (size_t j = i + 1; j < vec_len(calls); j++) {
+            if (equal_expressions(call, vec_get(calls, j)))
+                return call;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Computes a pure call repeated within a statement once, into a temporary defined just before the statement
+ * @param statements Statements of the block
+ * @param index Index of the statement
+ * @param func_node Function the statement is in
+ * @return bool: whether a temporary was inserted at the index
+ */
+static bool hoist_common_call(vec statements, size_t index, function_node *func_node) {
+    ast_node *expression = statement_expression(vec_get(statements, index));
+    if (expression == NULL)
+        return false;
+
+    vec calls = vec_new();
+    collect_calls(expression, calls);
+    ast_node *common = find_common_call(calls, func_node);
+
+    if (common != NULL) {
+        char name[MAX_TEMP_NAME_LEN];
+        compilation *unit = bound_compilation();
+        size_t temp_id = unit->temp_count++;
+        char *temp_name = intern_str(unit->strings, name, snprintf(name, MAX_TEMP_NAME_LEN, TEMP_NAME, temp_id));
+        ast_node *temp = function_node_add_var(func_node, common->expr_type, temp_name);
+
+        vec repeats = vec_new();
+        vec_iter(ast_node *curr_call, calls, {
+            if (curr_call != common && equal_expressions(common, curr_call)) {
+                vec_push(repeats, curr_call);
+            }
+        })
+        vec_iter(ast_node *repeat, repeats, replace_node(repeat, var_ref_copy(temp)))
+        vec_free(repeats);
+
+        ast_node *call = malloc(sizeof(ast_node));
+        *call = *common;
+        ast_node *load = var_ref_copy(temp);
+        *common = *load;
+        free(load);
+
+        vec_insert(statements, index, binary_operation_new(temp->expr_type, temp, call, &assignment_assembly));
+    }
+
+    vec_free(calls);
+    return common != NULL;
+}
+
+static void collect_assigned(vec statements, vec assigned);
+
+/**
+ * Collects the variables a statement writes, including the variables of the loops nested in it
+ * @param statement Statement
+ * @param assigned Where the written variables are added
+ */
+static void collect_statement_assigned(ast_node *statement, vec assigned) {
+    void (*assembly)(ast_node*) = statement->generate_assembly;
+
+    if (assembly == &assignment_assembly) {
+        vec_push(assigned, ((binary_operation_node*) statement->node)->left->node);
+    } else if (assembly == &match_assembly) {
+        match_node *match = statement->node;
+        vec_iter(match_arm *arm, match->arms, collect_assigned(arm->statements, assigned))
+        if (match->default_statements != NULL) {
+            collect_assigned(match->default_statements, assigned);
+        }
+    } else if (assembly == &for_assembly || assembly == &parallel_for_assembly) {
+        for_node *loop = statement->node;
+        vec_push(assigned, loop->var->node);
+        collect_assigned(loop->invariants, assigned);
+        collect_assigned(loop->statements, assigned);
+        vec_iter(reduction *loop_reduction, loop->reductions, vec_push(assigned, loop_reduction->target->node))
+    }
+}
+
+static void collect_assigned(vec statements, vec assigned) {
+    vec_iter(ast_node *statement, statements, collect_statement_assigned(statement, assigned))
+}
+
+static bool statements_return(vec statements);
+
+static bool statement_returns(ast_node *statement) {
+    void (*assembly)(ast_node*) = statement->generate_assembly;
+    if (assembly == &return_assembly)
+        return true;
+
+    if (assembly == &match_assembly) {
+        match_node *match = statement->node;
+        vec_iter(match_arm *arm, match->arms, {
+            if (statements_return(arm->statements))
+                return true;
+        })
+        return match->default_statements != NULL && statements_return(match->default_statements);
+    }
+
+    return (assembly == &for_assembly || assembly == &parallel_for_assembly)
+        && statements_return(((for_node*) statement->node)->statements);
+}
+
+static bool statements_return(vec statements) {
+    vec_iter(ast_node *statement, statements, {
+        if (statement_returns(statement))
+            return true;
+    })
+
+    return false;
+}
+
+/**
+ * Checks if an expression gives the same value on every iteration of a loop, it may only read variables of the
+ * function running the loop that nothing in the loop writes
+ * @param node Expression
+ * @param assigned Variables written in the loop
+ * @param body_depth Depth of the loop's outlined body, whose variables the function running the loop cannot read
+ * @return bool: whether the expression is invariant
+ */
+static bool invariant_expression(ast_node *node, vec assigned, uint32_t body_depth) {
+    void (*assembly)(ast_node*) = node->generate_assembly;
+
+    if (assembly == &literal_assembly)
+        return true;
+
+    if (assembly == &load_assembly) {
+        var_node *var = node->node;
+        if (var->scope == 0 || var->scope == body_depth)
+            return false;
+        vec_iter(var_node *written, assigned, {
+            if (written == var)
+                return false;
+        })
+        return true;
+    }
+
+    if (assembly == &call_assembly) {
+        call_node *call = node->node;
+        if (!((function_node*) call->function->node)->pure)
+            return false;
+        vec_iter(ast_node *arg, call->args, {
+            if (!invariant_expression(arg, assigned, body_depth))
+                return false;
+        })
+        return true;
+    }
+
+    binary_operation_node *op_node = node->node;
+    return arithmetic_operation(node)
+        && invariant_expression(op_node->left, assigned, body_depth)
+        && invariant_expression(op_node->right, assigned, body_depth);
+}
+
+static void collect_invariant_calls(ast_node *node, vec assigned, uint32_t body_depth, vec calls) {
+    void (*assembly)(ast_node*) = node->generate_assembly;
+    if (shared_node(node))
+        return;
+
+    if (assembly == &call_assembly) {
+        if (invariant_expression(node, assigned, body_depth)) {
+            vec_push(calls, node);
+            return;
+        }
+        vec_iter(ast_node *arg, ((call_node*) node->node)->args, collect_invariant_calls(arg, assigned, body_depth,
+            calls))
+    } else if (assembly == &assignment_assembly) {
+        collect_invariant_calls(((binary_operation_node*) node->node)->right, assigned, body_depth, calls);
+    } else if (arithmetic_operation(node)) {
+        binary_operation_node *op_node = node->node;
+        collect_invariant_calls(op_node->left, assigned, body_depth, calls);
+        collect_invariant_calls(op_node->right, assigned, body_depth, calls);
+    }
+}
+
+/**
+ * Moves pure calls that give the same value on every iteration out of a loop, into temporaries computed once when
+ * the loop runs at least once. Only calls every iteration makes before it can return are moved, so a call the loop
+ * may never reach is not made
+ * @param loop Loop
+ * @param func_node Function running the loop, the temporaries are its variables
+ */
+static void hoist_invariant_calls(for_node *loop, function_node *func_node) {
+    vec assigned = vec_new();
+    vec_push(assigned, loop->var->node);
+    collect_assigned(loop->statements, assigned);
+    uint32_t body_depth = loop->body != NULL ? loop->body->func_namespace.depth : 0;
+
+    vec calls = vec_new();
+    vec_iter(ast_node *statement, loop->statements, {
+        void (*assembly)(ast_node*) = statement->generate_assembly;
+        ast_node *expression = statement_expression(statement);
+        if (expression != NULL) {
+            collect_invariant_calls(expression, assigned, body_depth, calls);
+        } else if (assembly == &print_assembly) {
+            vec_iter(ast_node *value, statement->node, collect_invariant_calls(value, assigned, body_depth, calls))
+        } else if (assembly == &for_assembly || assembly == &parallel_for_assembly) {
+            collect_invariant_calls(((for_node*) statement->node)->start, assigned, body_depth, calls);
+            collect_invariant_calls(((for_node*) statement->node)->end, assigned, body_depth, calls);
+        }
+
+        if (statement_returns(statement))
+            break;
+    })
+
+    for (size_t i = 0; i < vec_len(calls); i++) {
+        ast_node *invariant = vec_get(calls, i);
+        if (invariant->generate_assembly != &call_assembly)
+            continue;
+
+        char name[MAX_TEMP_NAME_LEN];
+        compilation *unit = bound_compilation();
+        size_t temp_id = unit->temp_count++;
+        char *temp_name = intern_str(unit->strings, name, snprintf(name, MAX_TEMP_NAME_LEN, INVARIANT_NAME, temp_id));
+        ast_node *temp = function_node_add_var(func_node, invariant->expr_type, temp_name);
+
+        ast_node *call = malloc(sizeof(ast_node));
+        *call = *invariant;
+        ast_node *load = var_ref_copy(temp);
+        *invariant = *load;
+        free(load);
+
+        for (size_t j = i + 1; j < vec_len(calls); j++) {
+            ast_node *repeat = vec_get(calls, j);
+            if (repeat->generate_assembly == &call_assembly && equal_expressions(call, repeat)) {
+                replace_node(repeat, var_ref_copy(temp));
+            }
+        }
+        vec_push(loop->invariants, binary_operation_new(temp->expr_type, temp, call, &assignment_assembly));
+    }
+
+    vec_free(calls);
+    vec_free(assigned);
+}
+
+static void optimize_statements(vec statements, function_node *func_node) {
+    size_t i = 0;
+    while (i < vec_len(statements)) {
+        ast_node *statement = vec_get(statements, i);
+        ast_node *expression = statement_expression(statement);
+        if (expression != NULL) {
+            fold_constants(expression);
+        }
+
+        if (hoist_common_call(statements, i, func_node))
+            continue;
+
+        if (statement->generate_assembly == &match_assembly) {
+            match_node *match = statement->node;
+            vec_iter(match_arm *arm, match->arms, optimize_statements(arm->statements, func_node))
+            if (match->default_statements != NULL) {
+                optimize_statements(match->default_statements, func_node);
+            }
+        } else if (statement->generate_assembly == &print_assembly) {
+            vec_iter(ast_node *value, statement->node, fold_constants(value))
+        } else if (statement->generate_assembly == &for_assembly
+            || statement->generate_assembly == &parallel_for_assembly) {
+            for_node *loop = statement->node;
+            fold_constants(loop->start);
+            fold_constants(loop->end);
+            optimize_statements(loop->statements, loop->body != NULL ? loop->body : func_node);
+            hoist_invariant_calls(loop, func_node);
+        }
+        i++;
+    }
+}
+
+/**
+ * Optimizes a single function as soon as it is defined, before the functions after it are parsed. Only the
+ * function itself and calls to itself are assumed pure while checking its body, functions it calls that are
+ * defined later are pure only if they are declared so
+ * @param function Function to optimize
+ */
+void optimize_function(ast_node *function) {
+    function_node *func_node = function->node;
+    func_node->pure = true;
+    func_node->pure = pure_statements(func_node->statements, func_node);
+    check_declared_purity(func_node);
+    optimize_statements(func_node->statements, func_node);
+}
+
+static void mark_statements_reachable(vec statements, vec pending, bool *globals);
+
+static void mark_var_reachable(ast_node *var, bool *globals) {
+    var_node *var_ref = var->node;
+    if (var_ref->scope == 0) {
+        globals[var_ref->slot] = true;
+    }
+}
+
+/**
+ * Marks what a statement or expression needs at runtime, the globals it reads or writes and the functions it
+ * calls. Functions marked for the first time are queued so their bodies are marked too
+ * @param node Statement or expression
+ * @param pending Functions whose bodies are still to be marked
+ * @param globals Whether each global variable is needed, by slot
+ */
+static void mark_reachable(ast_node *node, vec pending, bool *globals) {
+    void (*assembly)(ast_node*) = node->generate_assembly;
+
+    if (assembly == &load_assembly) {
+        mark_var_reachable(node, globals);
+    } else if (assembly == &return_assembly) {
+        if (node->node != NULL) {
+            mark_reachable(node->node, pending, globals);
+        }
+    } else if (assembly == &print_assembly) {
+        vec_iter(ast_node *value, node->node, mark_reachable(value, pending, globals))
+    } else if (assembly == &call_assembly) {
+        call_node *call = node->node;
+        function_node *func_node = call->function->node;
+        if (func_node->extern_symbol == NULL && !func_node->reachable) {
+            func_node->reachable = true;
+            vec_push(pending, func_node);
+        }
+        vec_iter(ast_node *arg, call->args, mark_reachable(arg, pending, globals))
+    } else if (assembly == &match_assembly) {
+        match_node *match = node->node;
+        mark_reachable(match->value, pending, globals);
+        vec_iter(match_arm *arm, match->arms, mark_statements_reachable(arm->statements, pending, globals))
+        if (match->default_statements != NULL) {
+            mark_statements_reachable(match->default_statements, pending, globals);
+        }
+    } else if (assembly == &for_assembly || assembly == &parallel_for_assembly) {
+        for_node *loop = node->node;
+        mark_var_reachable(loop->var, globals);
+        mark_reachable(loop->start, pending, globals);
+        mark_reachable(loop->end, pending, globals);
+        mark_statements_reachable(loop->invariants, pending, globals);
+        mark_statements_reachable(loop->statements, pending, globals);
+        vec_iter(reduction *loop_reduction, loop->reductions, mark_var_reachable(loop_reduction->target, globals))
+    } else if (assembly == &assignment_assembly || arithmetic_operation(node)) {
+        binary_operation_node *op_node = node->node;
+        mark_reachable(op_node->left, pending, globals);
+        mark_reachable(op_node->right, pending, globals);
+    }
+}
+
+static void mark_statements_reachable(vec statements, vec pending, bool *globals) {
+    vec_iter(ast_node *statement, statements, mark_reachable(statement, pending, globals))
+}
+
+static bool reachable_definition(ast_node *definition, bool *globals) {
+    if (definition->generate_assembly == &function_assembly)
+        return ((function_node*) definition->node)->reachable;
+
+    binary_operation_node *op_node = definition->node;
+    return globals[((var_node*) op_node->left->node)->slot];
+}
+
+/**
+ * Drops the definitions nothing reachable at runtime uses before any code is generated for them, along with the
+ * string constants only they refer to. The entry module only needs main and what it reaches, every function of
+ * another module may be called by the modules importing it. Globals are private to their module and calls in
+ * their initializers are evaluated at compile time, so only globals used by a reachable function are kept
+ * @param program Program node
+ */
+static void eliminate_dead_definitions(program_node *program) {
+    vec pending = vec_new();
+    bool *globals = calloc(vec_len(program->global_namespace.vars) + 1, sizeof(bool));
+    vec_iter(ast_node *function, program->global_namespace.functions, {
+        function_node *func_node = function->node;
+        if (func_node->extern_symbol == NULL && func_node->defined
+            && (!program->entry || strcmp(func_node->name, ENTRY_FUNCTION) == 0)) {
+            func_node->reachable = true;
+            vec_push(pending, func_node);
+        }
+    })
+
+    while (vec_len(pending) > 0) {
+        function_node *func_node = vec_pop(pending);
+        mark_statements_reachable(func_node->statements, pending, globals);
+    }
+
+    size_t kept = 0;
+    vec_iter(ast_node *definition, program->definitions, {
+        if (reachable_definition(definition, globals)) {
+            vec_set(program->definitions, kept++, definition);
+        } else if (definition->generate_assembly != &function_assembly) {
+            definition->free_func(definition);
+        }
+    })
+    while (vec_len(program->definitions) > kept) {
+        vec_pop(program->definitions);
+    }
+
+    free(globals);
+    vec_free(pending);
+}
+
+/**
+ * Optimizes a program by treating calls to pure functions as values, they are evaluated at compile time when
+ * their arguments are constant, computed once when repeated within a statement and moved out of loops they do not
+ * change in. Definitions left unreachable once calls are folded are then dropped
+ * @param root Root of the program's AST
+ */
+void optimize(ast_node *root) {
+    program_node *program = root->node;
+    vec functions = program->global_namespace.functions;
+
+    infer_purity(functions);
+    vec_iter(ast_node *function, functions, {
+        function_node *func_node = function->node;
+        optimize_statements(func_node->statements, func_node);
+    })
+    eliminate_dead_definitions(program);
+}
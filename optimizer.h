@@ -0,0 +1,10 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "ast_node.h"
+
+void optimize(ast_node *root);
+
+void optimize_function(ast_node *function);
+
+#endif //OPTIMIZER_H
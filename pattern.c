@@ -9,12 +9,9 @@
 #include "regex.h"
 #include "vec.h"
 
-#define TOKEN_REGEX "\n[ \t]*|[-+*/%|&~^()=,]|\\w+|\".*?[^\\\\]\""
+#define TOKEN_REGEX "\n[ \t]*|[-+*/%|&~^()=,]|\\w+|\"([^\"\\\\\n]|\\\\.)*\""
 #define SYMBOL_REGEX "^\\w+$"
 
-static regex_t token_regex;
-static regex_t symbol_regex;
-
 void compile_regex(regex_t *regex, const char *pattern) {
     const int ret = regcomp(regex, pattern, REG_EXTENDED);
     if (ret != 0) {
@@ -23,26 +20,31 @@ void compile_regex(regex_t *regex, const char *pattern) {
     }
 }
 
-void compile_regexps() {
-    compile_regex(&token_regex, TOKEN_REGEX);
-    compile_regex(&symbol_regex, SYMBOL_REGEX);
+/**
+ * Compiles the patterns tokens and symbols are matched with, they are only read afterwards so every compilation
+ * in the process uses the same ones
+ * @param shared Shared compiler state the patterns are stored in
+ */
+void compile_patterns(compiler_shared *shared) {
+    compile_regex(&shared->token_regex, TOKEN_REGEX);
+    compile_regex(&shared->symbol_regex, SYMBOL_REGEX);
 }
 
-void free_regexps() {
-    regfree(&token_regex);
-    regfree(&symbol_regex);
+void free_patterns(compiler_shared *shared) {
+    regfree(&shared->token_regex);
+    regfree(&shared->symbol_regex);
 }
 
-bool next_token(char *start, regmatch_t *match) {
-    return regexec(&token_regex, start, 1, match, 0) == 0;
+bool next_token(compiler_shared *shared, char *start, regmatch_t *match) {
+    return regexec(&shared->token_regex, start, 1, match, 0) == 0;
 }
 
 bool full_match(regex_t *regex, char *str) {
     return regexec(regex, str, 0, NULL, 0) == 0;
 }
 
-bool valid_symbol(char *symbol) {
-    return full_match(&symbol_regex, symbol);
+bool valid_symbol(compiler_shared *shared, char *symbol) {
+    return full_match(&shared->symbol_regex, symbol);
 }
 
 bool valid_i64_literal(char *literal) {
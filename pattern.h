@@ -4,13 +4,15 @@
 #include <regex.h>
 #include <stdbool.h>
 
-void compile_regexps();
+#include "context.h"
 
-void free_regexps();
+void compile_patterns(compiler_shared *shared);
 
-bool next_token(char *start, regmatch_t *match);
+void free_patterns(compiler_shared *shared);
 
-bool valid_symbol(char *symbol);
+bool next_token(compiler_shared *shared, char *start, regmatch_t *match);
+
+bool valid_symbol(compiler_shared *shared, char *symbol);
 
 bool valid_i64_literal(char *literal);
 
@@ -0,0 +1,280 @@
+#include "pipeline.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "span.h"
+#include "tokenizer.h"
+
+#define LINE_QUEUE_CAPACITY 256
+#define SPINS_BEFORE_YIELD 64
+#define MIN_THREADED_LEX_SIZE (16 << 10)
+
+/**
+ * Reads the lines of a source file within a byte range, the buffers are reused from line to line
+ */
+typedef struct line_reader_s {
+    compiler_shared *shared;
+    interner *strings;
+    FILE *source;
+    bool top_level_only;
+    size_t line_offset;
+    size_t end;
+    char *contents;
+    size_t capacity;
+    char *text;
+    size_t text_capacity;
+} line_reader;
+
+/**
+ * Bounded single producer single consumer queue of lexed lines, the lexer thread only writes tail and the parser
+ * only writes head, so neither side takes a lock. A synchronous queue has no lexer thread and lexes each line as
+ * the parser takes it
+ */
+struct line_queue_s {
+    line_reader reader;
+    bool synchronous;
+    pthread_t lexer;
+    _Alignas(64) atomic_size_t head;
+    _Alignas(64) atomic_size_t tail;
+    lexed_line lines[LINE_QUEUE_CAPACITY];
+};
+
+static void wait_briefly(size_t *spins) {
+    if (++*spins > SPINS_BEFORE_YIELD) {
+        sched_yield();
+    }
+}
+
+static void push_line(line_queue *queue, vec tokenv, vec token_offsets) {
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    size_t spins = 0;
+    while (tail - atomic_load_explicit(&queue->head, memory_order_acquire) == LINE_QUEUE_CAPACITY) {
+        wait_briefly(&spins);
+    }
+
+    lexed_line *slot = &queue->lines[tail % LINE_QUEUE_CAPACITY];
+    slot->tokenv = tokenv;
+    slot->token_offsets = token_offsets;
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+}
+
+static bool top_level(char *contents) {
+    return *contents != ' ' && *contents != '\t' && *contents != '\n' && *contents != '\r' && *contents != '\0';
+}
+
+static void open_reader(line_reader *reader, compiler_shared *shared, interner *strings, char *filename,
+    bool top_level_only, size_t start, size_t end) {
+
+    reader->shared = shared;
+    reader->strings = strings;
+    reader->source = open_source(filename);
+    if (reader->source == NULL) {
+        fprintf(stderr, "fatal error: cannot open %s\n", filename);
+        exit(1);
+    }
+
+    reader->top_level_only = top_level_only;
+    reader->line_offset = start;
+    reader->end = end;
+    if (start != 0 && fseek(reader->source, (long) start, SEEK_SET) != 0) {
+        reader->line_offset = end;
+    }
+    reader->contents = NULL;
+    reader->capacity = 0;
+    reader->text = NULL;
+    reader->text_capacity = 0;
+}
+
+/**
+ * Reads and tokenizes the next line within the reader's range
+ * @param reader Line reader
+ * @param next Where the tokens of the line and the byte offset of each token are stored
+ * @return bool: false once the range is exhausted
+ */
+static bool read_line(line_reader *reader, lexed_line *next) {
+    ssize_t len;
+    for (; reader->line_offset < reader->end; reader->line_offset += len) {
+        len = getline(&reader->contents, &reader->capacity, reader->source);
+        if (len == -1)
+            return false;
+        if (reader->top_level_only && !top_level(reader->contents))
+            continue;
+
+        size_t text_len = len - (len > 0 && reader->contents[len - 1] == '\n');
+        if (text_len + 2 > reader->text_capacity) {
+            reader->text_capacity = text_len + 2;
+            reader->text = realloc(reader->text, reader->text_capacity);
+        }
+        reader->text[0] = '\n';
+        memcpy(reader->text + 1, reader->contents, text_len);
+        reader->text[text_len + 1] = '\0';
+
+        next->token_offsets = vec_new();
+        next->tokenv = tokenize_line(reader->shared, reader->strings, reader->text, reader->line_offset == 0,
+            reader->line_offset, next->token_offsets);
+        reader->line_offset += len;
+        return true;
+    }
+    return false;
+}
+
+static void close_reader(line_reader *reader) {
+    free(reader->contents);
+    free(reader->text);
+    fclose(reader->source);
+}
+
+/**
+ * Reads the lines of the source one at a time and pushes each tokenized line, the end of the range is marked by
+ * a line without tokens. Only the lines waiting in the queue are held in memory
+ * @param arg Line queue to fill
+ * @return void*: NULL
+ */
+static void *lex_lines(void *arg) {
+    line_queue *queue = arg;
+    lexed_line next;
+    while (read_line(&queue->reader, &next)) {
+        push_line(queue, next.tokenv, next.token_offsets);
+    }
+
+    push_line(queue, NULL, NULL);
+    close_reader(&queue->reader);
+    return NULL;
+}
+
+/**
+ * Records a lexer as open in the bound compilation until it is finished, so an abandoned compilation can stop it
+ * @param queue Line queue of the lexer
+ * @return line_queue*: the queue
+ */
+static line_queue *track_lexer(line_queue *queue) {
+    compilation *unit = bound_compilation();
+    if (unit->lexers == NULL) {
+        unit->lexers = vec_new();
+    }
+    vec_push(unit->lexers, queue);
+    return queue;
+}
+
+static size_t source_size(FILE *source) {
+    long size = -1;
+    if (fseek(source, 0, SEEK_END) == 0) {
+        size = ftell(source);
+    }
+    rewind(source);
+    return size < 0 ? SIZE_MAX : size;
+}
+
+/**
+ * Starts lexing a file on its own thread, the parser takes lines from the queue while later lines are lexed. The
+ * lexer thread only reads the shared compiler state and interns into the compilation's interner, which takes
+ * strings from several threads at once. A small file is lexed as the parser takes each line instead,
+ * starting a thread for it would cost more than the overlap saves. The lexer is a dedicated thread rather than a
+ * worker pool task: it blocks while the queue is full until the parser catches up, which would hold a worker, and a
+ * module compiled in a forked child has no pool workers at all. A compilation without a core to spare for it, such
+ * as a module compiled alongside as many others as the build has workers, lexes as the parser takes each line
+ * @param shared Shared compiler state
+ * @param strings Interner of the compilation
+ * @param filename Name of the source file
+ * @param top_level_only Whether to skip indented lines without tokenizing them
+ * @param threaded Whether a large file may be lexed on a thread of its own
+ * @return line_queue*: queue of lexed lines
+ */
+line_queue *start_lexer(compiler_shared *shared, interner *strings, char *filename, bool top_level_only,
+    bool threaded) {
+
+    line_queue *queue = malloc(sizeof(line_queue));
+    open_reader(&queue->reader, shared, strings, filename, top_level_only, 0, SIZE_MAX);
+    queue->synchronous = !threaded || source_size(queue->reader.source) < MIN_THREADED_LEX_SIZE;
+    if (queue->synchronous)
+        return track_lexer(queue);
+
+    atomic_store(&queue->head, 0);
+    atomic_store(&queue->tail, 0);
+
+    if (pthread_create(&queue->lexer, NULL, &lex_lines, queue) != 0) {
+        fprintf(stderr, "fatal error: cannot start lexer thread\n");
+        exit(1);
+    }
+    return track_lexer(queue);
+}
+
+/**
+ * Prepares to lex the lines of a file within a byte range. A range is a single function body, short enough that
+ * starting a thread for it costs more than the overlap saves, so each line is lexed when the parser takes it
+ * @param shared Shared compiler state
+ * @param strings Interner of the compilation
+ * @param filename Name of the source file
+ * @param start Byte offset of the first line
+ * @param end Byte offset after the last line
+ * @return line_queue*: queue of lexed lines
+ */
+line_queue *start_range_lexer(compiler_shared *shared, interner *strings, char *filename, size_t start,
+    size_t end) {
+
+    line_queue *queue = malloc(sizeof(line_queue));
+    open_reader(&queue->reader, shared, strings, filename, false, start, end);
+    queue->synchronous = true;
+    return track_lexer(queue);
+}
+
+/**
+ * Takes the next lexed line from the queue, waiting for the lexer if it is behind
+ * @param queue Line queue
+ * @param next Where the line is stored, its tokens and their offsets are owned by the caller
+ * @return bool: false once the file is exhausted
+ */
+bool next_lexed_line(line_queue *queue, lexed_line *next) {
+    if (queue->synchronous)
+        return read_line(&queue->reader, next);
+
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    size_t spins = 0;
+    while (atomic_load_explicit(&queue->tail, memory_order_acquire) == head) {
+        wait_briefly(&spins);
+    }
+
+    *next = queue->lines[head % LINE_QUEUE_CAPACITY];
+    if (next->tokenv == NULL)
+        return false;
+
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return true;
+}
+
+/**
+ * Closes a lexer once its lines were taken, lexers are finished in the reverse order they were started
+ * @param queue Line queue
+ */
+void finish_lexer(line_queue *queue) {
+    vec_pop(bound_compilation()->lexers);
+    if (queue->synchronous) {
+        close_reader(&queue->reader);
+    } else {
+        pthread_join(queue->lexer, NULL);
+    }
+    free(queue);
+}
+
+/**
+ * Finishes the lexers of the bound compilation after it was abandoned, a lexer thread is only stopped once it
+ * reached the end of its file so the lines it has left are taken and dropped
+ */
+void cancel_lexers() {
+    compilation *unit = bound_compilation();
+    while (unit->lexers != NULL && vec_len(unit->lexers) > 0) {
+        line_queue *queue = vec_peek_end(unit->lexers);
+        lexed_line next;
+        while (!queue->synchronous && next_lexed_line(queue, &next)) {
+            vec_free(next.tokenv);
+            vec_free(next.token_offsets);
+        }
+        finish_lexer(queue);
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "context.h"
+#include "vec.h"
+
+typedef struct lexed_line_s {
+    vec tokenv;
+    vec token_offsets;
+} lexed_line;
+
+typedef struct line_queue_s line_queue;
+
+line_queue *start_lexer(compiler_shared *shared, interner *strings, char *filename, bool top_level_only,
+    bool threaded);
+
+line_queue *start_range_lexer(compiler_shared *shared, interner *strings, char *filename, size_t start,
+    size_t end);
+
+bool next_lexed_line(line_queue *queue, lexed_line *next);
+
+void finish_lexer(line_queue *queue);
+
+void cancel_lexers();
+
+#endif //PIPELINE_H
@@ -0,0 +1,435 @@
+#include "pool.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define INITIAL_DEQUE_CAPACITY 64
+#define SCRATCH_CHUNK_SIZE (64 << 10)
+#define SCRATCH_ALIGNMENT 16
+#define STEAL_ATTEMPTS 4
+
+typedef struct task_s {
+    task_fn fn;
+    void *arg;
+    task_group *group;
+    struct task_s *next;
+} task;
+
+typedef struct deque_array_s {
+    int64_t capacity;
+    struct deque_array_s *retired;
+    _Atomic(task*) slots[];
+} deque_array;
+
+/**
+ * Chase-Lev deque, the owning worker pushes and takes at the bottom while other workers steal from the top
+ */
+typedef struct deque_s {
+    _Atomic int64_t top;
+    _Atomic int64_t bottom;
+    _Atomic(deque_array*) array;
+} deque;
+
+typedef struct scratch_chunk_s {
+    struct scratch_chunk_s *next;
+    size_t size;
+    size_t used;
+    _Alignas(SCRATCH_ALIGNMENT) char bytes[];
+} scratch_chunk;
+
+typedef struct worker_s {
+    pool *owner;
+    size_t index;
+    deque tasks;
+    scratch_chunk *scratch;
+    pthread_t thread;
+    unsigned int seed;
+} worker;
+
+typedef struct injection_queue_s {
+    pthread_mutex_t lock;
+    task *head;
+    task *tail;
+} injection_queue;
+
+/**
+ * Workers running the tasks of one build, nothing is shared with the pools of other builds so builds on different
+ * threads of a process run independently. Idle workers and threads waiting on a task group sleep on the same
+ * condition, it is signalled when a task is queued or the last task of a group finishes
+ */
+struct pool_s {
+    worker *workers;
+    size_t worker_count;
+    injection_queue injected;
+    atomic_size_t queued;
+    atomic_size_t sleeping;
+    atomic_bool shutting_down;
+    pthread_mutex_t sleep_lock;
+    pthread_cond_t wake;
+};
+
+static __thread worker *current;
+
+static deque_array *deque_array_new(int64_t capacity) {
+    deque_array *array = malloc(sizeof(deque_array) + capacity * sizeof(_Atomic(task*)));
+    array->capacity = capacity;
+    array->retired = NULL;
+    return array;
+}
+
+/**
+ * Doubles the capacity of a deque, the old array stays alive until the pool is freed since thieves may still
+ * be reading from it
+ * @param tasks Deque to grow
+ * @param array Current array of the deque
+ * @param top Index of the first task
+ * @param bottom Index after the last task
+ * @return deque_array*: the new array
+ */
+static deque_array *deque_grow(deque *tasks, deque_array *array, int64_t top, int64_t bottom) {
+    deque_array *grown = deque_array_new(array->capacity << 1);
+    for (int64_t i = top; i < bottom; i++) {
+        task *t = atomic_load_explicit(&array->slots[i % array->capacity], memory_order_relaxed);
+        atomic_store_explicit(&grown->slots[i % grown->capacity], t, memory_order_relaxed);
+    }
+    grown->retired = array;
+    atomic_store_explicit(&tasks->array, grown, memory_order_release);
+    return grown;
+}
+
+static void deque_push(deque *tasks, task *t) {
+    int64_t bottom = atomic_load_explicit(&tasks->bottom, memory_order_relaxed);
+    int64_t top = atomic_load_explicit(&tasks->top, memory_order_acquire);
+    deque_array *array = atomic_load_explicit(&tasks->array, memory_order_relaxed);
+    if (bottom - top > array->capacity - 1) {
+        array = deque_grow(tasks, array, top, bottom);
+    }
+
+    atomic_store_explicit(&array->slots[bottom % array->capacity], t, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&tasks->bottom, bottom + 1, memory_order_relaxed);
+}
+
+static task *deque_take(deque *tasks) {
+    int64_t bottom = atomic_load_explicit(&tasks->bottom, memory_order_relaxed) - 1;
+    deque_array *array = atomic_load_explicit(&tasks->array, memory_order_relaxed);
+    atomic_store_explicit(&tasks->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t top = atomic_load_explicit(&tasks->top, memory_order_relaxed);
+
+    if (top > bottom) {
+        atomic_store_explicit(&tasks->bottom, bottom + 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    task *t = atomic_load_explicit(&array->slots[bottom % array->capacity], memory_order_relaxed);
+    if (top == bottom) {
+        if (!atomic_compare_exchange_strong_explicit(&tasks->top, &top, top + 1, memory_order_seq_cst,
+            memory_order_relaxed)) {
+            t = NULL;
+        }
+        atomic_store_explicit(&tasks->bottom, bottom + 1, memory_order_relaxed);
+    }
+    return t;
+}
+
+static task *deque_steal(deque *tasks) {
+    int64_t top = atomic_load_explicit(&tasks->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t bottom = atomic_load_explicit(&tasks->bottom, memory_order_acquire);
+    if (top >= bottom)
+        return NULL;
+
+    deque_array *array = atomic_load_explicit(&tasks->array, memory_order_acquire);
+    task *t = atomic_load_explicit(&array->slots[top % array->capacity], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&tasks->top, &top, top + 1, memory_order_seq_cst,
+        memory_order_relaxed))
+        return NULL;
+    return t;
+}
+
+static task *injection_pop(injection_queue *injected) {
+    pthread_mutex_lock(&injected->lock);
+    task *t = injected->head;
+    if (t != NULL) {
+        injected->head = t->next;
+        injected->tail = injected->head == NULL ? NULL : injected->tail;
+    }
+    pthread_mutex_unlock(&injected->lock);
+    return t;
+}
+
+/**
+ * Finds a task for a worker, its own deque comes first, then the injection queue, then stealing from the other
+ * workers of its pool starting at a random one
+ * @param self Worker
+ * @return task*: the task, NULL if none was found
+ */
+static task *find_task(worker *self) {
+    pool *owner = self->owner;
+    task *t = deque_take(&self->tasks);
+    if (t == NULL) {
+        t = injection_pop(&owner->injected);
+    }
+
+    for (size_t attempt = 0; t == NULL && attempt < STEAL_ATTEMPTS && atomic_load(&owner->queued) > 0; attempt++) {
+        size_t start = rand_r(&self->seed) % owner->worker_count;
+        for (size_t i = 0; t == NULL && i < owner->worker_count; i++) {
+            size_t victim = (start + i) % owner->worker_count;
+            t = victim == self->index ? NULL : deque_steal(&owner->workers[victim].tasks);
+        }
+    }
+
+    if (t != NULL) {
+        atomic_fetch_sub(&owner->queued, 1);
+    }
+    return t;
+}
+
+static void wake_workers(pool *owner) {
+    if (atomic_load(&owner->sleeping) == 0)
+        return;
+
+    pthread_mutex_lock(&owner->sleep_lock);
+    pthread_cond_broadcast(&owner->wake);
+    pthread_mutex_unlock(&owner->sleep_lock);
+}
+
+/**
+ * Runs a task, finishing the last task of a group wakes the threads sleeping until the group is done
+ * @param t Task
+ */
+static void run_task(task *t) {
+    task_group *group = t->group;
+    pool *owner = group->owner;
+    t->fn(t->arg);
+    free(t);
+    if (atomic_fetch_sub(&group->pending, 1) == 1) {
+        wake_workers(owner);
+    }
+}
+
+/**
+ * Sleeps until a task is queued on the pool, the pool shuts down or, when waiting on a group, the group is done.
+ * The counters are checked under the lock the waker takes to signal, so no wakeup is missed
+ * @param owner Pool
+ * @param group Group being waited on, NULL for an idle worker
+ */
+static void sleep_until_work(pool *owner, task_group *group) {
+    pthread_mutex_lock(&owner->sleep_lock);
+    atomic_fetch_add(&owner->sleeping, 1);
+    while (atomic_load(&owner->queued) == 0 && !atomic_load(&owner->shutting_down)
+        && (group == NULL || atomic_load(&group->pending) > 0)) {
+        pthread_cond_wait(&owner->wake, &owner->sleep_lock);
+    }
+    atomic_fetch_sub(&owner->sleeping, 1);
+    pthread_mutex_unlock(&owner->sleep_lock);
+}
+
+static void *worker_loop(void *arg) {
+    current = arg;
+    pool *owner = current->owner;
+
+    while (!atomic_load(&owner->shutting_down)) {
+        task *t = find_task(current);
+        if (t != NULL) {
+            run_task(t);
+        } else {
+            sleep_until_work(owner, NULL);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Starts a worker pool for a build, the calling thread becomes worker 0 and runs tasks while it waits on a task
+ * group, so only workers - 1 threads are started. Module builds are its only tasks: each module compiles in a
+ * forked child, which keeps only the thread that forked it, so the phases within a module never run on the pool
+ * @param count Number of workers, at least 1
+ * @return pool*: the pool, the calling thread is its worker 0 until it is freed
+ */
+pool *pool_new(size_t count) {
+    pool *owner = malloc(sizeof(pool));
+    owner->worker_count = count < 1 ? 1 : count;
+    owner->workers = calloc(owner->worker_count, sizeof(worker));
+    owner->injected = (injection_queue) {.head = NULL, .tail = NULL};
+    pthread_mutex_init(&owner->injected.lock, NULL);
+    atomic_store(&owner->queued, 0);
+    atomic_store(&owner->sleeping, 0);
+    atomic_store(&owner->shutting_down, false);
+    pthread_mutex_init(&owner->sleep_lock, NULL);
+    pthread_cond_init(&owner->wake, NULL);
+
+    for (size_t i = 0; i < owner->worker_count; i++) {
+        worker *self = &owner->workers[i];
+        self->owner = owner;
+        self->index = i;
+        atomic_store(&self->tasks.array, deque_array_new(INITIAL_DEQUE_CAPACITY));
+        self->seed = i + 1;
+    }
+    current = &owner->workers[0];
+    for (size_t i = 1; i < owner->worker_count; i++) {
+        if (pthread_create(&owner->workers[i].thread, NULL, &worker_loop, &owner->workers[i]) != 0) {
+            fprintf(stderr, "fatal error: cannot start worker thread\n");
+            exit(1);
+        }
+    }
+    return owner;
+}
+
+void pool_free(pool *owner) {
+    pthread_mutex_lock(&owner->sleep_lock);
+    atomic_store(&owner->shutting_down, true);
+    pthread_cond_broadcast(&owner->wake);
+    pthread_mutex_unlock(&owner->sleep_lock);
+
+    for (size_t i = 1; i < owner->worker_count; i++) {
+        pthread_join(owner->workers[i].thread, NULL);
+    }
+
+    worker *workers = owner->workers;
+    for (size_t i = 0; i < owner->worker_count; i++) {
+        deque_array *array = atomic_load(&workers[i].tasks.array);
+        while (array != NULL) {
+            deque_array *retired = array->retired;
+            free(array);
+            array = retired;
+        }
+
+        scratch_chunk *chunk = workers[i].scratch;
+        while (chunk != NULL) {
+            scratch_chunk *next = chunk->next;
+            free(chunk);
+            chunk = next;
+        }
+    }
+
+    pthread_mutex_destroy(&owner->injected.lock);
+    pthread_mutex_destroy(&owner->sleep_lock);
+    pthread_cond_destroy(&owner->wake);
+    free(workers);
+    free(owner);
+    current = NULL;
+}
+
+size_t pool_workers(pool *owner) {
+    return owner->worker_count;
+}
+
+size_t pool_worker_index() {
+    return current->index;
+}
+
+void task_group_init(task_group *group, pool *owner) {
+    group->owner = owner;
+    atomic_store(&group->pending, 0);
+}
+
+static task *task_new(task_group *group, task_fn fn, void *arg) {
+    task *t = malloc(sizeof(task));
+    t->fn = fn;
+    t->arg = arg;
+    t->group = group;
+    t->next = NULL;
+    atomic_fetch_add(&group->pending, 1);
+    return t;
+}
+
+/**
+ * Runs a task on the pool, it goes on the calling worker's deque so it runs next on this worker unless another
+ * worker steals it first
+ * @param group Group the task belongs to
+ * @param fn Function to run
+ * @param arg Argument passed to the function
+ */
+void pool_spawn(task_group *group, task_fn fn, void *arg) {
+    deque_push(&current->tasks, task_new(group, fn, arg));
+    atomic_fetch_add(&group->owner->queued, 1);
+    wake_workers(group->owner);
+}
+
+/**
+ * Runs a task on the pool through the shared injection queue, injected tasks start in the order they were
+ * injected
+ * @param group Group the task belongs to
+ * @param fn Function to run
+ * @param arg Argument passed to the function
+ */
+void pool_inject(task_group *group, task_fn fn, void *arg) {
+    task *t = task_new(group, fn, arg);
+    injection_queue *injected = &group->owner->injected;
+
+    pthread_mutex_lock(&injected->lock);
+    if (injected->tail == NULL) {
+        injected->head = t;
+    } else {
+        injected->tail->next = t;
+    }
+    injected->tail = t;
+    pthread_mutex_unlock(&injected->lock);
+
+    atomic_fetch_add(&group->owner->queued, 1);
+    wake_workers(group->owner);
+}
+
+/**
+ * Waits until every task of a group finished, the waiting worker runs pool tasks in the meantime and sleeps when
+ * there is nothing to run, until a task is queued or the group's last task finishes
+ * @param group Group to wait for, the calling thread must be a worker of its pool
+ */
+void task_group_wait(task_group *group) {
+    while (atomic_load(&group->pending) > 0) {
+        task *t = find_task(current);
+        if (t != NULL) {
+            run_task(t);
+        } else {
+            sleep_until_work(group->owner, group);
+        }
+    }
+}
+
+/**
+ * Allocates scratch memory from the calling worker's arena, it stays valid until the worker resets its arena
+ * @param size Size in bytes
+ * @return void*: the allocation aligned to 16 bytes
+ */
+void *scratch_alloc(size_t size) {
+    worker *self = current;
+    size = (size + SCRATCH_ALIGNMENT - 1) & ~(size_t) (SCRATCH_ALIGNMENT - 1);
+
+    scratch_chunk *chunk = self->scratch;
+    if (chunk == NULL || chunk->size - chunk->used < size) {
+        size_t chunk_size = size > SCRATCH_CHUNK_SIZE ? size : SCRATCH_CHUNK_SIZE;
+        chunk = malloc(sizeof(scratch_chunk) + chunk_size);
+        chunk->next = self->scratch;
+        chunk->size = chunk_size;
+        chunk->used = 0;
+        self->scratch = chunk;
+    }
+
+    void *allocation = chunk->bytes + chunk->used;
+    chunk->used += size;
+    return allocation;
+}
+
+/**
+ * Frees everything allocated from the calling worker's arena, its most recent chunk is kept for reuse
+ */
+void scratch_reset() {
+    worker *self = current;
+    if (self->scratch == NULL)
+        return;
+
+    scratch_chunk *chunk = self->scratch->next;
+    while (chunk != NULL) {
+        scratch_chunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    self->scratch->next = NULL;
+    self->scratch->used = 0;
+}
@@ -0,0 +1,36 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+typedef void (*task_fn)(void *arg);
+
+typedef struct pool_s pool;
+
+typedef struct task_group_s {
+    pool *owner;
+    atomic_size_t pending;
+} task_group;
+
+pool *pool_new(size_t workers);
+
+void pool_free(pool *workers);
+
+size_t pool_workers(pool *workers);
+
+size_t pool_worker_index();
+
+void task_group_init(task_group *group, pool *owner);
+
+void pool_spawn(task_group *group, task_fn fn, void *arg);
+
+void pool_inject(task_group *group, task_fn fn, void *arg);
+
+void task_group_wait(task_group *group);
+
+void *scratch_alloc(size_t size);
+
+void scratch_reset();
+
+#endif //POOL_H
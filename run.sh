@@ -1,3 +1 @@
-nasm -f elf64 main.asm -o main.o
-ld main.o -o main
-./main
+./compiler -o main "$@" && ./main
@@ -0,0 +1,226 @@
+#include "runtime.h"
+
+#include <stdint.h>
+
+#include "syscall.h"
+#include "thread.h"
+
+#define HEADER_SIZE 16
+#define ALIGNMENT 16
+#define PAGE_SIZE 4096
+#define SLAB_SIZE (1 << 20)
+#define ARENA_CHUNK_SIZE (64 << 10)
+
+#define SMALL_CLASSES 8
+#define SMALL_CLASS_SHIFT 4
+#define MAX_SMALL_SIZE 128
+#define MAX_SMALL_SIZE_SHIFT 7
+#define STEPS_PER_DOUBLING_SHIFT 2
+#define MAX_CLASS_SIZE 32768
+#define LARGE_CLASS RT_SIZE_CLASSES
+
+#define MAP_FLAGS (MAP_PRIVATE | MAP_ANONYMOUS)
+
+struct rt_block_s {
+    uint64_t size_class;
+    uint64_t mapped_size;
+    rt_block *next;
+};
+
+typedef struct arena_chunk_s {
+    struct arena_chunk_s *next;
+    uint64_t size;
+} arena_chunk;
+
+typedef struct rt_arena_s {
+    arena_chunk *chunks;
+    char *next;
+    char *end;
+} rt_arena;
+
+static uint64_t round_up(uint64_t size, uint64_t alignment) {
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+/**
+ * Gets the size class of an allocation, classes are 16 bytes apart up to 128 bytes and then four classes per
+ * doubling up to 32KB, so at most a fifth of a block is wasted
+ * @param size Requested size
+ * @return uint64_t: index of the smallest class the size fits in
+ */
+static uint64_t size_class(uint64_t size) {
+    if (size <= MAX_SMALL_SIZE)
+        return size == 0 ? 0 : ((size + ALIGNMENT - 1) >> SMALL_CLASS_SHIFT) - 1;
+
+    uint64_t exponent = 63 - __builtin_clzll(size - 1);
+    uint64_t step = ((size - 1) >> (exponent - STEPS_PER_DOUBLING_SHIFT)) - (1 << STEPS_PER_DOUBLING_SHIFT);
+    return SMALL_CLASSES + ((exponent - MAX_SMALL_SIZE_SHIFT) << STEPS_PER_DOUBLING_SHIFT) + step;
+}
+
+static uint64_t class_size(uint64_t size_class) {
+    if (size_class < SMALL_CLASSES)
+        return (size_class + 1) << SMALL_CLASS_SHIFT;
+
+    uint64_t doubling = (size_class - SMALL_CLASSES) >> STEPS_PER_DOUBLING_SHIFT;
+    uint64_t step = (size_class - SMALL_CLASSES) & ((1 << STEPS_PER_DOUBLING_SHIFT) - 1);
+    uint64_t steps = (1 << STEPS_PER_DOUBLING_SHIFT) + step + 1;
+    return steps << (doubling + MAX_SMALL_SIZE_SHIFT - STEPS_PER_DOUBLING_SHIFT);
+}
+
+static void *map(uint64_t size) {
+    void *address = rt_mmap(size, PROT_READ | PROT_WRITE, MAP_FLAGS);
+    return (long) address < 0 ? 0 : address;
+}
+
+/**
+ * Allocates a block of at least size bytes aligned to 16 bytes. Small blocks come from the calling thread's free
+ * list for their size class, refilled by carving up a slab, large blocks are mapped on their own
+ * @param size Size in bytes
+ * @return int64_t: address of the block, 0 if out of memory
+ */
+int64_t rt_alloc(int64_t size) {
+    if (size < 0)
+        return 0;
+
+    if (size > MAX_CLASS_SIZE) {
+        uint64_t mapped_size = round_up(size + HEADER_SIZE, PAGE_SIZE);
+        rt_block *block = map(mapped_size);
+        if (block == 0)
+            return 0;
+        block->size_class = LARGE_CLASS;
+        block->mapped_size = mapped_size;
+        return (int64_t) block + HEADER_SIZE;
+    }
+
+    rt_thread *thread = rt_thread_self();
+    uint64_t block_class = size_class(size);
+    rt_block *block = thread->free_lists[block_class];
+    if (block != 0) {
+        thread->free_lists[block_class] = block->next;
+        return (int64_t) block + HEADER_SIZE;
+    }
+
+    uint64_t block_size = class_size(block_class) + HEADER_SIZE;
+    if (thread->slab_left < block_size) {
+        char *slab = map(SLAB_SIZE);
+        if (slab == 0)
+            return 0;
+        thread->slab = slab;
+        thread->slab_left = SLAB_SIZE;
+    }
+
+    block = (rt_block*) thread->slab;
+    thread->slab += block_size;
+    thread->slab_left -= block_size;
+    block->size_class = block_class;
+    return (int64_t) block + HEADER_SIZE;
+}
+
+/**
+ * Frees a block, small blocks go on the calling thread's free list and large blocks are unmapped
+ * @param address Address returned by rt_alloc, 0 is ignored
+ * @return int64_t: 0
+ */
+int64_t rt_free(int64_t address) {
+    if (address == 0)
+        return 0;
+
+    rt_block *block = (rt_block*) (address - HEADER_SIZE);
+    if (block->size_class == LARGE_CLASS) {
+        rt_munmap(block, block->mapped_size);
+        return 0;
+    }
+
+    rt_thread *thread = rt_thread_self();
+    block->next = thread->free_lists[block->size_class];
+    thread->free_lists[block->size_class] = block;
+    return 0;
+}
+
+/**
+ * Creates an arena, allocations from it are freed all at once. An arena must only be used by one thread at a time
+ * @return int64_t: address of the arena, 0 if out of memory
+ */
+int64_t rt_arena_new() {
+    rt_arena *arena = (rt_arena*) rt_alloc(sizeof(rt_arena));
+    if (arena != 0) {
+        arena->chunks = 0;
+        arena->next = 0;
+        arena->end = 0;
+    }
+    return (int64_t) arena;
+}
+
+/**
+ * Allocates from an arena by bumping a pointer, a new chunk is mapped when the current one is full
+ * @param address Address of the arena
+ * @param size Size in bytes
+ * @return int64_t: address of the allocation aligned to 16 bytes, 0 if out of memory
+ */
+int64_t rt_arena_alloc(int64_t address, int64_t size) {
+    rt_arena *arena = (rt_arena*) address;
+    if (size < 0)
+        return 0;
+
+    uint64_t aligned_size = round_up(size, ALIGNMENT);
+    if ((uint64_t) (arena->end - arena->next) < aligned_size) {
+        uint64_t chunk_size = round_up(aligned_size + sizeof(arena_chunk), PAGE_SIZE);
+        chunk_size = chunk_size < ARENA_CHUNK_SIZE ? ARENA_CHUNK_SIZE : chunk_size;
+        arena_chunk *chunk = map(chunk_size);
+        if (chunk == 0)
+            return 0;
+
+        chunk->next = arena->chunks;
+        chunk->size = chunk_size;
+        arena->chunks = chunk;
+        arena->next = (char*) chunk + sizeof(arena_chunk);
+        arena->end = (char*) chunk + chunk_size;
+    }
+
+    char *allocation = arena->next;
+    arena->next += aligned_size;
+    return (int64_t) allocation;
+}
+
+/**
+ * Frees everything allocated from an arena, its most recent chunk is kept for reuse
+ * @param address Address of the arena
+ * @return int64_t: 0
+ */
+int64_t rt_arena_reset(int64_t address) {
+    rt_arena *arena = (rt_arena*) address;
+    if (arena->chunks == 0)
+        return 0;
+
+    arena_chunk *chunk = arena->chunks->next;
+    while (chunk != 0) {
+        arena_chunk *next = chunk->next;
+        rt_munmap(chunk, chunk->size);
+        chunk = next;
+    }
+
+    arena->chunks->next = 0;
+    arena->next = (char*) arena->chunks + sizeof(arena_chunk);
+    return 0;
+}
+
+int64_t rt_arena_free(int64_t address) {
+    rt_arena *arena = (rt_arena*) address;
+    arena_chunk *chunk = arena->chunks;
+    while (chunk != 0) {
+        arena_chunk *next = chunk->next;
+        rt_munmap(chunk, chunk->size);
+        chunk = next;
+    }
+
+    return rt_free(address);
+}
+
+int64_t rt_load(int64_t address) {
+    return *(int64_t*) address;
+}
+
+int64_t rt_store(int64_t address, int64_t value) {
+    *(int64_t*) address = value;
+    return value;
+}
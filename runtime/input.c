@@ -0,0 +1,167 @@
+#include "runtime.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "syscall.h"
+
+#define STDIN 0
+#define READ_CHUNK_SIZE (1 << 20)
+#define MAX_INPUT_RESERVATION (1L << 40)
+#define MIN_INPUT_RESERVATION (1L << 26)
+#define MAX_I64_LEN 20
+#define SWAR_DIGITS 8
+#define BYTE_BITS 3
+
+#define ASCII_ZEROS 0x3030303030303030
+#define ABOVE_NINE 0x4646464646464646
+#define HIGH_BITS 0x8080808080808080
+#define LOW_NIBBLES 0x0f0f0f0f0f0f0f0f
+#define LOW_BYTES 0x00ff00ff00ff00ff
+#define LOW_HALVES 0x0000ffff0000ffff
+#define COMBINE_DIGITS (1 + (10 << 8))
+#define COMBINE_PAIRS (1 + (100 << 16))
+#define COMBINE_QUADS (1 + (10000L << 32))
+
+typedef struct input_buffer_s {
+    char *bytes;
+    uint64_t reserved;
+    uint64_t len;
+    uint64_t pos;
+    bool done;
+} input_buffer;
+
+static input_buffer input;
+
+static const uint64_t powers_of_ten[SWAR_DIGITS + 1] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000
+};
+
+/**
+ * Reserves address space for all of stdin, pages are only backed once input is read into them, so str views into
+ * the buffer stay valid for the rest of the program
+ */
+static void reserve_input() {
+    for (uint64_t size = MAX_INPUT_RESERVATION; size >= MIN_INPUT_RESERVATION; size >>= 1) {
+        char *bytes = rt_mmap(size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE);
+        if ((long) bytes >= 0) {
+            input.bytes = bytes;
+            input.reserved = size;
+            return;
+        }
+    }
+    input.done = true;
+}
+
+/**
+ * Reads stdin in large chunks until enough unparsed bytes are buffered. A margin is left at the end of the
+ * reservation so word sized loads past the input stay in mapped, zeroed memory
+ * @param count Number of unparsed bytes wanted
+ * @return bool: whether that many bytes are buffered, false once stdin is exhausted
+ */
+static bool fill_input(uint64_t count) {
+    if (input.bytes == 0 && !input.done) {
+        reserve_input();
+    }
+
+    while (input.len - input.pos < count && !input.done) {
+        uint64_t space = input.reserved - input.len - READ_CHUNK_SIZE;
+        long bytes_read = rt_syscall3(SYS_READ, STDIN, (long) (input.bytes + input.len),
+            space < READ_CHUNK_SIZE ? space : READ_CHUNK_SIZE);
+        if (bytes_read <= 0) {
+            input.done = true;
+        } else {
+            input.len += bytes_read;
+        }
+    }
+
+    return input.len - input.pos >= count;
+}
+
+static bool whitespace(char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+}
+
+static uint64_t load_word(const char *bytes) {
+    uint64_t word;
+    __builtin_memcpy(&word, bytes, sizeof(word));
+    return word;
+}
+
+/**
+ * Counts the decimal digits at the start of a word, a byte is flagged if subtracting '0' borrows or adding
+ * 0x46 reaches its high bit. Borrows and carries only move towards later bytes, so the first flag is exact
+ * @param word Eight input bytes, the first in the lowest byte
+ * @return uint64_t: number of leading digits
+ */
+static uint64_t leading_digits(uint64_t word) {
+    uint64_t non_digits = ((word - ASCII_ZEROS) | (word + ABOVE_NINE)) & HIGH_BITS;
+    return non_digits == 0 ? SWAR_DIGITS : __builtin_ctzll(non_digits) >> BYTE_BITS;
+}
+
+/**
+ * Converts up to eight digits at once by combining neighbouring digits, then pairs, then groups of four
+ * @param word Eight input bytes starting with the digits
+ * @param digits Number of digits
+ * @return uint64_t: value of the digits
+ */
+static uint64_t parse_digits(uint64_t word, uint64_t digits) {
+    word = ((word - ASCII_ZEROS) << ((SWAR_DIGITS - digits) << BYTE_BITS));
+    word = ((word & LOW_NIBBLES) * COMBINE_DIGITS) >> 8;
+    word = ((word & LOW_BYTES) * COMBINE_PAIRS) >> 16;
+    return ((word & LOW_HALVES) * COMBINE_QUADS) >> 32;
+}
+
+/**
+ * Reads the next decimal i64 from stdin, skipping whitespace before it
+ * @return int64_t: the value, 0 if the input is exhausted or not a number
+ */
+int64_t rt_read_i64() {
+    while (fill_input(1) && whitespace(input.bytes[input.pos])) {
+        input.pos++;
+    }
+    fill_input(MAX_I64_LEN + 1);
+
+    bool negative = input.pos < input.len && input.bytes[input.pos] == '-';
+    input.pos += negative;
+
+    uint64_t value = 0;
+    uint64_t digits = SWAR_DIGITS;
+    while (digits == SWAR_DIGITS && input.pos < input.len) {
+        uint64_t word = load_word(input.bytes + input.pos);
+        digits = leading_digits(word);
+        if (digits > input.len - input.pos) {
+            digits = input.len - input.pos;
+        }
+        if (digits > 0) {
+            value = value * powers_of_ten[digits] + parse_digits(word, digits);
+            input.pos += digits;
+        }
+    }
+
+    return (int64_t) (negative ? -value : value);
+}
+
+/**
+ * Reads the next line from stdin as a view into the input buffer, without its line terminator. Only the str's
+ * header is allocated and it can be passed to rt_free
+ * @return const rt_str*: the line, empty once the input is exhausted
+ */
+const rt_str *rt_read_line() {
+    rt_str *line = (rt_str*) rt_alloc(sizeof(rt_str));
+    uint64_t start = input.pos;
+    uint64_t end = start;
+
+    while (fill_input(end - start + 1) && input.bytes[end] != '\n') {
+        end++;
+    }
+    input.pos = end + (end < input.len);
+
+    uint64_t len = end - start;
+    if (len > 0 && input.bytes[end - 1] == '\r') {
+        len--;
+    }
+    line->len = len;
+    line->bytes = input.bytes + start;
+    return line;
+}
@@ -0,0 +1,140 @@
+#include "runtime.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "syscall.h"
+
+#define OUTPUT_BUFFER_SIZE (64 << 10)
+#define MAX_I64_LEN 20
+#define STDOUT 1
+
+static const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static char output_buffer[OUTPUT_BUFFER_SIZE];
+static uint64_t output_len;
+static bool output_lock;
+
+static void lock_output() {
+    while (__atomic_exchange_n(&output_lock, true, __ATOMIC_ACQUIRE)) {
+        __builtin_ia32_pause();
+    }
+}
+
+static void unlock_output() {
+    __atomic_store_n(&output_lock, false, __ATOMIC_RELEASE);
+}
+
+static void write_all(const char *bytes, uint64_t len) {
+    while (len > 0) {
+        long written = rt_syscall3(SYS_WRITE, STDOUT, (long) bytes, len);
+        if (written <= 0)
+            return;
+        bytes += written;
+        len -= written;
+    }
+}
+
+static void flush_locked() {
+    write_all(output_buffer, output_len);
+    output_len = 0;
+}
+
+/**
+ * Writes the digits of an unsigned value ending just before a position, two digits at a time
+ * @param value Value to convert
+ * @param end Position after the last digit
+ * @return char*: position of the first digit
+ */
+static char *write_digits(uint64_t value, char *end) {
+    while (value >= 100) {
+        uint64_t pair = (value % 100) << 1;
+        value /= 100;
+        *--end = digit_pairs[pair + 1];
+        *--end = digit_pairs[pair];
+    }
+
+    if (value >= 10) {
+        *--end = digit_pairs[(value << 1) + 1];
+        *--end = digit_pairs[value << 1];
+    } else {
+        *--end = (char) ('0' + value);
+    }
+    return end;
+}
+
+/**
+ * Appends an i64 in decimal followed by a separator to the output buffer, the buffer is written out once it is
+ * close to full
+ * @param value Value to print
+ * @param separator Character printed after the value
+ */
+void rt_print_i64(int64_t value, int64_t separator) {
+    char digits[MAX_I64_LEN + 1];
+    char *end = digits + sizeof(digits);
+    uint64_t magnitude = value < 0 ? -(uint64_t) value : (uint64_t) value;
+    char *start = write_digits(magnitude, end);
+    if (value < 0) {
+        *--start = '-';
+    }
+
+    lock_output();
+    if (output_len + sizeof(digits) + 1 > OUTPUT_BUFFER_SIZE) {
+        flush_locked();
+    }
+    for (char *digit = start; digit < end; digit++) {
+        output_buffer[output_len++] = *digit;
+    }
+    output_buffer[output_len++] = (char) separator;
+    unlock_output();
+}
+
+/**
+ * Appends a str followed by a separator to the output buffer, strs longer than the buffer are written directly
+ * @param str Str to print
+ * @param separator Character printed after the str
+ */
+void rt_print_str(const rt_str *str, int64_t separator) {
+    uint64_t len = str->len;
+    const char *bytes = str->bytes;
+
+    lock_output();
+    if (output_len + len + 1 > OUTPUT_BUFFER_SIZE) {
+        flush_locked();
+    }
+    if (len + 1 > OUTPUT_BUFFER_SIZE) {
+        write_all(bytes, len);
+    } else {
+        for (uint64_t i = 0; i < len; i++) {
+            output_buffer[output_len++] = bytes[i];
+        }
+    }
+    output_buffer[output_len++] = (char) separator;
+    unlock_output();
+}
+
+void rt_flush() {
+    lock_output();
+    flush_locked();
+    unlock_output();
+}
+
+/**
+ * Flushes buffered output and exits every thread of the program
+ * @param status Exit status
+ */
+void rt_exit(int64_t status) {
+    rt_flush();
+    rt_syscall3(SYS_EXIT_GROUP, status, 0, 0);
+    __builtin_unreachable();
+}
@@ -0,0 +1,48 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+#include <stdint.h>
+
+#define RT_MAX_THREADS 64
+
+typedef struct rt_str_s {
+    int64_t len;
+    const char *bytes;
+} rt_str;
+
+typedef void (*rt_loop_body)(int64_t start, int64_t end, void *context, int64_t thread, int64_t *accumulators);
+
+void rt_parallel_for(int64_t start, int64_t end, rt_loop_body body, void *context, int64_t *accumulators,
+    int64_t dynamic);
+
+void rt_init();
+
+int64_t rt_alloc(int64_t size);
+
+int64_t rt_free(int64_t address);
+
+int64_t rt_arena_new();
+
+int64_t rt_arena_alloc(int64_t arena, int64_t size);
+
+int64_t rt_arena_reset(int64_t arena);
+
+int64_t rt_arena_free(int64_t arena);
+
+int64_t rt_load(int64_t address);
+
+int64_t rt_store(int64_t address, int64_t value);
+
+void rt_print_i64(int64_t value, int64_t separator);
+
+int64_t rt_read_i64();
+
+const rt_str *rt_read_line();
+
+void rt_print_str(const rt_str *str, int64_t separator);
+
+void rt_flush();
+
+void rt_exit(int64_t status);
+
+#endif //RUNTIME_H
@@ -0,0 +1,61 @@
+#ifndef SYSCALL_H
+#define SYSCALL_H
+
+#define SYS_READ 0
+#define SYS_WRITE 1
+#define SYS_MMAP 9
+#define SYS_MPROTECT 10
+#define SYS_MUNMAP 11
+#define SYS_CLONE 56
+#define SYS_EXIT 60
+#define SYS_ARCH_PRCTL 158
+#define SYS_FUTEX 202
+#define SYS_SCHED_GETAFFINITY 204
+#define SYS_EXIT_GROUP 231
+
+#define PROT_NONE 0
+#define PROT_READ 1
+#define PROT_WRITE 2
+#define MAP_PRIVATE 0x02
+#define MAP_ANONYMOUS 0x20
+#define MAP_NORESERVE 0x4000
+#define MAP_STACK 0x20000
+
+#define ARCH_SET_FS 0x1002
+
+#define FUTEX_WAIT_PRIVATE 128
+#define FUTEX_WAKE_PRIVATE 129
+
+static inline long rt_syscall6(long number, long a, long b, long c, long d, long e, long f) {
+    register long r10 __asm__("r10") = d;
+    register long r8 __asm__("r8") = e;
+    register long r9 __asm__("r9") = f;
+    long result;
+    __asm__ volatile ("syscall"
+        : "=a"(result)
+        : "a"(number), "D"(a), "S"(b), "d"(c), "r"(r10), "r"(r8), "r"(r9)
+        : "rcx", "r11", "memory");
+    return result;
+}
+
+static inline long rt_syscall3(long number, long a, long b, long c) {
+    return rt_syscall6(number, a, b, c, 0, 0, 0);
+}
+
+static inline void *rt_mmap(unsigned long size, int prot, int flags) {
+    return (void*) rt_syscall6(SYS_MMAP, 0, size, prot, flags, -1, 0);
+}
+
+static inline void rt_munmap(void *address, unsigned long size) {
+    rt_syscall3(SYS_MUNMAP, (long) address, size, 0);
+}
+
+static inline void rt_futex_wait(volatile unsigned *word, unsigned expected) {
+    rt_syscall6(SYS_FUTEX, (long) word, FUTEX_WAIT_PRIVATE, expected, 0, 0, 0);
+}
+
+static inline void rt_futex_wake(volatile unsigned *word, int count) {
+    rt_syscall3(SYS_FUTEX, (long) word, FUTEX_WAKE_PRIVATE, count);
+}
+
+#endif //SYSCALL_H
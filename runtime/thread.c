@@ -0,0 +1,237 @@
+#include "runtime.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "syscall.h"
+#include "thread.h"
+
+#define STACK_SIZE (8 << 20)
+#define GUARD_SIZE 4096
+#define AFFINITY_MASK_WORDS 16
+#define CHUNKS_PER_THREAD 16
+#define WAKE_ALL 0x7fffffff
+
+#define CLONE_VM 0x100
+#define CLONE_FS 0x200
+#define CLONE_FILES 0x400
+#define CLONE_SIGHAND 0x800
+#define CLONE_THREAD 0x10000
+#define CLONE_SYSVSEM 0x40000
+#define THREAD_FLAGS (CLONE_VM | CLONE_FS | CLONE_FILES | CLONE_SIGHAND | CLONE_THREAD | CLONE_SYSVSEM)
+
+typedef struct rt_job_s {
+    int64_t start;
+    uint64_t len;
+    rt_loop_body body;
+    void *context;
+    int64_t *accumulators;
+    bool dynamic;
+    uint64_t chunk;
+    uint64_t next;
+} rt_job;
+
+typedef struct rt_pool_s {
+    int64_t thread_count;
+    volatile unsigned generation;
+    volatile unsigned remaining;
+    bool active;
+    rt_job job;
+} rt_pool;
+
+static rt_pool pool;
+static rt_thread main_thread;
+
+/**
+ * Starts a thread sharing the address space on a stack whose top holds the entry function and its argument. The
+ * child pops both, calls the entry and exits the thread when it returns
+ * @param flags Clone flags
+ * @param stack_top Top of the child's stack
+ * @return long: thread id of the child, negative on failure
+ */
+long rt_clone_thread(long flags, void **stack_top);
+
+#define STRINGIFY(x) #x
+#define SYSCALL_NUMBER(x) STRINGIFY(x)
+
+__asm__(
+    ".text\n"
+    ".globl rt_clone_thread\n"
+    "rt_clone_thread:\n"
+    "    movl $" SYSCALL_NUMBER(SYS_CLONE) ", %eax\n"
+    "    xorl %edx, %edx\n"
+    "    xorl %r10d, %r10d\n"
+    "    xorl %r8d, %r8d\n"
+    "    syscall\n"
+    "    testq %rax, %rax\n"
+    "    jnz 1f\n"
+    "    xorl %ebp, %ebp\n"
+    "    popq %rax\n"
+    "    popq %rdi\n"
+    "    callq *%rax\n"
+    "    movl $" SYSCALL_NUMBER(SYS_EXIT) ", %eax\n"
+    "    xorl %edi, %edi\n"
+    "    syscall\n"
+    "1:\n"
+    "    ret\n"
+);
+
+/**
+ * Runs the calling thread's share of the current job. Static jobs split the range into one contiguous piece per
+ * thread, dynamic jobs hand out chunks from a shared counter
+ * @param thread Index of the calling thread
+ */
+static void run_share(int64_t thread) {
+    rt_job *job = &pool.job;
+
+    if (!job->dynamic) {
+        uint64_t per_thread = job->len / pool.thread_count;
+        uint64_t extra = job->len % pool.thread_count;
+        uint64_t offset = thread * per_thread + ((uint64_t) thread < extra ? thread : extra);
+        uint64_t count = per_thread + ((uint64_t) thread < extra);
+        if (count > 0) {
+            job->body(job->start + offset, job->start + offset + count, job->context, thread, job->accumulators);
+        }
+        return;
+    }
+
+    uint64_t offset;
+    while ((offset = __atomic_fetch_add(&job->next, job->chunk, __ATOMIC_RELAXED)) < job->len) {
+        uint64_t count = job->len - offset < job->chunk ? job->len - offset : job->chunk;
+        job->body(job->start + offset, job->start + offset + count, job->context, thread, job->accumulators);
+    }
+}
+
+/**
+ * Makes a block the calling thread's, it is reached through the fs segment
+ * @param thread Block of the thread
+ * @param index Index of the thread in the pool
+ */
+static void init_thread(rt_thread *thread, int64_t index) {
+    thread->self = thread;
+    thread->index = index;
+    rt_syscall3(SYS_ARCH_PRCTL, ARCH_SET_FS, (long) thread, 0);
+}
+
+void rt_init() {
+    init_thread(&main_thread, 0);
+}
+
+/**
+ * Worker loop, sleeps on the pool's generation until a job is published, runs its share and wakes the caller once
+ * the last worker is done
+ * @param arg Block of the worker's thread
+ */
+static void worker(void *arg) {
+    rt_thread *block = arg;
+    init_thread(block, block->index);
+    int64_t thread = block->index;
+    unsigned seen = 0;
+
+    for (;;) {
+        unsigned generation;
+        while ((generation = __atomic_load_n(&pool.generation, __ATOMIC_ACQUIRE)) == seen) {
+            rt_futex_wait(&pool.generation, seen);
+        }
+        seen = generation;
+
+        run_share(thread);
+        if (__atomic_sub_fetch(&pool.remaining, 1, __ATOMIC_ACQ_REL) == 0) {
+            rt_futex_wake(&pool.remaining, 1);
+        }
+    }
+}
+
+static int64_t available_cpus() {
+    uint64_t mask[AFFINITY_MASK_WORDS] = {0};
+    long size = rt_syscall3(SYS_SCHED_GETAFFINITY, 0, sizeof(mask), (long) mask);
+    if (size <= 0)
+        return 1;
+
+    int64_t count = 0;
+    for (long i = 0; i < size / (long) sizeof(uint64_t); i++) {
+        for (uint64_t bits = mask[i]; bits != 0; bits &= bits - 1) {
+            count++;
+        }
+    }
+    return count == 0 ? 1 : count;
+}
+
+/**
+ * Starts a worker for every available cpu besides the calling thread, capped at RT_MAX_THREADS. Workers persist
+ * for the rest of the program and are torn down when the process exits
+ */
+static void start_workers() {
+    int64_t thread_count = available_cpus();
+    if (thread_count > RT_MAX_THREADS) {
+        thread_count = RT_MAX_THREADS;
+    }
+    pool.thread_count = 1;
+
+    for (int64_t thread = 1; thread < thread_count; thread++) {
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK;
+        char *stack = rt_mmap(STACK_SIZE, PROT_READ | PROT_WRITE, flags);
+        if ((long) stack < 0)
+            break;
+        rt_syscall3(SYS_MPROTECT, (long) stack, GUARD_SIZE, PROT_NONE);
+
+        rt_thread *block = (rt_thread*) (stack + STACK_SIZE) - 1;
+        block->index = thread;
+        void **stack_top = (void**) block - 2;
+        stack_top[0] = (void*) &worker;
+        stack_top[1] = block;
+        if (rt_clone_thread(THREAD_FLAGS, stack_top) < 0)
+            break;
+        pool.thread_count++;
+    }
+}
+
+/**
+ * Runs a loop body over the range [start, end) on every thread of the pool and returns when all of it is done.
+ * Nested calls, from inside a body, run serially on the calling thread
+ * @param start Start of the range
+ * @param end End of the range
+ * @param body Outlined loop body, called with a chunk of the range and the index of the thread running it
+ * @param context Passed through to the body
+ * @param accumulators Per thread reduction slots, passed through to the body
+ * @param dynamic Whether chunks are handed out on demand instead of split evenly up front
+ */
+void rt_parallel_for(int64_t start, int64_t end, rt_loop_body body, void *context, int64_t *accumulators,
+    int64_t dynamic) {
+
+    if (start >= end)
+        return;
+
+    if (pool.thread_count == 0) {
+        start_workers();
+    }
+
+    if (pool.active || pool.thread_count == 1) {
+        body(start, end, context, 0, accumulators);
+        return;
+    }
+
+    rt_job *job = &pool.job;
+    job->start = start;
+    job->len = (uint64_t) end - (uint64_t) start;
+    job->body = body;
+    job->context = context;
+    job->accumulators = accumulators;
+    job->dynamic = dynamic;
+    job->chunk = job->len / (pool.thread_count * CHUNKS_PER_THREAD);
+    job->chunk = job->chunk == 0 ? 1 : job->chunk;
+    job->next = 0;
+    pool.active = true;
+    pool.remaining = pool.thread_count - 1;
+
+    __atomic_add_fetch(&pool.generation, 1, __ATOMIC_RELEASE);
+    rt_futex_wake(&pool.generation, WAKE_ALL);
+
+    run_share(0);
+
+    unsigned remaining;
+    while ((remaining = __atomic_load_n(&pool.remaining, __ATOMIC_ACQUIRE)) != 0) {
+        rt_futex_wait(&pool.remaining, remaining);
+    }
+    pool.active = false;
+}
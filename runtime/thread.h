@@ -0,0 +1,28 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+#include <stdint.h>
+
+#define RT_SIZE_CLASSES 40
+
+typedef struct rt_block_s rt_block;
+
+typedef struct rt_thread_s {
+    struct rt_thread_s *self;
+    int64_t index;
+    rt_block *free_lists[RT_SIZE_CLASSES];
+    char *slab;
+    uint64_t slab_left;
+} rt_thread;
+
+/**
+ * Gets the calling thread's block, each thread keeps a pointer to its block at the start of its fs segment
+ * @return rt_thread*: the calling thread's block
+ */
+static inline rt_thread *rt_thread_self() {
+    rt_thread *thread;
+    __asm__ ("movq %%fs:0, %0" : "=r"(thread));
+    return thread;
+}
+
+#endif //THREAD_H
@@ -0,0 +1,352 @@
+#include "service.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "vec.h"
+
+#define BATCH_TURN 4
+#define NANOSECONDS 1000000000
+#define FNV_OFFSET 0xcbf29ce484222325
+#define FNV_PRIME 0x100000001b3
+
+/**
+ * A compile shared by every identical request made while it is queued or running. It is freed once it finished and
+ * every requester released it
+ */
+struct compile_job_s {
+    uint64_t key;
+    char *path;
+    char *source;
+    size_t len;
+    bool entry;
+    parse_options options;
+    size_t references;
+    bool done;
+    uint64_t submitted_at;
+    compile_result result;
+};
+
+/**
+ * Jobs of one client waiting in a class, in the order they were submitted
+ */
+typedef struct client_queue_s {
+    size_t client;
+    vec jobs;
+    size_t head;
+} client_queue;
+
+/**
+ * Jobs waiting in a class, clients with waiting jobs take turns so a burst from one client does not hold back the
+ * others
+ */
+typedef struct class_queue_s {
+    vec clients;
+    size_t turn;
+} class_queue;
+
+/**
+ * Compiles requests from many clients on a fixed set of worker threads. Interactive requests are taken first, but
+ * every BATCH_TURN-th pick goes to a waiting batch request so batch work is never starved
+ */
+struct compile_service_s {
+    compiler *instance;
+    pthread_mutex_t lock;
+    pthread_cond_t queued;
+    pthread_cond_t finished;
+    class_queue classes[REQUEST_CLASSES];
+    vec in_flight;
+    size_t picks;
+    bool stopping;
+    size_t worker_count;
+    pthread_t *workers;
+    service_metrics metrics;
+};
+
+static uint64_t now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t) time.tv_sec * NANOSECONDS + time.tv_nsec;
+}
+
+static uint64_t hash_bytes(uint64_t hash, const char *bytes, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char) bytes[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+/**
+ * Hashes everything that decides the output of a request, identical requests have the same key
+ * @param request Request
+ * @return uint64_t: key of the request
+ */
+static uint64_t request_key(compile_request *request) {
+    char flags[] = {request->entry, request->options.share_expressions, request->options.lazy_bodies};
+    uint64_t hash = hash_bytes(FNV_OFFSET, request->path, strlen(request->path) + 1);
+    hash = hash_bytes(hash, flags, sizeof(flags));
+    return hash_bytes(hash, request->source, request->len);
+}
+
+static bool same_request(compile_job *job, uint64_t key, compile_request *request) {
+    return job->key == key && job->entry == request->entry && job->len == request->len
+        && job->options.share_expressions == request->options.share_expressions
+        && job->options.lazy_bodies == request->options.lazy_bodies && strcmp(job->path, request->path) == 0
+        && memcmp(job->source, request->source, request->len) == 0;
+}
+
+static void enqueue(class_queue *queue, size_t client, compile_job *job) {
+    client_queue *waiting = NULL;
+    vec_iter(client_queue *curr, queue->clients, {
+        if (curr->client == client) {
+            waiting = curr;
+            break;
+        }
+    })
+
+    if (waiting == NULL) {
+        waiting = malloc(sizeof(client_queue));
+        waiting->client = client;
+        waiting->jobs = vec_new();
+        waiting->head = 0;
+        vec_push(queue->clients, waiting);
+    }
+    vec_push(waiting->jobs, job);
+}
+
+/**
+ * Takes the oldest job of the client whose turn it is, a client without jobs left gives up its place
+ * @param queue Class with waiting jobs
+ * @return compile_job*: the job
+ */
+static compile_job *dequeue(class_queue *queue) {
+    vec clients = queue->clients;
+    size_t turn = queue->turn % vec_len(clients);
+    client_queue *waiting = vec_get(clients, turn);
+    compile_job *job = vec_get(waiting->jobs, waiting->head++);
+    if (waiting->head < vec_len(waiting->jobs)) {
+        queue->turn = turn + 1;
+        return job;
+    }
+
+    for (size_t i = turn + 1; i < vec_len(clients); i++) {
+        vec_set(clients, i - 1, vec_get(clients, i));
+    }
+    vec_pop(clients);
+    vec_free(waiting->jobs);
+    free(waiting);
+    queue->turn = turn;
+    return job;
+}
+
+static compile_job *next_job(compile_service *service) {
+    size_t *depth = service->metrics.queue_depth;
+    request_class priority = REQUEST_INTERACTIVE;
+    if (depth[REQUEST_INTERACTIVE] == 0 || (depth[REQUEST_BATCH] > 0 && ++service->picks % BATCH_TURN == 0)) {
+        priority = REQUEST_BATCH;
+    }
+
+    depth[priority]--;
+    return dequeue(&service->classes[priority]);
+}
+
+static void job_free(compile_service *service, compile_job *job) {
+    compile_result_free(service->instance, &job->result);
+    free(job->path);
+    free(job->source);
+    free(job);
+}
+
+static void finish_job(compile_service *service, compile_job *job, uint64_t started, uint64_t ended) {
+    vec in_flight = service->in_flight;
+    for (size_t i = 0; i < vec_len(in_flight); i++) {
+        if (vec_get(in_flight, i) == job) {
+            vec_set(in_flight, i, vec_peek_end(in_flight));
+            vec_pop(in_flight);
+            break;
+        }
+    }
+
+    service_metrics *metrics = &service->metrics;
+    uint64_t queue_latency = started - job->submitted_at;
+    uint64_t compile_latency = ended - started;
+    metrics->running--;
+    metrics->completed++;
+    metrics->total_queue_latency += queue_latency;
+    metrics->total_compile_latency += compile_latency;
+    metrics->max_queue_latency = queue_latency > metrics->max_queue_latency ? queue_latency
+        : metrics->max_queue_latency;
+    metrics->max_compile_latency = compile_latency > metrics->max_compile_latency ? compile_latency
+        : metrics->max_compile_latency;
+
+    job->done = true;
+    if (job->references == 0) {
+        job_free(service, job);
+    }
+    pthread_cond_broadcast(&service->finished);
+}
+
+/**
+ * Compiles queued jobs until the service stops, the jobs still queued when it stops are compiled first
+ * @param arg Service
+ * @return void*: NULL
+ */
+static void *serve(void *arg) {
+    compile_service *service = arg;
+    pthread_mutex_lock(&service->lock);
+    while (true) {
+        service_metrics *metrics = &service->metrics;
+        while (!service->stopping && metrics->queue_depth[REQUEST_INTERACTIVE] == 0
+            && metrics->queue_depth[REQUEST_BATCH] == 0) {
+            pthread_cond_wait(&service->queued, &service->lock);
+        }
+        if (metrics->queue_depth[REQUEST_INTERACTIVE] == 0 && metrics->queue_depth[REQUEST_BATCH] == 0)
+            break;
+
+        compile_job *job = next_job(service);
+        metrics->running++;
+        pthread_mutex_unlock(&service->lock);
+
+        uint64_t started = now();
+        job->result = compile_source(service->instance, job->path, job->source, job->len, job->entry,
+            job->options);
+        uint64_t ended = now();
+
+        pthread_mutex_lock(&service->lock);
+        finish_job(service, job, started, ended);
+    }
+    pthread_mutex_unlock(&service->lock);
+    return NULL;
+}
+
+/**
+ * Starts a service compiling on its own worker threads
+ * @param instance Compiler the requests are compiled with
+ * @param workers Number of requests compiled at once, at least 1
+ * @return compile_service*: the service
+ */
+compile_service *compile_service_new(compiler *instance, size_t workers) {
+    compile_service *service = calloc(1, sizeof(compile_service));
+    service->instance = instance;
+    pthread_mutex_init(&service->lock, NULL);
+    pthread_cond_init(&service->queued, NULL);
+    pthread_cond_init(&service->finished, NULL);
+    for (size_t i = 0; i < REQUEST_CLASSES; i++) {
+        service->classes[i].clients = vec_new();
+    }
+    service->in_flight = vec_new();
+
+    service->worker_count = workers < 1 ? 1 : workers;
+    service->workers = malloc(service->worker_count * sizeof(pthread_t));
+    for (size_t i = 0; i < service->worker_count; i++) {
+        if (pthread_create(&service->workers[i], NULL, &serve, service) != 0) {
+            fprintf(stderr, "fatal error: cannot start compile service thread\n");
+            exit(1);
+        }
+    }
+    return service;
+}
+
+/**
+ * Stops a service once every queued request compiled, every job must be released first
+ * @param service Service
+ */
+void compile_service_free(compile_service *service) {
+    pthread_mutex_lock(&service->lock);
+    service->stopping = true;
+    pthread_cond_broadcast(&service->queued);
+    pthread_mutex_unlock(&service->lock);
+
+    for (size_t i = 0; i < service->worker_count; i++) {
+        pthread_join(service->workers[i], NULL);
+    }
+
+    for (size_t i = 0; i < REQUEST_CLASSES; i++) {
+        vec_free(service->classes[i].clients);
+    }
+    vec_free(service->in_flight);
+    free(service->workers);
+    pthread_cond_destroy(&service->finished);
+    pthread_cond_destroy(&service->queued);
+    pthread_mutex_destroy(&service->lock);
+    free(service);
+}
+
+/**
+ * Queues a request, a request identical to one already queued or running joins that compile instead of starting
+ * its own
+ * @param service Service
+ * @param request Request
+ * @return compile_job*: compile the request is answered by, released by the caller once it is done with it
+ */
+compile_job *submit_compile(compile_service *service, compile_request *request) {
+    uint64_t key = request_key(request);
+    pthread_mutex_lock(&service->lock);
+    service->metrics.submitted++;
+    vec_iter(compile_job *job, service->in_flight, {
+        if (same_request(job, key, request)) {
+            job->references++;
+            service->metrics.coalesced++;
+            pthread_mutex_unlock(&service->lock);
+            return job;
+        }
+    })
+
+    compile_job *job = malloc(sizeof(compile_job));
+    job->key = key;
+    job->path = strdup(request->path);
+    job->source = malloc(request->len + 1);
+    memcpy(job->source, request->source, request->len);
+    job->len = request->len;
+    job->entry = request->entry;
+    job->options = request->options;
+    job->references = 1;
+    job->done = false;
+    job->submitted_at = now();
+
+    request_class priority = request->priority == REQUEST_INTERACTIVE ? REQUEST_INTERACTIVE : REQUEST_BATCH;
+    vec_push(service->in_flight, job);
+    enqueue(&service->classes[priority], request->client, job);
+    service->metrics.queue_depth[priority]++;
+    pthread_cond_signal(&service->queued);
+    pthread_mutex_unlock(&service->lock);
+    return job;
+}
+
+/**
+ * Waits for a compile to finish
+ * @param service Service
+ * @param job Compile
+ * @return compile_result*: result of the compile, valid until the job is released
+ */
+compile_result *wait_compile(compile_service *service, compile_job *job) {
+    pthread_mutex_lock(&service->lock);
+    while (!job->done) {
+        pthread_cond_wait(&service->finished, &service->lock);
+    }
+    pthread_mutex_unlock(&service->lock);
+    return &job->result;
+}
+
+/**
+ * Gives up a reference to a compile, it is freed once it is done and nobody references it
+ * @param service Service
+ * @param job Compile
+ */
+void release_compile(compile_service *service, compile_job *job) {
+    pthread_mutex_lock(&service->lock);
+    if (--job->references == 0 && job->done) {
+        job_free(service, job);
+    }
+    pthread_mutex_unlock(&service->lock);
+}
+
+service_metrics compile_service_metrics(compile_service *service) {
+    pthread_mutex_lock(&service->lock);
+    service_metrics metrics = service->metrics;
+    pthread_mutex_unlock(&service->lock);
+    return metrics;
+}
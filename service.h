@@ -0,0 +1,61 @@
+#ifndef SERVICE_H
+#define SERVICE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "compiler.h"
+
+typedef enum request_class_e {
+    REQUEST_INTERACTIVE,
+    REQUEST_BATCH,
+    REQUEST_CLASSES,
+} request_class;
+
+/**
+ * A module to compile from memory on behalf of a client, the service copies everything it keeps
+ */
+typedef struct compile_request_s {
+    char *path;
+    char *source;
+    size_t len;
+    bool entry;
+    parse_options options;
+    request_class priority;
+    size_t client;
+} compile_request;
+
+/**
+ * Counters of a service since it started, latencies are in nanoseconds. A coalesced request joined a compile of
+ * the same module that was already queued or running
+ */
+typedef struct service_metrics_s {
+    size_t queue_depth[REQUEST_CLASSES];
+    size_t running;
+    size_t submitted;
+    size_t coalesced;
+    size_t completed;
+    uint64_t total_queue_latency;
+    uint64_t max_queue_latency;
+    uint64_t total_compile_latency;
+    uint64_t max_compile_latency;
+} service_metrics;
+
+typedef struct compile_service_s compile_service;
+
+typedef struct compile_job_s compile_job;
+
+compile_service *compile_service_new(compiler *instance, size_t workers);
+
+void compile_service_free(compile_service *service);
+
+compile_job *submit_compile(compile_service *service, compile_request *request);
+
+compile_result *wait_compile(compile_service *service, compile_job *job);
+
+void release_compile(compile_service *service, compile_job *job);
+
+service_metrics compile_service_metrics(compile_service *service);
+
+#endif //SERVICE_H
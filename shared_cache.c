@@ -0,0 +1,268 @@
+#include "shared_cache.h"
+
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CACHE_MAGIC "RSC\1"
+#define CACHE_MAGIC_LEN 4
+#define CACHE_SLOTS (1 << 13)
+#define CACHE_DATA_SIZE (16 << 20)
+#define MAX_CACHE_ENTRIES (CACHE_SLOTS / 2)
+#define ENTRY_ALIGNMENT 8
+#define TEMPORARY_SUFFIX ".XXXXXX"
+
+#define FNV_OFFSET 0xcbf29ce484222325
+#define FNV_PRIME 0x100000001b3
+
+/**
+ * Start of a cache file. Entries are allocated by bumping how much of the data region is used, the file is never
+ * compacted and is replaced by an empty one once it fills up
+ */
+typedef struct cache_header_s {
+    char magic[ENTRY_ALIGNMENT];
+    uint64_t slot_count;
+    uint64_t data_size;
+    _Atomic uint64_t data_used;
+    _Atomic uint64_t entry_count;
+} cache_header;
+
+/**
+ * Slot of the cache's index. A slot is claimed by setting its hash from 0, then the location of its entry is
+ * published. A claimed slot whose location is still 0 is being written and is skipped by lookups
+ */
+typedef struct cache_slot_s {
+    _Atomic uint64_t hash;
+    _Atomic uint64_t location;
+} cache_slot;
+
+typedef struct cache_entry_s {
+    uint32_t key_len;
+    uint32_t value_len;
+    char bytes[];
+} cache_entry;
+
+/**
+ * Cache file mapped into the process. Every process mapping the same file sees the entries the others add without
+ * taking any lock, and processes forked after the cache is opened share the mapping. Values are never changed once
+ * published, adding a key again publishes a new entry in the key's slot
+ */
+struct shared_cache_s {
+    char *mapping;
+    size_t size;
+    cache_header *header;
+    cache_slot *slots;
+};
+
+#define DATA_OFFSET (sizeof(cache_header) + CACHE_SLOTS * sizeof(cache_slot))
+#define CACHE_SIZE (DATA_OFFSET + CACHE_DATA_SIZE)
+
+static uint64_t key_hash(char *key, size_t key_len) {
+    uint64_t hash = FNV_OFFSET;
+    for (size_t i = 0; i < key_len; i++) {
+        hash = (hash ^ (unsigned char) key[i]) * FNV_PRIME;
+    }
+    hash ^= hash >> 29;
+    return hash == 0 ? 1 : hash;
+}
+
+static shared_cache *cache_new(char *mapping) {
+    shared_cache *cache = malloc(sizeof(shared_cache));
+    cache->mapping = mapping;
+    cache->size = CACHE_SIZE;
+    cache->header = (cache_header*) mapping;
+    cache->slots = (cache_slot*) (mapping + sizeof(cache_header));
+    return cache;
+}
+
+static char *map_file(int fd) {
+    char *mapping = mmap(NULL, CACHE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return mapping == MAP_FAILED ? NULL : mapping;
+}
+
+/**
+ * Maps an existing cache file, a file of another layout or one that has filled up is not used
+ * @param path Path of the cache file
+ * @return shared_cache*: the cache, NULL if the file cannot be used
+ */
+static shared_cache *map_cache(char *path) {
+    int fd = open(path, O_RDWR);
+    if (fd < 0)
+        return NULL;
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size != CACHE_SIZE) {
+        close(fd);
+        return NULL;
+    }
+    char *mapping = map_file(fd);
+    if (mapping == NULL)
+        return NULL;
+
+    cache_header *header = (cache_header*) mapping;
+    if (memcmp(header->magic, CACHE_MAGIC, CACHE_MAGIC_LEN) != 0 || header->slot_count != CACHE_SLOTS
+        || header->data_size != CACHE_DATA_SIZE || atomic_load(&header->entry_count) >= MAX_CACHE_ENTRIES
+        || atomic_load(&header->data_used) >= CACHE_DATA_SIZE / 4 * 3) {
+        munmap(mapping, CACHE_SIZE);
+        return NULL;
+    }
+    return cache_new(mapping);
+}
+
+/**
+ * Creates an empty cache file and moves it over the existing one. The file is only moved into place once its header
+ * is written, so other processes either open the old file or a complete new one. Processes that mapped the old file
+ * keep using it
+ * @param path Path of the cache file
+ * @return shared_cache*: the cache, NULL if the file cannot be created
+ */
+static shared_cache *create_cache(char *path) {
+    size_t path_len = strlen(path);
+    char *temporary = malloc(path_len + sizeof(TEMPORARY_SUFFIX));
+    memcpy(temporary, path, path_len);
+    memcpy(temporary + path_len, TEMPORARY_SUFFIX, sizeof(TEMPORARY_SUFFIX));
+
+    int fd = mkstemp(temporary);
+    char *mapping = NULL;
+    if (fd >= 0 && ftruncate(fd, CACHE_SIZE) == 0) {
+        mapping = map_file(fd);
+    } else if (fd >= 0) {
+        close(fd);
+    }
+
+    if (mapping != NULL) {
+        cache_header *header = (cache_header*) mapping;
+        memcpy(header->magic, CACHE_MAGIC, CACHE_MAGIC_LEN);
+        header->slot_count = CACHE_SLOTS;
+        header->data_size = CACHE_DATA_SIZE;
+        if (rename(temporary, path) != 0) {
+            munmap(mapping, CACHE_SIZE);
+            mapping = NULL;
+        }
+    }
+    if (fd >= 0 && mapping == NULL) {
+        unlink(temporary);
+    }
+    free(temporary);
+    return mapping == NULL ? NULL : cache_new(mapping);
+}
+
+/**
+ * Opens the cache file at a path, creating it when it does not exist or cannot be used
+ * @param path Path of the cache file
+ * @return shared_cache*: the cache, NULL if no cache file can be used, callers then work without it
+ */
+shared_cache *shared_cache_open(char *path) {
+    shared_cache *cache = map_cache(path);
+    return cache != NULL ? cache : create_cache(path);
+}
+
+void shared_cache_close(shared_cache *cache) {
+    munmap(cache->mapping, cache->size);
+    free(cache);
+}
+
+/**
+ * Gets the entry at a location of the cache, the cache file may have been written by anything so the entry is
+ * checked to lie within the data region
+ * @param cache Cache
+ * @param location Location of the entry, 0 if it is not published yet
+ * @return cache_entry*: the entry, NULL if there is none
+ */
+static cache_entry *entry_at(shared_cache *cache, uint64_t location) {
+    if (location < DATA_OFFSET || location > cache->size - sizeof(cache_entry) || location % ENTRY_ALIGNMENT != 0)
+        return NULL;
+
+    cache_entry *entry = (cache_entry*) (cache->mapping + location);
+    if ((uint64_t) entry->key_len + entry->value_len > cache->size - location - sizeof(cache_entry))
+        return NULL;
+    return entry;
+}
+
+static bool has_key(cache_entry *entry, char *key, size_t key_len) {
+    return entry != NULL && entry->key_len == key_len && memcmp(entry->bytes, key, key_len) == 0;
+}
+
+/**
+ * Finds the value of a key, the value is read in place from the mapped file
+ * @param cache Cache
+ * @param key Key
+ * @param key_len Length of the key
+ * @param size Set to the size of the value
+ * @return char*: the value, NULL if the key has none
+ */
+char *shared_cache_find(shared_cache *cache, char *key, size_t key_len, size_t *size) {
+    uint64_t hash = key_hash(key, key_len);
+    size_t mask = CACHE_SLOTS - 1;
+    for (size_t i = hash & mask, probes = 0; probes < CACHE_SLOTS; i = (i + 1) & mask, probes++) {
+        uint64_t slot_hash = atomic_load_explicit(&cache->slots[i].hash, memory_order_acquire);
+        if (slot_hash == 0)
+            return NULL;
+        if (slot_hash != hash)
+            continue;
+
+        cache_entry *entry = entry_at(cache, atomic_load_explicit(&cache->slots[i].location, memory_order_acquire));
+        if (has_key(entry, key, key_len)) {
+            *size = entry->value_len;
+            return entry->bytes + key_len;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Adds the value of a key, replacing the value it had. The entry is written before its location is published, so
+ * other processes never see it half written. Two processes adding the same key at once may both claim a slot, the
+ * one found first wins, so callers must check that a value they find is still current
+ * @param cache Cache
+ * @param key Key
+ * @param key_len Length of the key
+ * @param value Value
+ * @param size Size of the value
+ * @return bool: whether the value was added, false once the cache is full
+ */
+bool shared_cache_add(shared_cache *cache, char *key, size_t key_len, char *value, size_t size) {
+    if (key_len > UINT32_MAX || size > UINT32_MAX)
+        return false;
+
+    uint64_t entry_size = (sizeof(cache_entry) + key_len + size + ENTRY_ALIGNMENT - 1) & ~(ENTRY_ALIGNMENT - 1);
+    uint64_t offset = atomic_fetch_add(&cache->header->data_used, entry_size);
+    if (offset > CACHE_DATA_SIZE || entry_size > CACHE_DATA_SIZE - offset)
+        return false;
+
+    uint64_t location = DATA_OFFSET + offset;
+    cache_entry *entry = (cache_entry*) (cache->mapping + location);
+    entry->key_len = key_len;
+    entry->value_len = size;
+    memcpy(entry->bytes, key, key_len);
+    memcpy(entry->bytes + key_len, value, size);
+
+    uint64_t hash = key_hash(key, key_len);
+    size_t mask = CACHE_SLOTS - 1;
+    for (size_t i = hash & mask, probes = 0; probes < CACHE_SLOTS; i = (i + 1) & mask, probes++) {
+        cache_slot *slot = cache->slots + i;
+        uint64_t slot_hash = atomic_load_explicit(&slot->hash, memory_order_acquire);
+        if (slot_hash == 0) {
+            if (atomic_load(&cache->header->entry_count) >= MAX_CACHE_ENTRIES)
+                return false;
+            if (atomic_compare_exchange_strong(&slot->hash, &slot_hash, hash)) {
+                atomic_fetch_add(&cache->header->entry_count, 1);
+                atomic_store_explicit(&slot->location, location, memory_order_release);
+                return true;
+            }
+        }
+        if (slot_hash == hash
+            && has_key(entry_at(cache, atomic_load_explicit(&slot->location, memory_order_acquire)), key, key_len)) {
+            atomic_store_explicit(&slot->location, location, memory_order_release);
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,17 @@
+#ifndef SHARED_CACHE_H
+#define SHARED_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct shared_cache_s shared_cache;
+
+shared_cache *shared_cache_open(char *path);
+
+void shared_cache_close(shared_cache *cache);
+
+char *shared_cache_find(shared_cache *cache, char *key, size_t key_len, size_t *size);
+
+bool shared_cache_add(shared_cache *cache, char *key, size_t key_len, char *value, size_t size);
+
+#endif //SHARED_CACHE_H
@@ -0,0 +1,191 @@
+#include "span.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "context.h"
+#include "vec.h"
+
+#define READ_CHUNK_SIZE (64 << 10)
+
+/**
+ * A source file spans can point into, the start of each of its lines is only found when a span in the file is
+ * first resolved, which is usually never. Each compilation numbers its source files on its own. A source given in
+ * memory is read from its text instead of the file at its path
+ */
+typedef struct source_file_s {
+    char *path;
+    char *text;
+    size_t len;
+    vec line_starts;
+} source_file;
+
+/**
+ * Gets the id of a source file in the bound compilation, registering it on first use. Spans store the id instead
+ * of the path
+ * @param path Path of the file
+ * @return uint32_t: id of the file
+ */
+uint32_t source_file_id(char *path) {
+    compilation *unit = bound_compilation();
+    if (unit->source_files == NULL) {
+        unit->source_files = vec_new();
+    }
+
+    vec source_files = unit->source_files;
+    vec_iter(source_file *file, source_files, {
+        if (strcmp(file->path, path) == 0)
+            return i;
+    })
+
+    source_file *file = malloc(sizeof(source_file));
+    file->path = strdup(path);
+    file->text = NULL;
+    file->len = 0;
+    file->line_starts = NULL;
+    vec_push(source_files, file);
+    return vec_len(source_files) - 1;
+}
+
+static source_file *get_source_file(uint32_t file) {
+    return vec_get(bound_compilation()->source_files, file);
+}
+
+char *source_file_path(uint32_t file) {
+    return get_source_file(file)->path;
+}
+
+/**
+ * Gives the source of a file in memory, the file at its path is never read by the bound compilation
+ * @param path Path the source is compiled as, imports are looked up next to it
+ * @param text Source, it must outlive the compilation
+ * @param len Length of the source
+ */
+void source_file_text(char *path, char *text, size_t len) {
+    source_file *file = get_source_file(source_file_id(path));
+    file->text = text;
+    file->len = len;
+}
+
+static FILE *open_file(source_file *file) {
+    return file->text != NULL ? fmemopen(file->text, file->len, "r") : fopen(file->path, "r");
+}
+
+/**
+ * Opens a source file for reading, from memory if its source was given in memory
+ * @param path Path of the file
+ * @return FILE*: the source, NULL if it cannot be opened
+ */
+FILE *open_source(char *path) {
+    return open_file(get_source_file(source_file_id(path)));
+}
+
+/**
+ * Creates a span for a byte offset in a file, offsets past what 32 bits can hold point at the last representable
+ * byte
+ * @param file Id of the file
+ * @param offset Byte offset in the file
+ * @return span: the span
+ */
+span span_new(uint32_t file, size_t offset) {
+    return (span) {file, offset > UINT32_MAX ? UINT32_MAX : (uint32_t) offset};
+}
+
+static vec line_starts(source_file *file) {
+    if (file->line_starts != NULL)
+        return file->line_starts;
+
+    vec starts = vec_new();
+    vec_push_val(starts, 0);
+    FILE *source = open_file(file);
+    if (source != NULL) {
+        char *chunk = malloc(READ_CHUNK_SIZE);
+        size_t offset = 0;
+        size_t read;
+        while ((read = fread(chunk, sizeof(char), READ_CHUNK_SIZE, source)) > 0) {
+            for (size_t i = 0; i < read; i++) {
+                if (chunk[i] == '\n') {
+                    vec_push_val(starts, offset + i + 1);
+                }
+            }
+            offset += read;
+        }
+        free(chunk);
+        fclose(source);
+    }
+
+    file->line_starts = starts;
+    return starts;
+}
+
+static size_t line_index(vec starts, uint32_t offset) {
+    size_t low = 0;
+    size_t high = vec_len(starts);
+    while (high - low > 1) {
+        size_t mid = (low + high) >> 1;
+        if ((size_t) vec_get(starts, mid) <= offset) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/**
+ * Finds the line and column a span points at
+ * @param position Span
+ * @param line_num Set to the line number, starting at 1
+ * @param column Set to the column in bytes, starting at 1
+ */
+void span_location(span position, size_t *line_num, size_t *column) {
+    vec starts = line_starts(get_source_file(position.file));
+    size_t index = line_index(starts, position.offset);
+    *line_num = index + 1;
+    *column = position.offset - (size_t) vec_get(starts, index) + 1;
+}
+
+/**
+ * Reads the line a span points at back from its file
+ * @param position Span
+ * @return char*: the line without its newline, NULL if it cannot be read
+ */
+char *span_snippet(span position) {
+    source_file *file = get_source_file(position.file);
+    vec starts = line_starts(file);
+    FILE *source = open_file(file);
+    if (source == NULL)
+        return NULL;
+
+    char *text = NULL;
+    size_t capacity = 0;
+    ssize_t len = -1;
+    if (fseek(source, (long) (size_t) vec_get(starts, line_index(starts, position.offset)), SEEK_SET) == 0) {
+        len = getline(&text, &capacity, source);
+    }
+    fclose(source);
+
+    if (len < 0) {
+        free(text);
+        return NULL;
+    }
+    while (len > 0 && (text[len - 1] == '\n' || text[len - 1] == '\r')) {
+        text[--len] = '\0';
+    }
+    return text;
+}
+
+void free_spans(compilation *unit) {
+    if (unit->source_files == NULL)
+        return;
+
+    vec_iter(source_file *file, unit->source_files, {
+        free(file->path);
+        if (file->line_starts != NULL) {
+            vec_free(file->line_starts);
+        }
+    })
+    free_vec_and_elements(unit->source_files);
+    unit->source_files = NULL;
+}
@@ -0,0 +1,31 @@
+#ifndef SPAN_H
+#define SPAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "context.h"
+
+typedef struct span_s {
+    uint32_t file;
+    uint32_t offset;
+} span;
+
+uint32_t source_file_id(char *path);
+
+char *source_file_path(uint32_t file);
+
+void source_file_text(char *path, char *text, size_t len);
+
+FILE *open_source(char *path);
+
+span span_new(uint32_t file, size_t offset);
+
+void span_location(span position, size_t *line_num, size_t *column);
+
+char *span_snippet(span position);
+
+void free_spans(compilation *unit);
+
+#endif //SPAN_H
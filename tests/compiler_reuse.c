@@ -0,0 +1,68 @@
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../compiler.h"
+
+#define SOURCE "i64 main()\n    i64 total = 0\n    for i = 0, 10\n        total = total + i\n    return total\n"
+#define ERRONEOUS_SOURCE "i64 f(i64 x)\n    return x\n\ni64 main()\n    i64 a = (1 + 2) * f(3, 4)\n" \
+    "    print 1 + 2, f(5) * missing\n    for i = 1 + 2, 3 + missing\n        a = a + i\n    return (a * 2) + missing\n"
+
+/**
+ * A thread that compiles, waits while the compiler is freed and another created, then compiles again. Strings it
+ * interned in the first compile belong to the freed compiler, the second compile must not write after them. Each
+ * compile also compiles a source whose lines have errors after part of them was parsed, which must fail without
+ * leaking
+ */
+typedef struct worker_s {
+    compiler *instance;
+    sem_t compiled;
+    sem_t recreated;
+    bool results[2];
+} worker;
+
+static bool compile_once(compiler *instance) {
+    compile_result result = compile_source(instance, "reuse.ro", SOURCE, strlen(SOURCE), true,
+        (parse_options) {false, false});
+    bool compiled = result.compiled;
+    compile_result_free(instance, &result);
+
+    result = compile_source(instance, "erroneous.ro", ERRONEOUS_SOURCE, strlen(ERRONEOUS_SOURCE), true,
+        (parse_options) {true, true});
+    compiled = compiled && !result.compiled;
+    compile_result_free(instance, &result);
+    return compiled;
+}
+
+static void *compile_twice(void *arg) {
+    worker *state = arg;
+    state->results[0] = compile_once(state->instance);
+    sem_post(&state->compiled);
+    sem_wait(&state->recreated);
+    state->results[1] = compile_once(state->instance);
+    return NULL;
+}
+
+int main() {
+    worker state = {.instance = compiler_new(NULL)};
+    sem_init(&state.compiled, 0, 0);
+    sem_init(&state.recreated, 0, 0);
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, &compile_twice, &state);
+    sem_wait(&state.compiled);
+    compiler_free(state.instance);
+    state.instance = compiler_new(NULL);
+    sem_post(&state.recreated);
+    pthread_join(thread, NULL);
+
+    compiler_free(state.instance);
+    sem_destroy(&state.compiled);
+    sem_destroy(&state.recreated);
+    if (!state.results[0] || !state.results[1]) {
+        fprintf(stderr, "compiler_reuse: a compile failed\n");
+        return 1;
+    }
+    return 0;
+}
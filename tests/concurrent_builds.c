@@ -0,0 +1,97 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../compiler.h"
+
+#define BUILDERS 4
+#define ROUNDS 8
+#define JOBS 3
+#define LIBRARIES 4
+#define DIR_TEMPLATE "/tmp/concurrent_builds-XXXXXX"
+#define MAX_PATH_LEN 256
+
+/**
+ * A thread building a program of its own several times, each build starts a worker pool of its own while the
+ * other threads' builds are running
+ */
+typedef struct builder_s {
+    compiler *instance;
+    char dir[sizeof(DIR_TEMPLATE)];
+    size_t failed;
+} builder;
+
+static void write_module(builder *state, char *name, char *source) {
+    char path[MAX_PATH_LEN];
+    snprintf(path, MAX_PATH_LEN, "%s/%s.ro", state->dir, name);
+    FILE *out = fopen(path, "w");
+    fputs(source, out);
+    fclose(out);
+}
+
+/**
+ * Writes a program importing a few libraries, each library defines a function the program calls
+ * @param state Builder
+ */
+static void write_program(builder *state) {
+    char name[MAX_PATH_LEN];
+    char source[MAX_PATH_LEN * LIBRARIES];
+    size_t len = 0;
+    for (size_t i = 0; i < LIBRARIES; i++) {
+        char library[MAX_PATH_LEN];
+        snprintf(name, MAX_PATH_LEN, "lib%zu", i);
+        snprintf(library, MAX_PATH_LEN, "i64 value%zu(i64 x)\n    return x + %zu\n", i, i);
+        write_module(state, name, library);
+        len += snprintf(source + len, sizeof(source) - len, "import lib%zu\n", i);
+    }
+    len += snprintf(source + len, sizeof(source) - len, "\ni64 main()\n    i64 total = 0\n");
+    for (size_t i = 0; i < LIBRARIES; i++) {
+        len += snprintf(source + len, sizeof(source) - len, "    total = total + value%zu(%zu)\n", i, i);
+    }
+    snprintf(source + len, sizeof(source) - len, "    return total\n");
+    write_module(state, "app", source);
+}
+
+static void *build_repeatedly(void *arg) {
+    builder *state = arg;
+    char path[MAX_PATH_LEN];
+    snprintf(path, MAX_PATH_LEN, "%s/app.ro", state->dir);
+    for (size_t round = 0; round < ROUNDS; round++) {
+        state->failed += !compile_program(state->instance, path, JOBS, round % 2 == 1, (parse_options) {false, false},
+            NULL);
+    }
+    return NULL;
+}
+
+int main() {
+    compiler *instance = compiler_new(NULL);
+    builder builders[BUILDERS];
+    pthread_t threads[BUILDERS];
+    for (size_t i = 0; i < BUILDERS; i++) {
+        builders[i] = (builder) {.instance = instance, .dir = DIR_TEMPLATE, .failed = 0};
+        if (mkdtemp(builders[i].dir) == NULL)
+            return 1;
+        write_program(&builders[i]);
+    }
+
+    for (size_t i = 0; i < BUILDERS; i++) {
+        pthread_create(&threads[i], NULL, &build_repeatedly, &builders[i]);
+    }
+    size_t failed = 0;
+    for (size_t i = 0; i < BUILDERS; i++) {
+        pthread_join(threads[i], NULL);
+        failed += builders[i].failed;
+
+        char command[MAX_PATH_LEN];
+        snprintf(command, MAX_PATH_LEN, "rm -rf %s", builders[i].dir);
+        system(command);
+    }
+    compiler_free(instance);
+
+    if (failed > 0) {
+        fprintf(stderr, "concurrent_builds: %zu of %d builds failed\n", failed, BUILDERS * ROUNDS);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../compiler.h"
+
+#define DIR_TEMPLATE "/tmp/library_build-XXXXXX"
+#define LIBRARY_SOURCE "i64 helper(i64 x)\n    return x * 3\n"
+#define PROGRAM_SOURCE "import lib\n\ni64 main()\n    return helper(14)\n"
+#define PROGRAM_EXIT 42
+#define RUNTIME "runtime/libruntime.a"
+#define FIND_ASSEMBLER "command -v nasm > /dev/null"
+#define MAX_PATH_LEN 256
+
+static char dir[] = DIR_TEMPLATE;
+
+static char *dir_path(char *name) {
+    static char path[MAX_PATH_LEN];
+    snprintf(path, MAX_PATH_LEN, "%s/%s", dir, name);
+    return path;
+}
+
+static void write_source(char *name, char *source) {
+    FILE *out = fopen(dir_path(name), "w");
+    fputs(source, out);
+    fclose(out);
+}
+
+static int run_program(char *name) {
+    int status = system(dir_path(name));
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static bool fail(char *message) {
+    fprintf(stderr, "library_build: %s\n", message);
+    return false;
+}
+
+/**
+ * Builds the library module on its own, which fails since it has no main, then the program importing it with each
+ * set of parse options. Outputs of the library built in another role or with other options must not be reused
+ * @param instance Compiler
+ * @param linking How the program is linked, NULL to only write assembly
+ * @return bool: whether every build behaved
+ */
+static bool build_library_then_program(compiler *instance, link_options *linking) {
+    parse_options options[] = {{false, false}, {true, false}, {false, true}, {false, false}};
+    char *library = strdup(dir_path("lib.ro"));
+    char *program = strdup(dir_path("app.ro"));
+    bool passed = true;
+
+    if (compile_program(instance, library, 1, false, options[0], linking)) {
+        passed = fail("a library without main built as a program");
+    }
+    for (size_t i = 0; passed && i < sizeof(options) / sizeof(parse_options); i++) {
+        if (!compile_program(instance, program, 1, false, options[i], linking)) {
+            passed = fail("the program importing the library did not build");
+        } else if (linking != NULL && run_program("app") != PROGRAM_EXIT) {
+            passed = fail("the program importing the library returned the wrong value");
+        }
+    }
+
+    free(library);
+    free(program);
+    return passed;
+}
+
+int main() {
+    if (mkdtemp(dir) == NULL)
+        return 1;
+    write_source("lib.ro", LIBRARY_SOURCE);
+    write_source("app.ro", PROGRAM_SOURCE);
+
+    compiler *instance = compiler_new(NULL);
+    bool passed = build_library_then_program(instance, NULL);
+    if (passed && system(FIND_ASSEMBLER) == 0) {
+        link_options linking = {dir_path("app"), RUNTIME};
+        linking.output = strdup(linking.output);
+        passed = build_library_then_program(instance, &linking);
+        free(linking.output);
+    } else if (passed) {
+        printf("library_build: no assembler, linked builds skipped\n");
+    }
+    compiler_free(instance);
+
+    char command[MAX_PATH_LEN];
+    snprintf(command, MAX_PATH_LEN, "rm -rf %s", dir);
+    system(command);
+    return passed ? 0 : 1;
+}
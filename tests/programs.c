@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../compiler.h"
+
+#define DIR_TEMPLATE "/tmp/programs-XXXXXX"
+#define PROGRAMS_DIR "tests/programs"
+#define RUNTIME "runtime/libruntime.a"
+#define FIND_ASSEMBLER "command -v nasm > /dev/null"
+#define JOBS 2
+#define MAX_PATH_LEN 256
+#define MAX_COMMAND_LEN 1024
+#define MAX_OUTPUT_LEN 4096
+
+#define SHAPES_SOURCE "pure i64 area(i64 w, i64 h)\n    return w * h\n"
+#define CHANGED_BODY_SOURCE "pure i64 area(i64 w, i64 h)\n    return w * h + 1\n"
+#define CHANGED_INTERFACE_SOURCE "pure i64 area(i64 w, i64 h, i64 d)\n    return w * h * d\n"
+#define MODULES_PROGRAM "modules/app.ro"
+#define MODULES_EXIT 28
+#define CHANGED_BODY_EXIT 31
+
+#define DIAGNOSTIC_SOURCE "i64 twice(i64 x)\n    return x * 2\n\ni64 main()\n    i64 a = twice(1, 2)\n" \
+    "    str s = 5\n    a = a + missing\n    return a\n"
+#define EXPECTED_DIAGNOSTICS \
+    "ERROR: diagnostics.ro:5:13: `twice` takes 1 arguments but 2 were given\n" \
+    "        i64 a = twice(1, 2)\n" \
+    "                ^\n" \
+    "ERROR: diagnostics.ro:6:13: Expected `str` but got `i64`\n" \
+    "        str s = 5\n" \
+    "                ^\n" \
+    "ERROR: diagnostics.ro:7:13: Invalid Value\n" \
+    "        a = a + missing\n" \
+    "                ^\n"
+
+/**
+ * A regression program and what running it must give, programs live in tests/programs and are built from a copy
+ * so their outputs are not written into the tree
+ */
+typedef struct regression_s {
+    char *path;
+    char *input;
+    int exit_code;
+    char *output;
+} regression;
+
+/**
+ * A way the driver can compile a program, every program must behave the same in each of them
+ */
+typedef struct mode_s {
+    char *name;
+    bool stream;
+    parse_options options;
+} mode;
+
+static regression programs[] = {
+    {"match.ro", "", 15, ""},
+    {"globals.ro", "", 48, "hi\n"},
+    {"pure.ro", "", 102, ""},
+    {"parallel.ro", "", 99, ""},
+    {"print.ro", "", 5, "hello, world\n1 -42 9223372036854775807 -9223372036854775808\na 7 b\t\"c\"\n"},
+    {"alloc.ro", "", 0, "292 49995000 499500\n"},
+    {"input.ro", "3\n1 2 3\nbob\n77\n", 77, "6 bob\n"},
+    {MODULES_PROGRAM, "", MODULES_EXIT, ""},
+    {}
+};
+
+static mode modes[] = {
+    {"default", false, {false, false}},
+    {"-s", true, {false, false}},
+    {"-d", false, {true, false}},
+    {"-l", false, {false, true}},
+    {}
+};
+
+static char dir[] = DIR_TEMPLATE;
+
+static char *dir_path(char *name) {
+    static char path[MAX_PATH_LEN];
+    snprintf(path, MAX_PATH_LEN, "%s/%s", dir, name);
+    return path;
+}
+
+static void write_file(char *name, char *contents) {
+    FILE *out = fopen(dir_path(name), "w");
+    fputs(contents, out);
+    fclose(out);
+}
+
+static bool fail(char *message, char *name, char *mode_name) {
+    fprintf(stderr, "programs: %s %s: %s\n", name, mode_name, message);
+    return false;
+}
+
+/**
+ * Runs a built program with its input and checks its exit code and output
+ * @param checked Program
+ * @return char*: what went wrong, NULL if the program behaved
+ */
+static char *run_program(regression *checked) {
+    write_file("input", checked->input);
+    char command[MAX_COMMAND_LEN];
+    snprintf(command, MAX_COMMAND_LEN, "%s/program < %s/input > %s/output", dir, dir, dir);
+    int status = system(command);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != checked->exit_code)
+        return "wrong exit code";
+
+    char output[MAX_OUTPUT_LEN];
+    FILE *in = fopen(dir_path("output"), "r");
+    size_t len = fread(output, sizeof(char), MAX_OUTPUT_LEN - 1, in);
+    fclose(in);
+    output[len] = '\0';
+    return strcmp(output, checked->output) == 0 ? NULL : "wrong output";
+}
+
+/**
+ * Builds a program and runs it when it is linked
+ * @param instance Compiler
+ * @param checked Program
+ * @param how How the program is compiled
+ * @param linking How the program is linked, NULL to only write assembly
+ * @return bool: whether the program built and behaved
+ */
+static bool check_program(compiler *instance, regression *checked, mode *how, link_options *linking) {
+    char *path = strdup(dir_path(checked->path));
+    bool built = compile_program(instance, path, JOBS, how->stream, how->options, linking);
+    free(path);
+    if (!built)
+        return fail("did not build", checked->path, how->name);
+
+    char *problem = linking != NULL ? run_program(checked) : NULL;
+    return problem == NULL || fail(problem, checked->path, how->name);
+}
+
+/**
+ * Rebuilds the modules program after changing an imported module. A changed body must reach the program and a
+ * changed interface must make the modules importing it fail to compile
+ * @param instance Compiler
+ * @param linking How the program is linked, NULL to only write assembly
+ * @return bool: whether every rebuild behaved
+ */
+static bool check_rebuilds(compiler *instance, link_options *linking) {
+    regression original = {MODULES_PROGRAM, "", MODULES_EXIT, ""};
+    regression changed_body = {MODULES_PROGRAM, "", CHANGED_BODY_EXIT, ""};
+    bool passed = true;
+    for (mode *how = modes; passed && how->name != NULL; how++) {
+        write_file("modules/shapes.ro", CHANGED_BODY_SOURCE);
+        passed = check_program(instance, &changed_body, how, linking);
+
+        write_file("modules/shapes.ro", CHANGED_INTERFACE_SOURCE);
+        char *path = strdup(dir_path(MODULES_PROGRAM));
+        if (passed && compile_program(instance, path, JOBS, how->stream, how->options, NULL)) {
+            passed = fail("built against an old interface", MODULES_PROGRAM, how->name);
+        }
+        free(path);
+
+        write_file("modules/shapes.ro", SHAPES_SOURCE);
+        passed = passed && check_program(instance, &original, how, linking);
+    }
+    return passed;
+}
+
+static bool check_diagnostics(compiler *instance) {
+    compile_result result = compile_source(instance, "diagnostics.ro", DIAGNOSTIC_SOURCE, strlen(DIAGNOSTIC_SOURCE),
+        true, (parse_options) {false, false});
+    bool passed = !result.compiled && strcmp(result.diagnostics, EXPECTED_DIAGNOSTICS) == 0;
+    if (!passed) {
+        fprintf(stderr, "programs: unexpected diagnostics\n%s", result.diagnostics);
+    }
+    compile_result_free(instance, &result);
+    return passed;
+}
+
+int main() {
+    if (mkdtemp(dir) == NULL)
+        return 1;
+    char command[MAX_COMMAND_LEN];
+    snprintf(command, MAX_COMMAND_LEN, "cp -r %s/. %s", PROGRAMS_DIR, dir);
+    if (system(command) != 0)
+        return 1;
+
+    compiler *instance = compiler_new(NULL);
+    bool linked = system(FIND_ASSEMBLER) == 0;
+    link_options linking = {strdup(dir_path("program")), RUNTIME};
+    link_options *how_linked = linked ? &linking : NULL;
+    if (!linked) {
+        printf("programs: no assembler, programs are only compiled\n");
+    }
+
+    bool passed = check_diagnostics(instance);
+    for (regression *checked = programs; checked->path != NULL; checked++) {
+        for (mode *how = modes; how->name != NULL; how++) {
+            passed = check_program(instance, checked, how, how_linked) && passed;
+        }
+    }
+    passed = passed && check_rebuilds(instance, how_linked);
+
+    free(linking.output);
+    compiler_free(instance);
+    snprintf(command, MAX_COMMAND_LEN, "rm -rf %s", dir);
+    system(command);
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,108 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../service.h"
+
+#define CLIENTS 4
+#define WORKERS 4
+#define ROUNDS 8
+#define REQUESTS_PER_ROUND 64
+#define FUNCTIONS_PER_REQUEST 32
+#define ERRONEOUS_EVERY 4
+#define MAX_SOURCE_LEN (FUNCTIONS_PER_REQUEST * 96 + 512)
+#define MAX_RETAINED_GROWTH (1 << 20)
+
+size_t __sanitizer_get_current_allocated_bytes();
+
+/**
+ * A client of the service sending modules no other request shares a name or literal with, so every compile
+ * interns strings nothing before it interned. Some of the modules have errors on lines that are partly parsed
+ * before the error, they must fail without leaking what was parsed
+ */
+typedef struct client_s {
+    compile_service *service;
+    size_t id;
+    size_t round;
+    size_t unexpected;
+} client;
+
+static size_t write_source(char *source, size_t unique, bool erroneous) {
+    size_t len = 0;
+    for (size_t i = 0; i < FUNCTIONS_PER_REQUEST; i++) {
+        len += snprintf(source + len, MAX_SOURCE_LEN - len, "i64 f%zu_%zu(i64 x%zu)\n    return x%zu + %zu\n", unique,
+            i, unique, unique, unique * FUNCTIONS_PER_REQUEST + i);
+    }
+    len += snprintf(source + len, MAX_SOURCE_LEN - len, "i64 main()\n");
+    if (erroneous) {
+        len += snprintf(source + len, MAX_SOURCE_LEN - len, "    i64 a = (1 + 2) * f%zu_1(3, 4)\n"
+            "    print 1 + 2, f%zu_2(5) * missing\n    for i = 1 + 2, 3 + missing\n        a = a + i\n"
+            "    a = (a * 2) + (3 + 4) * missing\n", unique, unique);
+    }
+    len += snprintf(source + len, MAX_SOURCE_LEN - len, "    return f%zu_0(1)\n", unique);
+    return len;
+}
+
+static void *send_requests(void *arg) {
+    client *sender = arg;
+    char source[MAX_SOURCE_LEN];
+    for (size_t i = 0; i < REQUESTS_PER_ROUND / CLIENTS; i++) {
+        size_t unique = (sender->round * REQUESTS_PER_ROUND / CLIENTS + i) * CLIENTS + sender->id;
+        bool erroneous = unique % ERRONEOUS_EVERY == 0;
+        compile_request request = {
+            .path = "stress.ro",
+            .source = source,
+            .len = write_source(source, unique, erroneous),
+            .entry = true,
+            .options = {false, false},
+            .priority = i % 2 == 0 ? REQUEST_INTERACTIVE : REQUEST_BATCH,
+            .client = sender->id,
+        };
+        compile_job *job = submit_compile(sender->service, &request);
+        sender->unexpected += wait_compile(sender->service, job)->compiled == erroneous;
+        release_compile(sender->service, job);
+    }
+    return NULL;
+}
+
+static size_t run_round(compile_service *service, size_t round) {
+    pthread_t threads[CLIENTS];
+    client clients[CLIENTS];
+    for (size_t i = 0; i < CLIENTS; i++) {
+        clients[i] = (client) {service, i, round, 0};
+        pthread_create(&threads[i], NULL, &send_requests, &clients[i]);
+    }
+
+    size_t unexpected = 0;
+    for (size_t i = 0; i < CLIENTS; i++) {
+        pthread_join(threads[i], NULL);
+        unexpected += clients[i].unexpected;
+    }
+    return unexpected;
+}
+
+int main() {
+    compiler *instance = compiler_new(NULL);
+    compile_service *service = compile_service_new(instance, WORKERS);
+
+    size_t unexpected = run_round(service, 0);
+    size_t retained = __sanitizer_get_current_allocated_bytes();
+    for (size_t round = 1; round < ROUNDS; round++) {
+        unexpected += run_round(service, round);
+    }
+    size_t growth = __sanitizer_get_current_allocated_bytes() - retained;
+
+    service_metrics metrics = compile_service_metrics(service);
+    compile_service_free(service);
+    compiler_free(instance);
+
+    if (unexpected > 0 || metrics.completed != ROUNDS * REQUESTS_PER_ROUND) {
+        fprintf(stderr, "service_stress: %zu of %zu compiles had the wrong outcome\n", unexpected, metrics.completed);
+        return 1;
+    }
+    if ((ssize_t) growth > MAX_RETAINED_GROWTH) {
+        fprintf(stderr, "service_stress: %zu bytes retained across %d rounds\n", growth, ROUNDS - 1);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../compiler.h"
+#include "../shared_cache.h"
+
+#define DIR_TEMPLATE "/tmp/shared_cache-XXXXXX"
+#define WRITERS 8
+#define KEYS_PER_WRITER 200
+#define LIBRARY_SOURCE "i64 helper(i64 x)\n    return x * 3\n"
+#define CHANGED_LIBRARY_SOURCE "i64 helper(i64 x, i64 y)\n    return x * y\n"
+#define PROGRAM_SOURCE "import lib\n\ni64 main()\n    return helper(14)\n"
+#define MAX_PATH_LEN 256
+#define MAX_KEY_LEN 32
+
+static char dir[] = DIR_TEMPLATE;
+
+static char *dir_path(char *name) {
+    static char path[MAX_PATH_LEN];
+    snprintf(path, MAX_PATH_LEN, "%s/%s", dir, name);
+    return path;
+}
+
+static void write_source(char *name, char *source) {
+    FILE *out = fopen(dir_path(name), "w");
+    fputs(source, out);
+    fclose(out);
+}
+
+static bool fail(char *message) {
+    fprintf(stderr, "shared_cache: %s\n", message);
+    return false;
+}
+
+/**
+ * Adds keys of its own to the cache file from a process that opened it itself, as another compiler would
+ * @param writer Index of the writer
+ * @return int: exit status of the writer
+ */
+static int add_keys(size_t writer) {
+    shared_cache *cache = shared_cache_open(dir_path("cache"));
+    if (cache == NULL)
+        return 1;
+    for (size_t i = 0; i < KEYS_PER_WRITER; i++) {
+        char key[MAX_KEY_LEN];
+        size_t value = writer * KEYS_PER_WRITER + i;
+        int key_len = snprintf(key, MAX_KEY_LEN, "key %zu", value);
+        if (!shared_cache_add(cache, key, key_len, (char*) &value, sizeof(size_t)))
+            return 1;
+    }
+    shared_cache_close(cache);
+    return 0;
+}
+
+/**
+ * Adds keys from several processes at once, then checks this process sees every one of them through the mapping it
+ * opened before they were added
+ * @return bool: whether every key was found with its value
+ */
+static bool share_between_processes() {
+    shared_cache *cache = shared_cache_open(dir_path("cache"));
+    if (cache == NULL)
+        return fail("cannot open a cache file");
+
+    pid_t writers[WRITERS];
+    for (size_t i = 0; i < WRITERS; i++) {
+        writers[i] = fork();
+        if (writers[i] == 0)
+            _exit(add_keys(i));
+    }
+    bool passed = true;
+    for (size_t i = 0; i < WRITERS; i++) {
+        int status;
+        if (waitpid(writers[i], &status, 0) != writers[i] || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            passed = fail("a writer could not add its keys");
+        }
+    }
+
+    for (size_t value = 0; passed && value < WRITERS * KEYS_PER_WRITER; value++) {
+        char key[MAX_KEY_LEN];
+        int key_len = snprintf(key, MAX_KEY_LEN, "key %zu", value);
+        size_t size;
+        char *found = shared_cache_find(cache, key, key_len, &size);
+        if (found == NULL || size != sizeof(size_t) || memcmp(found, &value, sizeof(size_t)) != 0) {
+            passed = fail("a key added by another process was not found");
+        }
+    }
+    shared_cache_close(cache);
+    return passed;
+}
+
+/**
+ * Builds a program importing a library, then changes the library's interface right away. The cached interface
+ * must not stand in for the new one even though the file was rewritten moments after it was cached
+ * @return bool: whether the change was seen
+ */
+static bool rebuild_after_interface_change() {
+    write_source("lib.ro", LIBRARY_SOURCE);
+    write_source("app.ro", PROGRAM_SOURCE);
+    char *program = strdup(dir_path("app.ro"));
+    compiler *instance = compiler_new(NULL);
+    bool passed = true;
+
+    if (!compile_program(instance, program, 1, false, (parse_options) {false, false}, NULL)) {
+        passed = fail("the program importing the library did not build");
+    } else if (access(dir_path(".roi-cache"), F_OK) != 0) {
+        passed = fail("the build did not create an interface cache");
+    }
+    write_source("lib.ro", CHANGED_LIBRARY_SOURCE);
+    if (passed && compile_program(instance, program, 1, false, (parse_options) {false, false}, NULL)) {
+        passed = fail("the program built against the library's old interface");
+    }
+
+    compiler_free(instance);
+    free(program);
+    return passed;
+}
+
+int main() {
+    if (mkdtemp(dir) == NULL)
+        return 1;
+    bool passed = share_between_processes() && rebuild_after_interface_change();
+
+    char command[MAX_PATH_LEN];
+    snprintf(command, MAX_PATH_LEN, "rm -rf %s", dir);
+    system(command);
+    return passed ? 0 : 1;
+}
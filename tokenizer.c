@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "interner.h"
 #include "pattern.h"
 
 /**
@@ -84,49 +85,84 @@ char *read_source_file(const char *name) {
 }
 
 /**
- *
- * @param match
- * @param source_code_cursor
- * @param tokenv
- * @return
+ * Splits source code into interned tokens
+ * @param shared Shared compiler state
+ * @param strings Interner the tokens are interned into
+ * @param match Regex match buffer
+ * @param source_code_cursor Source code to tokenize
+ * @param tokenv Where the tokens are added
+ * @param token_offsets Where the byte offset of each token in the file is added, NULL if not needed
+ * @param origin Start of the line the source code belongs to, a newline token before it is placed at its start
+ * @param origin_offset Byte offset of the origin in the file
+ * @return int: 0
  */
-int tokenize(regmatch_t* match, char *source_code_cursor, vec tokenv) {
-    while (next_token(source_code_cursor, match)) {
+int tokenize(compiler_shared *shared, interner *strings, regmatch_t* match, char *source_code_cursor, vec tokenv,
+    vec token_offsets, char *origin, size_t origin_offset) {
+
+    while (next_token(shared, source_code_cursor, match)) {
         source_code_cursor += match->rm_so;
 
         size_t token_len = match->rm_eo - match->rm_so;
-        char* token = malloc(token_len + 1);
-        strncpy(token, source_code_cursor, token_len);
-        token[token_len] = '\0';
-
-        vec_push(tokenv, token);
+        vec_push(tokenv, intern_str(strings, source_code_cursor, token_len));
+        if (token_offsets != NULL) {
+            vec_push_val(token_offsets, origin_offset + (source_code_cursor > origin ? source_code_cursor - origin : 0));
+        }
         source_code_cursor += token_len;
     }
 
     return 0;
 }
 
-char *get_new_line() {
-    char *new_line = malloc(2);
-    strcpy(new_line, "\n");
-    return new_line;
+char *get_new_line(interner *strings) {
+    return intern_str(strings, "\n", 1);
 }
 
 /**
  * Tokenizes an input file
+ * @param shared Shared compiler state
+ * @param strings Interner the tokens are interned into
  * @param filename name of the file
  * @return vec: contains all tokens in the file
  */
-vec tokenize_file(char *filename) {
+vec tokenize_file(compiler_shared *shared, interner *strings, char *filename) {
     vec tokenv = vec_new();
     char *source_file_content = read_source_file(filename);
 
-    vec_push(tokenv, get_new_line());
+    vec_push(tokenv, get_new_line(strings));
     regmatch_t match[1];
-    tokenize(match, source_file_content, tokenv);
-    vec_push(tokenv, get_new_line());
+    tokenize(shared, strings, match, source_file_content, tokenv, NULL, source_file_content, 0);
+    vec_push(tokenv, get_new_line(strings));
 
     free(source_file_content);
 
     return tokenv;
 }
+
+/**
+ * Tokenizes a single line the same way tokenize_file would, so it can be read with a line iterator on its own
+ * @param shared Shared compiler state
+ * @param strings Interner the tokens are interned into
+ * @param text Newline followed by the line's contents, without the line's own newline
+ * @param first_line Whether this is the first line of the file, its indentation is not tokenized
+ * @param line_offset Byte offset of the line in the file
+ * @param token_offsets Where the byte offset of each token is added, the leading newline token is at the line's
+ * start and the trailing one at its end
+ * @return vec: tokens of the line between its leading and trailing newline tokens
+ */
+vec tokenize_line(compiler_shared *shared, interner *strings, char *text, bool first_line, size_t line_offset,
+    vec token_offsets) {
+    vec tokenv = vec_new();
+    regmatch_t match[1];
+    char *contents = text + 1;
+
+    if (first_line) {
+        vec_push(tokenv, get_new_line(strings));
+        vec_push_val(token_offsets, line_offset);
+        text++;
+    }
+    tokenize(shared, strings, match, text, tokenv, token_offsets, contents, line_offset);
+    vec_push(tokenv, get_new_line(strings));
+    vec_push_val(token_offsets, line_offset + strlen(contents));
+
+    return tokenv;
+}
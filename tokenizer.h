@@ -1,12 +1,14 @@
 #ifndef TOKENIZER_H
 #define TOKENIZER_H
 
+#include "context.h"
 #include "vec.h"
 
 #include <stdbool.h>
 
-bool valid_symbol(char *symbol);
+vec tokenize_file(compiler_shared *shared, interner *strings, char *filename);
 
-vec tokenize_file(char *filename);
+vec tokenize_line(compiler_shared *shared, interner *strings, char *text, bool first_line, size_t line_offset,
+    vec token_offsets);
 
 #endif //TOKENIZER_H
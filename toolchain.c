@@ -0,0 +1,101 @@
+#include "toolchain.h"
+
+#include <errno.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define ASSEMBLER "nasm"
+#define OBJECT_FORMAT "elf64"
+#define LINKER "ld"
+#define GC_SECTIONS "--gc-sections"
+#define NO_EXEC_STACK "noexecstack"
+#define TMPFS_DIR "/dev/shm"
+#define TEMP_DIR "/tmp"
+#define ASSEMBLY_DIR_TEMPLATE "/ro-XXXXXX"
+
+extern char **environ;
+
+static bool wait_tool(pid_t pid) {
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR)
+            return false;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/**
+ * Assembles a file into an object. The assembler reads its input once per pass, so it is given a file it can open
+ * again rather than a pipe
+ * @param assembly_path Path of the assembly
+ * @param object_path Path of the object the assembler writes
+ * @return bool: whether the object was assembled
+ */
+bool assemble(char *assembly_path, char *object_path) {
+    char *argv[] = {ASSEMBLER, "-f", OBJECT_FORMAT, "-o", object_path, assembly_path, NULL};
+    pid_t assembler;
+    return posix_spawnp(&assembler, ASSEMBLER, NULL, NULL, argv, environ) == 0 && wait_tool(assembler);
+}
+
+/**
+ * Links objects and the runtime library into an executable with a non-executable stack, sections nothing refers
+ * to are dropped
+ * @param objects Paths of the objects
+ * @param link Where the executable is written and where the runtime library is
+ * @return bool: whether the executable was linked
+ */
+bool link_objects(vec objects, link_options *link) {
+    char **argv = malloc((vec_len(objects) + 8) * sizeof(char*));
+    size_t argc = 0;
+    argv[argc++] = LINKER;
+    argv[argc++] = GC_SECTIONS;
+    argv[argc++] = "-z";
+    argv[argc++] = NO_EXEC_STACK;
+    argv[argc++] = "-o";
+    argv[argc++] = link->output;
+    vec_iter(char *object, objects, argv[argc++] = object)
+    argv[argc++] = link->runtime;
+    argv[argc] = NULL;
+
+    pid_t linker;
+    bool linked = posix_spawnp(&linker, LINKER, NULL, NULL, argv, environ) == 0 && wait_tool(linker);
+    free(argv);
+    return linked;
+}
+
+/**
+ * Creates a directory for the assembly of a build, which only lives until it is assembled, in memory when a tmpfs
+ * is mounted
+ * @return char*: path of the directory, NULL if it could not be created
+ */
+char *make_assembly_dir() {
+    struct stat info;
+    char *parent = stat(TMPFS_DIR, &info) == 0 && S_ISDIR(info.st_mode) && access(TMPFS_DIR, W_OK) == 0
+        ? TMPFS_DIR : getenv("TMPDIR") != NULL ? getenv("TMPDIR") : TEMP_DIR;
+
+    size_t parent_len = strlen(parent);
+    char *dir = malloc(parent_len + sizeof(ASSEMBLY_DIR_TEMPLATE));
+    memcpy(dir, parent, parent_len);
+    memcpy(dir + parent_len, ASSEMBLY_DIR_TEMPLATE, sizeof(ASSEMBLY_DIR_TEMPLATE));
+    if (mkdtemp(dir) == NULL) {
+        free(dir);
+        return NULL;
+    }
+    return dir;
+}
+
+/**
+ * Removes a build's assembly directory with the files in it
+ * @param dir Directory, it is freed
+ * @param files Paths of the files that may have been written
+ */
+void remove_assembly_dir(char *dir, vec files) {
+    vec_iter(char *file, files, remove(file))
+    rmdir(dir);
+    free(dir);
+}
@@ -0,0 +1,25 @@
+#ifndef TOOLCHAIN_H
+#define TOOLCHAIN_H
+
+#include <stdbool.h>
+
+#include "vec.h"
+
+/**
+ * How a built program is linked, each module's object is kept next to its source and reused while the module is up
+ * to date, only its assembly goes to a temporary directory until it is assembled
+ */
+typedef struct link_options_s {
+    char *output;
+    char *runtime;
+} link_options;
+
+bool assemble(char *assembly_path, char *object_path);
+
+bool link_objects(vec objects, link_options *link);
+
+char *make_assembly_dir();
+
+void remove_assembly_dir(char *dir, vec files);
+
+#endif //TOOLCHAIN_H
@@ -4,51 +4,57 @@
 #include <string.h>
 
 #include "pattern.h"
-#include "vec.h"
 
 #define i64_SIZE 8
 #define STR_SIZE 8
 
-static vec types;
-
-type *new_native_type(char *name, size_t size, bool (*validate_literal)(char*)) {
-    type *data_type = malloc(sizeof(type));
-    data_type->name = name;
-    data_type->size = size;
-    data_type->validate_literal = validate_literal;
-    return data_type;
-}
-
-void compile_native_types() {
-    types = vec_new();
-    vec_push(types, new_native_type("i64", i64_SIZE, &valid_i64_literal));
-    vec_push(types, new_native_type("str", STR_SIZE, &valid_string_literal));
-}
-
-void free_types() {
-    free_vec_and_elements(types);
-}
+/**
+ * Native types in the order of their ids, the table is never written so every compilation shares it
+ */
+static type native_types[] = {
+    {"i64", i64_SIZE, &valid_i64_literal},
+    {"str", STR_SIZE, &valid_string_literal},
+    {}
+};
 
 type *get_type(char *type_name) {
-    vec_iter(type *curr, types, {
+    for (type *curr = native_types; curr->name != NULL; curr++) {
         if (strcmp(type_name, curr->name) == 0) {
             return curr;
         }
-    })
+    }
 
     return NULL;
 }
 
+/**
+ * Gets a compact id for a type, ids follow the order native types are registered in
+ * @param data_type Type
+ * @return size_t: id of the type
+ */
+size_t get_type_id(type *data_type) {
+    size_t id = 0;
+    while (native_types[id].name != NULL && native_types + id != data_type) {
+        id++;
+    }
+    return id;
+}
+
+type *get_type_by_id(size_t id) {
+    size_t count = sizeof(native_types) / sizeof(type) - 1;
+    return id < count ? native_types + id : NULL;
+}
+
 bool valid_type(char *type_name) {
     return get_type(type_name) != NULL;
 }
 
 type *get_literal_type(char *literal) {
-    vec_iter(type *curr_type, types, {
+    for (type *curr_type = native_types; curr_type->name != NULL; curr_type++) {
         if ((*curr_type->validate_literal)(literal)) {
             return curr_type;
         }
-    })
+    }
 
     return NULL;
 }
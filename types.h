@@ -10,11 +10,11 @@ typedef struct type_s {
     bool (*validate_literal)(char*);
 } type;
 
-void compile_native_types();
+type *get_type(char *type);
 
-void free_types();
+size_t get_type_id(type *data_type);
 
-type *get_type(char *type);
+type *get_type_by_id(size_t id);
 
 bool valid_type(char *type);
 
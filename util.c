@@ -5,19 +5,20 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "assembly_generator.h"
 #include "ast_node.h"
+#include "constant.h"
+#include "diagnostics.h"
 #include "pattern.h"
 #include "types.h"
 
-#define ERROR_LINE_MESSAGE "ERROR: %s: Line %lu: "
-
 void assert_valid_type(char *type_name, type *expr_type, line *curr_line) {
     if (expr_type == NULL)
         raise_compiler_error("Invalid type `%s`", curr_line, type_name);
 }
 
 void assert_valid_symbol(char *symbol, line *curr_line) {
-    if (!valid_symbol(symbol))
+    if (!valid_symbol(bound_compilation()->shared, symbol))
         raise_compiler_error("Invalid symbol `%s`", curr_line, symbol);
 }
 
@@ -36,8 +37,64 @@ void assert_unique_var(char *var_name, namespace *ns, line *curr_line) {
         raise_compiler_error("`%s` is already defined", curr_line, var_name);
 }
 
+void assert_constant(ast_node *node, line *curr_line) {
+    int64_t value;
+    if (node->generate_assembly != &literal_assembly && !evaluate_constant(node, &value))
+        raise_compiler_error("Initializer is not a constant expression", curr_line);
+}
+
+/**
+ * Checks that an expression has the type its context needs, values are never converted implicitly
+ * @param node Expression
+ * @param expected Type the context needs
+ * @param position Where the expression starts
+ */
+void assert_type(ast_node *node, type *expected, span position) {
+    if (node->expr_type != expected)
+        raise_compiler_error_at("Expected `%s` but got `%s`", position, expected->name, node->expr_type->name);
+}
+
+static void release_node(void *node) {
+    ((ast_node*) node)->free_func(node);
+}
+
+static void release_nodes(void *nodes) {
+    vec_iter(ast_node *node, (vec) nodes, node->free_func(node))
+    vec_free(nodes);
+}
+
+/**
+ * Holds a node until it is attached to its parent, so an error before then frees it
+ * @param node Node being built
+ */
+void hold_node(ast_node *node) {
+    hold_partial(node, &release_node);
+}
+
+/**
+ * Holds nodes collected for a parent that is not built yet, an error before then frees them and the vector
+ * @param nodes Nodes being collected
+ */
+void hold_nodes(vec nodes) {
+    hold_partial(nodes, &release_nodes);
+}
+
 /**
- * Raises a fatal compiler error, displays info about the error
+ * Reports a compiler error without stopping, the compile fails once it is finished
+ * @param message Message related to the type of error
+ * @param error_line Line the error occured on
+ * @param ... Format arguments
+ */
+void report_compiler_error(char *message, line *error_line, ...) {
+    va_list args;
+    va_start(args, error_line);
+    add_diagnostic(SEVERITY_ERROR, error_line->position, message, args);
+    va_end(args);
+}
+
+/**
+ * Raises a compiler error, the rest of the current line is abandoned and the compile continues with the next one.
+ * Outside of a line the error is fatal
  * @param message Message related to the type of error
  * @param error_line Line the error occured on
  * @param ... Format arguments
@@ -45,11 +102,23 @@ void assert_unique_var(char *var_name, namespace *ns, line *curr_line) {
 void raise_compiler_error(char *message, line *error_line, ...) {
     va_list args;
     va_start(args, error_line);
+    add_diagnostic(SEVERITY_ERROR, error_line->position, message, args);
+    va_end(args);
 
-    fprintf(stderr, ERROR_LINE_MESSAGE, error_line->filename, error_line->line_num);
-    vfprintf(stderr, message, args);
-    fprintf(stderr, "\n");
+    abandon_recoverable();
+}
+
+/**
+ * Raises a compiler error pointing at a specific place, such as one token of a line
+ * @param message Message related to the type of error
+ * @param position Where the error is
+ * @param ... Format arguments
+ */
+void raise_compiler_error_at(char *message, span position, ...) {
+    va_list args;
+    va_start(args, position);
+    add_diagnostic(SEVERITY_ERROR, position, message, args);
     va_end(args);
 
-    exit(1);
+    abandon_recoverable();
 }
@@ -14,6 +14,18 @@ void assert_has_min_tokens(int min_tokens, int line_offset, line *curr_line);
 
 void assert_unique_var(char *var_name, namespace *ns, line *curr_line);
 
+void assert_constant(ast_node *node, line *curr_line);
+
+void assert_type(ast_node *node, type *expected, span position);
+
+void hold_node(ast_node *node);
+
+void hold_nodes(vec nodes);
+
+void report_compiler_error(char *message, line *error_line, ...);
+
 void raise_compiler_error(char *message, line *error_line, ...);
 
+void raise_compiler_error_at(char *message, span position, ...);
+
 #endif //UTIL_H
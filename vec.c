@@ -2,6 +2,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define INITIAL_CAPACITY 16
 #define ALLOCATION_SHIFT 3
@@ -46,6 +47,16 @@ void vec_push(vec v, void *element) {
     v->len++;
 }
 
+void vec_insert(vec v, size_t i, void *element) {
+    if (v->len == v->capacity) {
+        vec_double_capacity(v);
+    }
+
+    memmove(v->buffer + i + 1, v->buffer + i, (v->len - i) << ALLOCATION_SHIFT);
+    vec_set(v, i, element);
+    v->len++;
+}
+
 void *vec_pop(vec v) {
     return v->buffer[--v->len];
 }
@@ -26,6 +26,8 @@ void vec_set(vec v, size_t i, void *element);
 
 void vec_push(vec v, void *element);
 
+void vec_insert(vec v, size_t i, void *element);
+
 void *vec_pop(vec v);
 
 void *vec_peek_end(vec v);